@@ -0,0 +1,237 @@
+#include "AsyncCarDealershipManager.h"
+
+#define PENDING_CAPACITY (2 * BATCH_SIZE)
+
+using namespace wet1;
+
+AsyncCarDealershipManager::AsyncCarDealershipManager(bool coalesce) : manager(), coalescing(coalesce),
+ queue(), next_seq(1),
+ failed_events(0), stopping(false), applier_sleeping(false), pending(nullptr),
+ pending_order(nullptr), pending_num(0), applied_through(0)
+{
+    pending = new PendingDelta[PENDING_CAPACITY];
+    for (int i = 0; i < PENDING_CAPACITY; i++)
+    {
+        pending[i].used = false;
+    }
+    pending_order = new int[BATCH_SIZE];
+    applier = std::thread(&AsyncCarDealershipManager::applierLoop, this);
+}
+
+AsyncCarDealershipManager::~AsyncCarDealershipManager()
+{
+    stopping.store(true);
+    {
+        std::lock_guard<std::mutex> guard(wakeup_lock);
+        wakeup.notify_one();
+    }
+    applier.join();
+    delete[] pending;
+    delete[] pending_order;
+}
+
+unsigned long AsyncCarDealershipManager::enqueue(EventType event_type, int typeId, int modelId, int arg)
+{
+    Event* event = new Event;
+    event->event_type = event_type;
+    event->typeId = typeId;
+    event->modelId = modelId;
+    event->arg = arg;
+    unsigned long seq = next_seq.fetch_add(1);
+    event->seq = seq;
+    queue.push(event); //the applier may free the event from here on
+    if(applier_sleeping.load())
+    {
+        std::lock_guard<std::mutex> guard(wakeup_lock);
+        wakeup.notify_one();
+    }
+    return seq;
+}
+
+StatusType AsyncCarDealershipManager::AddCarType(int typeId, int numOfModels, unsigned long* seq)
+{
+    if(typeId <= 0 || numOfModels <= 0)
+        return INVALID_INPUT;
+    unsigned long event_seq = enqueue(ADD_TYPE_EVENT, typeId, 0, numOfModels);
+    if(seq)
+        *seq = event_seq;
+    return SUCCESS;
+}
+
+StatusType AsyncCarDealershipManager::RemoveCarType(int typeId, unsigned long* seq)
+{
+    if(typeId <= 0)
+        return INVALID_INPUT;
+    unsigned long event_seq = enqueue(REMOVE_TYPE_EVENT, typeId, 0, 0);
+    if(seq)
+        *seq = event_seq;
+    return SUCCESS;
+}
+
+StatusType AsyncCarDealershipManager::SellCar(int typeId, int modelId, unsigned long* seq)
+{
+    if(typeId <= 0 || modelId < 0)
+        return INVALID_INPUT;
+    unsigned long event_seq = enqueue(SELL_EVENT, typeId, modelId, 0);
+    if(seq)
+        *seq = event_seq;
+    return SUCCESS;
+}
+
+StatusType AsyncCarDealershipManager::MakeComplaint(int typeId, int modelId, int t, unsigned long* seq)
+{
+    if(typeId <= 0 || modelId < 0 || t <= 0)
+        return INVALID_INPUT;
+    unsigned long event_seq = enqueue(COMPLAINT_EVENT, typeId, modelId, t);
+    if(seq)
+        *seq = event_seq;
+    return SUCCESS;
+}
+
+void AsyncCarDealershipManager::applierLoop()
+{
+    unsigned long* batch_seqs = new unsigned long[BATCH_SIZE];
+    unsigned long processed = 0;
+    while(true)
+    {
+        int batch_num = 0;
+        {
+            std::lock_guard<std::mutex> guard(manager_lock);
+            Event* event = nullptr;
+            while(batch_num < BATCH_SIZE && (event = queue.pop()) != nullptr)
+            {
+                if(coalescing && (event->event_type == SELL_EVENT || event->event_type == COMPLAINT_EVENT))
+                {
+                    coalesce(event);
+                }
+                else
+                {
+                    flushPending();
+                    applyEvent(event);
+                }
+                batch_seqs[batch_num++] = event->seq;
+                delete event;
+            }
+            flushPending();
+        }
+        if(batch_num > 0)
+        {
+            processed += batch_num;
+            markApplied(batch_seqs, batch_num);
+            continue;
+        }
+        /*nothing popped - sleep unless an event was enqueued meanwhile*/
+        applier_sleeping.store(true);
+        if(next_seq.load() - 1 == processed)
+        {
+            if(stopping.load())
+                break;
+            std::unique_lock<std::mutex> lock(wakeup_lock);
+            wakeup.wait(lock, [&]{ return stopping.load() || next_seq.load() - 1 != processed; });
+        }
+        else
+        {
+            /*a producer is still linking its event*/
+            std::this_thread::yield();
+        }
+        applier_sleeping.store(false);
+    }
+    delete[] batch_seqs;
+}
+
+void AsyncCarDealershipManager::coalesce(Event* event)
+{
+    unsigned mask = PENDING_CAPACITY - 1;
+    unsigned index = ((unsigned)event->typeId * 2654435761u ^ (unsigned)event->modelId * 40503u) & mask;
+    while(pending[index].used &&
+        (pending[index].typeId != event->typeId || pending[index].modelId != event->modelId))
+    {
+        index = (index + 1) & mask;
+    }
+    PendingDelta& delta = pending[index];
+    if(!delta.used)
+    {
+        delta.used = true;
+        delta.typeId = event->typeId;
+        delta.modelId = event->modelId;
+        delta.sales = 0;
+        delta.score_delta = 0;
+        delta.events = 0;
+        pending_order[pending_num++] = index;
+    }
+    if(event->event_type == SELL_EVENT)
+        delta.sales++;
+    else
+        delta.score_delta -= 100 / event->arg;
+    delta.events++;
+}
+
+void AsyncCarDealershipManager::flushPending()
+{
+    for (int i = 0; i < pending_num; i++)
+    {
+        PendingDelta& delta = pending[pending_order[i]];
+        if(manager.ApplyModelDelta(delta.typeId, delta.modelId, delta.sales, delta.score_delta) != SUCCESS)
+            failed_events.fetch_add(delta.events);
+        delta.used = false;
+    }
+    pending_num = 0;
+}
+
+void AsyncCarDealershipManager::applyEvent(Event* event)
+{
+    StatusType res;
+    if(event->event_type == ADD_TYPE_EVENT)
+        res = manager.AddCarType(event->typeId, event->arg);
+    else if(event->event_type == REMOVE_TYPE_EVENT)
+        res = manager.RemoveCarType(event->typeId);
+    else if(event->event_type == SELL_EVENT)
+        res = manager.SellCar(event->typeId, event->modelId);
+    else
+        res = manager.MakeComplaint(event->typeId, event->modelId, event->arg);
+    if(res != SUCCESS)
+        failed_events.fetch_add(1);
+}
+
+void AsyncCarDealershipManager::markApplied(unsigned long* seqs, int seqs_num)
+{
+    std::lock_guard<std::mutex> guard(applied_lock);
+    for (int i = 0; i < seqs_num; i++)
+    {
+        applied_ahead.push(seqs[i]);
+    }
+    while(!applied_ahead.empty() && applied_ahead.top() == applied_through + 1)
+    {
+        applied_through++;
+        applied_ahead.pop();
+    }
+    applied_changed.notify_all();
+}
+
+void AsyncCarDealershipManager::waitApplied(unsigned long seq)
+{
+    std::unique_lock<std::mutex> lock(applied_lock);
+    applied_changed.wait(lock, [&]{ return applied_through >= seq; });
+}
+
+void AsyncCarDealershipManager::sync()
+{
+    waitApplied(next_seq.load() - 1);
+}
+
+unsigned long AsyncCarDealershipManager::getFailedEvents()
+{
+    return failed_events.load();
+}
+
+StatusType AsyncCarDealershipManager::GetBestSellerModelByType(int typeId, int* modelId)
+{
+    std::lock_guard<std::mutex> guard(manager_lock);
+    return manager.GetBestSellerModelByType(typeId, modelId);
+}
+
+StatusType AsyncCarDealershipManager::GetWorstModels(int numOfModels, int* types, int* models)
+{
+    std::lock_guard<std::mutex> guard(manager_lock);
+    return manager.GetWorstModels(numOfModels, types, models);
+}
@@ -0,0 +1,110 @@
+#ifndef ASYNC_CAR_DEALER
+#define ASYNC_CAR_DEALER
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include "CarDealershipManager.h"
+#include "MpscQueue.h"
+
+namespace wet1
+{
+    /**
+     * Asynchronous ingestion front end of a CarDealershipManager.
+     * Producers push mutations to a lock free MPSC queue and get back a
+     * sequence number. One applier thread drains the queue in batches and
+     * merges the SellCar/MakeComplaint events of each (type, model) into a
+     * single ApplyModelDelta, so a hot model is moved in the trees once per
+     * batch. AddCarType/RemoveCarType are barriers - pending deltas are
+     * applied before them. Without coalescing every event is applied on its
+     * own, in queue order.
+     * Queries see the applied state. waitApplied(seq) gives read your writes.
+     * Input is validated when enqueued; events that fail when applied (unknown
+     * type or model) are only counted in getFailedEvents().
+     */
+    class AsyncCarDealershipManager
+    {
+        private:
+            typedef enum {
+                ADD_TYPE_EVENT,
+                REMOVE_TYPE_EVENT,
+                SELL_EVENT,
+                COMPLAINT_EVENT,
+            } EventType;
+
+            struct Event
+            {
+                std::atomic<Event*> next;
+                EventType event_type;
+                int typeId, modelId, arg;
+                unsigned long seq;
+            };
+
+            /*open addressing table of the pending deltas of the current batch*/
+            struct PendingDelta
+            {
+                int typeId, modelId, sales, score_delta;
+                int events;
+                bool used;
+            };
+
+            CarDealershipManager manager;
+            std::mutex manager_lock;
+            bool coalescing;
+            MpscQueue<Event> queue;
+            std::atomic<unsigned long> next_seq;
+            std::atomic<unsigned long> failed_events;
+
+            /*applier side*/
+            std::thread applier;
+            std::atomic<bool> stopping;
+            std::atomic<bool> applier_sleeping;
+            std::mutex wakeup_lock;
+            std::condition_variable wakeup;
+            PendingDelta* pending;
+            int* pending_order;
+            int pending_num;
+
+            /*applied watermark - every seq up to applied_through was applied*/
+            std::mutex applied_lock;
+            std::condition_variable applied_changed;
+            unsigned long applied_through;
+            std::priority_queue<unsigned long, std::vector<unsigned long>,
+                std::greater<unsigned long> > applied_ahead; //applied seqs past the watermark
+
+            unsigned long enqueue(EventType event_type, int typeId, int modelId, int arg);
+            void applierLoop();
+            void coalesce(Event* event);
+            void flushPending();
+            void applyEvent(Event* event);
+            void markApplied(unsigned long* seqs, int seqs_num);
+
+        public:
+            static const int BATCH_SIZE = 4096;
+
+            explicit AsyncCarDealershipManager(bool coalesce = true);
+            ~AsyncCarDealershipManager();
+            AsyncCarDealershipManager(const AsyncCarDealershipManager&) = delete;
+            AsyncCarDealershipManager& operator=(const AsyncCarDealershipManager&) = delete;
+
+            /*seq may be NULL*/
+            StatusType AddCarType (int typeId, int numOfModels, unsigned long* seq);
+            StatusType RemoveCarType (int typeId, unsigned long* seq);
+            StatusType SellCar (int typeId, int modelId, unsigned long* seq);
+            StatusType MakeComplaint (int typeId, int modelId, int t, unsigned long* seq);
+
+            /*blocks until the event with this sequence number and all before it were applied*/
+            void waitApplied(unsigned long seq);
+            /*blocks until everything enqueued so far was applied*/
+            void sync();
+            unsigned long getFailedEvents();
+
+            StatusType GetBestSellerModelByType (int typeId, int* modelId);
+            StatusType GetWorstModels (int numOfModels, int* types, int* models);
+    };
+}
+#endif
@@ -1,296 +1,983 @@
 #ifndef AVLTREE_H
 #define AVLTREE_H
 
+#include <new>
+#include <stdint.h>
 #include "exceptions.h"
+#include "Trace.h"
 
 namespace wet1
 {
+    /*cache hints for batched lookups, no-ops where the builtin is missing*/
+    inline void prefetch(const void* address) {
+#if defined(__GNUC__)
+        __builtin_prefetch(address);
+#else
+        (void)address;
+#endif
+    }
+
+    /*pointer data is compared through what it points to - fetch that too*/
+    template<typename U>
+    inline void prefetchPointee(U* const& data) {
+        prefetch(data);
+    }
+
+    template<typename U>
+    inline void prefetchPointee(const U&) {}
+
     template<typename T>
     class AvlTreeNode {
         T data;
         AvlTreeNode* parent;
         AvlTreeNode* left;
         AvlTreeNode* right;
-        int height;
+        int balance_info; //height for AVL, color for red-black, unused by splay
+        int subtree_size; //nodes in the subtree rooted here, for rank queries
 
     public:
-        AvlTreeNode(const T& data) : data(data) , parent(nullptr),left(nullptr), right(nullptr), height(0) {}
+        AvlTreeNode(const T& data) : data(data) , parent(nullptr),left(nullptr), right(nullptr), balance_info(0),
+                                     subtree_size(1) {}
         AvlTreeNode(const T& data , AvlTreeNode<T>* father ) : data(data) , parent(father), left(nullptr),
-                                                                right(nullptr), height(0) {}
-        AvlTreeNode* buildATree(T* arr, int max, int min) {
-            if ((max-min) < 0 ) return nullptr;
-            int mid = (max+min)/2;
-            AvlTreeNode* node = new AvlTreeNode<T>(arr[mid]);
-
-            node->left = buildATree(arr, mid-1,min);
-            if (node->left) node->left->parent = node;
-            int left_height = node->left ? node->left->height : -1 ;
-            node->right = buildATree(arr, max,mid+1);
-            if (node->right) node->right->parent = node;
-            int right_height = node->right ? node->right->height : -1 ;
-            node->height = right_height > left_height ? right_height : left_height;
-            node->height++;
-            return node;
-        }
+                                                                right(nullptr), balance_info(0), subtree_size(1) {}
         AvlTreeNode<T>* get_left() {
-            return this->left ? this->left : nullptr ;
+            return this->left;
         }
         void set_left(AvlTreeNode<T>* node) {
             this->left = node;
         }
         AvlTreeNode<T>* get_right() {
-            return this->right ? this->right : nullptr;
+            return this->right;
         }
         void set_right(AvlTreeNode<T>* node) {
             this->right = node;
         }
         AvlTreeNode<T>* get_parent() {
-            return this->parent ? this->parent : nullptr ;
+            return this->parent;
         }
         void set_parent(AvlTreeNode<T>* node) {
             this->parent = node;
         }
-        int get_height(){
-            return this->height ? this->height : -1;
+        int get_balance_info() {
+            return this->balance_info;
         }
-        int get_left_height(){
-            return left ? left->height : -1;
+        void set_balance_info(int info) {
+            this->balance_info = info;
         }
-        int get_right_height(){
-            return right ? right->height : -1;
+        int get_subtree_size() {
+            return this->subtree_size;
         }
-        void set_height(int new_height){
-            this->height = new_height;
+        void set_subtree_size(int new_size) {
+            this->subtree_size = new_size;
         }
         T& get_data() {
             return this->data;
         }
-        T& get_left_data() {
-            return left->get_data();
-        }
-        T& get_right_data() {
-            return right->get_data();
-        }
         void set_data( T& new_data) {
             this->data = new_data;
         }
-        void destroyTree(AvlTreeNode<T>* root) {
-            if (root == nullptr ) return;
-            destroyTree(root->left);
-            destroyTree(root->right);
-            delete root;
-        }
     };
 
-    template<typename T, typename Comp>
-    class AvlTree {
-        AvlTreeNode<T>* root;
-        Comp compFunc;
-        AvlTreeNode<T>* youngest;
-        AvlTreeNode<T>* oldest;
-        int max(int x, int y) {
-            return ( x > y ) ? x : y;
-        }
+    /**
+     * Structural helpers shared by the balancing policies. root is the tree's
+     * root pointer, updated when a node at the top moves. Rotations keep the
+     * subtree sizes; a policy's remove calls detach before restructuring.
+     */
+    template<typename T>
+    struct TreeLinks {
+        typedef AvlTreeNode<T> Node;
 
-    public:
-        AvlTree() : root(nullptr),compFunc(), youngest(nullptr), oldest(nullptr) {}
-        AvlTree(T* arr, int max , int min) : root(nullptr),compFunc(), youngest(nullptr) {
-            root = root->buildATree(arr,max,min);
-            youngest = get_younget_child(root);
-            oldest = get_oldest_child(root);
+        static int size(Node* node) {
+            return node ? node->get_subtree_size() : 0;
         }
-        ~AvlTree() {
-            root->destroyTree(root);
-        };
 
-        AvlTreeNode<T>* getRoot() {
-            return this->root;
+        static void resize(Node* node) {
+            node->set_subtree_size(1 + size(node->get_left()) + size(node->get_right()));
         }
-        void set_root(AvlTreeNode<T>* new_root) {
-            root = new_root;
+
+        /*node is leaving the tree - it counts as empty, its ancestors shrink*/
+        static void detach(Node* node) {
+            node->set_subtree_size(0);
+            for (Node* parent = node->get_parent(); parent; parent = parent->get_parent())
+                parent->set_subtree_size(parent->get_subtree_size() - 1);
         }
 
-    private:
+        /*the node with rank nodes before it in the subtree, nullptr if there is none*/
+        static Node* select(Node* node, int rank) {
+            if (rank < 0)
+                return nullptr;
+            while (node) {
+                int left = size(node->get_left());
+                if (rank < left)
+                    node = node->get_left();
+                else if (rank == left)
+                    return node;
+                else {
+                    rank -= left + 1;
+                    node = node->get_right();
+                }
+            }
+            return nullptr;
+        }
 
-        AvlTreeNode<T>* find_in_tree(AvlTreeNode<T>* node , const T& data_to_find ) {
-            if (!node) return nullptr;
-            if (compFunc(data_to_find, node->get_data()))
-                return find_in_tree(node->get_left(),data_to_find);
-            else if (compFunc(node->get_data(),data_to_find))
-                return find_in_tree(node->get_right(),data_to_find);
-            else return node;
-            return nullptr; //should never get here
+        static void replaceChild(Node*& root, Node* parent, Node* old_child, Node* new_child) {
+            if (!parent)
+                root = new_child;
+            else if (parent->get_left() == old_child)
+                parent->set_left(new_child);
+            else
+                parent->set_right(new_child);
+            if (new_child)
+                new_child->set_parent(parent);
         }
 
+        static void rotateLeft(Node*& root, Node* x) {
+            Node* y = x->get_right();
+            Node* z = y->get_left();
+            replaceChild(root, x->get_parent(), x, y);
+            y->set_left(x);
+            x->set_parent(y);
+            x->set_right(z);
+            if (z) z->set_parent(x);
+            y->set_subtree_size(x->get_subtree_size());
+            resize(x);
+        }
 
-        AvlTreeNode<T>* rightRotate(AvlTreeNode<T>* y)
-        {
-            AvlTreeNode<T>* x = y->get_left();
-            AvlTreeNode<T>* z = x ? x->get_right() : nullptr ;
+        static void rotateRight(Node*& root, Node* y) {
+            Node* x = y->get_left();
+            Node* z = x->get_right();
+            replaceChild(root, y->get_parent(), y, x);
             x->set_right(y);
-            x->set_parent(y->get_parent());
             y->set_parent(x);
             y->set_left(z);
             if (z) z->set_parent(y);
-            y->set_height(1 + max(y->get_left_height(),y->get_right_height()));
-            x->set_height(1 + max(x->get_left_height(),x->get_right_height()));
+            x->set_subtree_size(y->get_subtree_size());
+            resize(y);
+        }
 
-            return x;
+        static Node* minimum(Node* node) {
+            while (node && node->get_left())
+                node = node->get_left();
+            return node;
         }
 
+        static Node* maximum(Node* node) {
+            while (node && node->get_right())
+                node = node->get_right();
+            return node;
+        }
 
-        AvlTreeNode<T>* leftRotate(AvlTreeNode<T>* x)
-        {
-            AvlTreeNode<T>* y = x->get_right();
-            AvlTreeNode<T>* z = y ? y->get_left() : nullptr;
-            y->set_left(x);
-            y->set_parent(x->get_parent());
-            x->set_parent(y);
-            x->set_right(z);
-            if (z) z->set_parent(x);
-            y->set_height(1 + max(y->get_left_height(),y->get_right_height()));
-            x->set_height(1 + max(x->get_left_height(),x->get_right_height()));
+        /*next node in order, nullptr after the last one*/
+        static Node* successor(Node* node) {
+            if (node->get_right())
+                return minimum(node->get_right());
+            Node* parent = node->get_parent();
+            while (parent && node == parent->get_right()) {
+                node = parent;
+                parent = parent->get_parent();
+            }
+            return parent;
+        }
 
-            return y;
+        /**
+         * node has two children - swaps its place in the tree (and its
+         * balance_info and subtree size) with its successor's, so node has at
+         * most one child
+         */
+        static void swapWithSuccessor(Node*& root, Node* node) {
+            Node* succ = minimum(node->get_right());
+            Node* left = node->get_left();
+            Node* right = node->get_right();
+            Node* succ_parent = succ->get_parent();
+            Node* succ_right = succ->get_right();
+            replaceChild(root, node->get_parent(), node, succ);
+            succ->set_left(left);
+            left->set_parent(succ);
+            if (succ == right) {
+                succ->set_right(node);
+                node->set_parent(succ);
+            }
+            else {
+                succ->set_right(right);
+                right->set_parent(succ);
+                succ_parent->set_left(node);
+                node->set_parent(succ_parent);
+            }
+            node->set_left(nullptr);
+            node->set_right(succ_right);
+            if (succ_right) succ_right->set_parent(node);
+            int info = node->get_balance_info();
+            node->set_balance_info(succ->get_balance_info());
+            succ->set_balance_info(info);
+            int succ_size = succ->get_subtree_size();
+            succ->set_subtree_size(node->get_subtree_size());
+            node->set_subtree_size(succ_size);
         }
 
-        AvlTreeNode<T>* get_younget_child(AvlTreeNode<T>* node) {
-            if(!node)
-                return nullptr;
-            if ( node->get_left() == nullptr )
-                return node;
-            else return get_younget_child(node->get_left());
+        /*removes a node with at most one child, returns its old parent*/
+        static Node* unlink(Node*& root, Node* node) {
+            Node* child = node->get_left() ? node->get_left() : node->get_right();
+            Node* parent = node->get_parent();
+            replaceChild(root, parent, node, child);
+            node->set_parent(nullptr);
+            node->set_left(nullptr);
+            node->set_right(nullptr);
+            return parent;
         }
+    };
 
-        AvlTreeNode<T>* get_oldest_child(AvlTreeNode<T>* node) {
-            if(!node)
-                return nullptr;
-            if ( node->get_right() == nullptr )
-                return node;
-            else return get_oldest_child(node->get_right());
+    /*treeHeight of the policies that keep no heights - finding one is a walk of the whole tree*/
+    enum { HEIGHT_UNTRACKED = -2 };
+
+    /*compactStep that could not get the memory for its pass - the tree is valid, not laid out*/
+    enum { COMPACT_OUT_OF_MEMORY = -1 };
+
+    /**
+     * Balancing policies. Each one gets a node already linked in as a leaf
+     * (afterInsert), or a node to take out (remove), and restores its
+     * invariant. afterBuild sets up a node of a tree built from a sorted
+     * array; access is called on every successful lookup.
+     */
+
+    /*height balanced, at most one (double) rotation per insert*/
+    struct AvlBalance {
+        enum { REORDERS_ON_ACCESS = 0 };
+
+        template<typename T>
+        static int height(AvlTreeNode<T>* node) {
+            return node ? node->get_balance_info() : -1;
         }
 
+        template<typename T>
+        static void update(AvlTreeNode<T>* node) {
+            int left = height(node->get_left());
+            int right = height(node->get_right());
+            node->set_balance_info(1 + (left > right ? left : right));
+        }
 
-        AvlTreeNode<T>* insert( const T& data , AvlTreeNode<T>* node , AvlTreeNode<T>* parent_node ) {
-            if (node == nullptr)
-                return new AvlTreeNode<T>(data,parent_node);
-            if ( compFunc(data,node->get_data()))
-                node->set_left(insert(data,node->get_left(),node));
+        /*fixes node, returns the root of its subtree*/
+        template<typename T>
+        static AvlTreeNode<T>* rebalance(AvlTreeNode<T>*& root, AvlTreeNode<T>* node) {
+            typedef TreeLinks<T> Links;
+            update(node);
+            int balance = height(node->get_left()) - height(node->get_right());
+            if (balance > 1) {
+                AvlTreeNode<T>* left = node->get_left();
+                if (height(left->get_left()) < height(left->get_right())) {
+                    Links::rotateLeft(root, left);
+                    update(left);
+                    update(left->get_parent());
+                }
+                Links::rotateRight(root, node);
+            }
+            else if (balance < -1) {
+                AvlTreeNode<T>* right = node->get_right();
+                if (height(right->get_right()) < height(right->get_left())) {
+                    Links::rotateRight(root, right);
+                    update(right);
+                    update(right->get_parent());
+                }
+                Links::rotateLeft(root, node);
+            }
             else
-                node->set_right(insert(data,node->get_right(),node));
+                return node;
+            update(node);
+            update(node->get_parent());
+            return node->get_parent();
+        }
 
-            node->set_height(1 + max(node->get_left_height(),node->get_right_height()));
+        template<typename T>
+        static void afterInsert(AvlTreeNode<T>*& root, AvlTreeNode<T>* node) {
+            node->set_balance_info(0);
+            AvlTreeNode<T>* parent = node->get_parent();
+            while (parent) {
+                int old_height = parent->get_balance_info();
+                AvlTreeNode<T>* subtree = rebalance(root, parent);
+                if (subtree->get_balance_info() == old_height)
+                    break;
+                parent = subtree->get_parent();
+            }
+        }
+
+        template<typename T>
+        static void remove(AvlTreeNode<T>*& root, AvlTreeNode<T>* node) {
+            if (node->get_left() && node->get_right())
+                TreeLinks<T>::swapWithSuccessor(root, node);
+            TreeLinks<T>::detach(node);
+            AvlTreeNode<T>* parent = TreeLinks<T>::unlink(root, node);
+            while (parent) {
+                int old_height = parent->get_balance_info();
+                AvlTreeNode<T>* subtree = rebalance(root, parent);
+                if (subtree->get_balance_info() == old_height)
+                    break;
+                parent = subtree->get_parent();
+            }
+        }
+
+        template<typename T>
+        static void afterBuild(AvlTreeNode<T>* node, int, int) {
+            update(node);
+        }
 
-            int balance = node->get_left_height() - node->get_right_height();
+        template<typename T>
+        static void access(AvlTreeNode<T>*&, AvlTreeNode<T>*) {}
 
-            // LL
-            if (balance > 1 && compFunc(data,node->get_left_data()) )
-                return rightRotate(node);
-            // RR
-            if (balance < -1 && compFunc(node->get_right_data(),data))
-                return leftRotate(node);
-            // LR
-            if (balance > 1 && compFunc(node->get_left_data(),data))
-            {
-                node->set_left(leftRotate(node->get_left()));
-                return rightRotate(node);
+        template<typename T>
+        static int treeHeight(AvlTreeNode<T>* root) {
+            return height(root);
+        }
+    };
+
+    /*red-black, O(1) rotations per update*/
+    struct RedBlackBalance {
+        enum { BLACK = 0, RED = 1 };
+        enum { REORDERS_ON_ACCESS = 0 };
+
+        template<typename T>
+        static bool isRed(AvlTreeNode<T>* node) {
+            return node && node->get_balance_info() == RED;
+        }
+
+        template<typename T>
+        static void afterInsert(AvlTreeNode<T>*& root, AvlTreeNode<T>* node) {
+            typedef TreeLinks<T> Links;
+            node->set_balance_info(RED);
+            AvlTreeNode<T>* parent;
+            while ((parent = node->get_parent()) && isRed(parent)) {
+                AvlTreeNode<T>* grand = parent->get_parent();
+                if (parent == grand->get_left()) {
+                    AvlTreeNode<T>* uncle = grand->get_right();
+                    if (isRed(uncle)) {
+                        parent->set_balance_info(BLACK);
+                        uncle->set_balance_info(BLACK);
+                        grand->set_balance_info(RED);
+                        node = grand;
+                        continue;
+                    }
+                    if (node == parent->get_right()) {
+                        Links::rotateLeft(root, parent);
+                        parent = node;
+                    }
+                    parent->set_balance_info(BLACK);
+                    grand->set_balance_info(RED);
+                    Links::rotateRight(root, grand);
+                    break;
+                }
+                else {
+                    AvlTreeNode<T>* uncle = grand->get_left();
+                    if (isRed(uncle)) {
+                        parent->set_balance_info(BLACK);
+                        uncle->set_balance_info(BLACK);
+                        grand->set_balance_info(RED);
+                        node = grand;
+                        continue;
+                    }
+                    if (node == parent->get_left()) {
+                        Links::rotateRight(root, parent);
+                        parent = node;
+                    }
+                    parent->set_balance_info(BLACK);
+                    grand->set_balance_info(RED);
+                    Links::rotateLeft(root, grand);
+                    break;
+                }
             }
-            // RL
-            if (balance < -1 && compFunc(data,node->get_right_data()))
-            {
-                node->set_right(rightRotate(node->get_right()));
-                return leftRotate(node);
+            root->set_balance_info(BLACK);
+        }
+
+        /*x is "double black" - one black short on its paths*/
+        template<typename T>
+        static void fixDoubleBlack(AvlTreeNode<T>*& root, AvlTreeNode<T>* x) {
+            typedef TreeLinks<T> Links;
+            while (x != root && !isRed(x)) {
+                AvlTreeNode<T>* parent = x->get_parent();
+                if (x == parent->get_left()) {
+                    AvlTreeNode<T>* sibling = parent->get_right();
+                    if (isRed(sibling)) {
+                        sibling->set_balance_info(BLACK);
+                        parent->set_balance_info(RED);
+                        Links::rotateLeft(root, parent);
+                        sibling = parent->get_right();
+                    }
+                    if (!isRed(sibling->get_left()) && !isRed(sibling->get_right())) {
+                        sibling->set_balance_info(RED);
+                        x = parent;
+                        continue;
+                    }
+                    if (!isRed(sibling->get_right())) {
+                        sibling->get_left()->set_balance_info(BLACK);
+                        sibling->set_balance_info(RED);
+                        Links::rotateRight(root, sibling);
+                        sibling = parent->get_right();
+                    }
+                    sibling->set_balance_info(parent->get_balance_info());
+                    parent->set_balance_info(BLACK);
+                    sibling->get_right()->set_balance_info(BLACK);
+                    Links::rotateLeft(root, parent);
+                }
+                else {
+                    AvlTreeNode<T>* sibling = parent->get_left();
+                    if (isRed(sibling)) {
+                        sibling->set_balance_info(BLACK);
+                        parent->set_balance_info(RED);
+                        Links::rotateRight(root, parent);
+                        sibling = parent->get_left();
+                    }
+                    if (!isRed(sibling->get_left()) && !isRed(sibling->get_right())) {
+                        sibling->set_balance_info(RED);
+                        x = parent;
+                        continue;
+                    }
+                    if (!isRed(sibling->get_left())) {
+                        sibling->get_right()->set_balance_info(BLACK);
+                        sibling->set_balance_info(RED);
+                        Links::rotateLeft(root, sibling);
+                        sibling = parent->get_left();
+                    }
+                    sibling->set_balance_info(parent->get_balance_info());
+                    parent->set_balance_info(BLACK);
+                    sibling->get_left()->set_balance_info(BLACK);
+                    Links::rotateRight(root, parent);
+                }
+                x = root;
             }
-            return node;
+            x->set_balance_info(BLACK);
+        }
 
+        template<typename T>
+        static void remove(AvlTreeNode<T>*& root, AvlTreeNode<T>* node) {
+            if (node->get_left() && node->get_right())
+                TreeLinks<T>::swapWithSuccessor(root, node);
+            TreeLinks<T>::detach(node);
+            AvlTreeNode<T>* child = node->get_left() ? node->get_left() : node->get_right();
+            if (!isRed(node)) {
+                if (isRed(child))
+                    child->set_balance_info(BLACK);
+                else
+                    fixDoubleBlack(root, node); //node is a black leaf, it stays one
+            }
+            TreeLinks<T>::unlink(root, node);
         }
 
+        /*the last, partial level of a built tree is red, the rest black*/
+        template<typename T>
+        static void afterBuild(AvlTreeNode<T>* node, int depth, int full_levels) {
+            node->set_balance_info(depth < full_levels ? BLACK : RED);
+        }
 
-        AvlTreeNode<T>* deleteNode(AvlTreeNode<T>* node, T& data)
-        {
+        template<typename T>
+        static void access(AvlTreeNode<T>*&, AvlTreeNode<T>*) {}
 
-            if (node == nullptr)
-                return node;
+        template<typename T>
+        static int treeHeight(AvlTreeNode<T>*) {
+            return HEIGHT_UNTRACKED;
+        }
+    };
 
-            if ( compFunc(data,node->get_data()))
-                node->set_left(deleteNode(node->get_left(),data));
-            else if( compFunc(node->get_data(),data) )
-                node->set_right(deleteNode(node->get_right(),data));
-            else
-            {
-                // node with max one child
-                if( (node->get_left() == nullptr ) || ( node->get_right() == nullptr) )
-                {
-                    AvlTreeNode<T>* temp = node->get_left() ? node->get_left() : node->get_right() ;
-
-                    // No child case
-                    if (temp == NULL)
-                    {
-                        temp = node;
-                        node = NULL;
-                    }
-                    else // One child case
-                        *node = *temp;
+    /*splay tree - every insert and lookup moves the node to the root*/
+    struct SplayBalance {
+        enum { REORDERS_ON_ACCESS = 1 };
+
+        template<typename T>
+        static void splay(AvlTreeNode<T>*& root, AvlTreeNode<T>* x) {
+            typedef TreeLinks<T> Links;
+            AvlTreeNode<T>* parent;
+            while ((parent = x->get_parent())) {
+                AvlTreeNode<T>* grand = parent->get_parent();
+                bool left = x == parent->get_left();
+                if (!grand) {
+                    if (left) Links::rotateRight(root, parent);
+                    else Links::rotateLeft(root, parent);
+                }
+                else if (left && parent == grand->get_left()) {
+                    Links::rotateRight(root, grand);
+                    Links::rotateRight(root, parent);
+                }
+                else if (!left && parent == grand->get_right()) {
+                    Links::rotateLeft(root, grand);
+                    Links::rotateLeft(root, parent);
+                }
+                else if (left) {
+                    Links::rotateRight(root, parent);
+                    Links::rotateLeft(root, grand);
+                }
+                else {
+                    Links::rotateLeft(root, parent);
+                    Links::rotateRight(root, grand);
+                }
+            }
+        }
+
+        template<typename T>
+        static void afterInsert(AvlTreeNode<T>*& root, AvlTreeNode<T>* node) {
+            splay(root, node);
+        }
+
+        template<typename T>
+        static void remove(AvlTreeNode<T>*& root, AvlTreeNode<T>* node) {
+            splay(root, node);
+            AvlTreeNode<T>* left = node->get_left();
+            AvlTreeNode<T>* right = node->get_right();
+            node->set_left(nullptr);
+            node->set_right(nullptr);
+            if (!left) {
+                root = right;
+                if (right) right->set_parent(nullptr);
+                return;
+            }
+            /*the left subtree's maximum becomes the root, right hangs off it*/
+            left->set_parent(nullptr);
+            AvlTreeNode<T>* max = TreeLinks<T>::maximum(left);
+            splay(left, max);
+            max->set_right(right);
+            if (right) right->set_parent(max);
+            TreeLinks<T>::resize(max);
+            root = max;
+        }
+
+        template<typename T>
+        static void afterBuild(AvlTreeNode<T>*, int, int) {}
+
+        template<typename T>
+        static void access(AvlTreeNode<T>*& root, AvlTreeNode<T>* node) {
+            splay(root, node);
+        }
+
+        template<typename T>
+        static int treeHeight(AvlTreeNode<T>*) {
+            return HEIGHT_UNTRACKED;
+        }
+    };
+
+    /*the policy every tree gets unless it names one, chosen at build time*/
+#if defined(WET1_RED_BLACK_TREES)
+    typedef RedBlackBalance DefaultBalance;
+#elif defined(WET1_SPLAY_TREES)
+    typedef SplayBalance DefaultBalance;
+#else
+    typedef AvlBalance DefaultBalance;
+#endif
 
-                    delete temp; // or a delete function
+    /**
+     * OwnsNodes = false makes an intrusive tree - its nodes are hooks living
+     * inside the elements, linked with insertNode/removeNode and never
+     * allocated or freed by the tree.
+     * An owning tree's nodes are on the heap, or in blocks made by compactStep.
+     */
+    template<typename T, typename Comp, typename Balance = DefaultBalance, bool OwnsNodes = true>
+    class AvlTree {
+        AvlTreeNode<T>* root;
+        Comp compFunc;
+        AvlTreeNode<T>* youngest;
+        AvlTreeNode<T>* oldest;
+        int size;
+
+        /**
+         * compaction state - nodes moved by compactStep live in blocks, newest
+         * first, each freed once its last node is. The layout tasks are the
+         * van Emde Boas recursion of the running pass as an explicit stack.
+         */
+        struct NodeBlock {
+            AvlTreeNode<T>* nodes;
+            int capacity, used, live;
+            NodeBlock* next;
+        };
+        /*lays out levels levels of node's subtree, or all of it if whole*/
+        struct LayoutTask {
+            AvlTreeNode<T>* node;
+            int levels;
+            bool whole;
+        };
+        NodeBlock* blocks;
+        LayoutTask* layout_tasks;
+        int layout_tasks_num, layout_tasks_capacity;
+        bool compacting, compacted;
+
+        /*builds a balanced subtree of the nodes node_of(min..max), sorted by Comp*/
+        template<typename NodeOf>
+        AvlTreeNode<T>* build(NodeOf& node_of, int max, int min, int depth, int full_levels) {
+            if (max < min)
+                return nullptr;
+            int mid = (max + min) / 2;
+            AvlTreeNode<T>* node = node_of(mid);
+            node->set_parent(nullptr);
+            node->set_left(build(node_of, mid - 1, min, depth + 1, full_levels));
+            if (node->get_left()) node->get_left()->set_parent(node);
+            node->set_right(build(node_of, max, mid + 1, depth + 1, full_levels));
+            if (node->get_right()) node->get_right()->set_parent(node);
+            TreeLinks<T>::resize(node);
+            Balance::afterBuild(node, depth, full_levels);
+            return node;
+        }
+
+        int fullLevels() {
+            int full_levels = 0;
+            while ((2 << full_levels) - 1 <= size)
+                full_levels++;
+            return full_levels;
+        }
+
+        template<typename NodeOf>
+        void buildTree(NodeOf& node_of, int max, int min) {
+            root = build(node_of, max, min, 0, fullLevels());
+            updateEnds();
+        }
+
+        /*a subtree left for the parallel part of buildTree*/
+        struct PendingSubtree {
+            int max, min;
+            AvlTreeNode<T>* parent;
+            bool left;
+        };
+
+        /*build above split_depth - links the top nodes and queues the subtrees below them*/
+        template<typename NodeOf>
+        AvlTreeNode<T>* buildTop(NodeOf& node_of, int max, int min, int depth, int split_depth,
+                                 PendingSubtree* pending, int& pending_num) {
+            int mid = (max + min) / 2;
+            AvlTreeNode<T>* node = node_of(mid);
+            node->set_parent(nullptr);
+            node->set_left(nullptr);
+            node->set_right(nullptr);
+            int bounds[2][2] = { { mid - 1, min }, { max, mid + 1 } };
+            for (int side = 0; side < 2; side++) {
+                if (bounds[side][0] < bounds[side][1])
+                    continue;
+                AvlTreeNode<T>* child = nullptr;
+                if (depth + 1 == split_depth) {
+                    PendingSubtree& subtree = pending[pending_num++];
+                    subtree.max = bounds[side][0];
+                    subtree.min = bounds[side][1];
+                    subtree.parent = node;
+                    subtree.left = side == 0;
                 }
                 else
-                {
-                    // node with two children
-                    AvlTreeNode<T>* temp = get_younget_child(node->get_right());
-                    node->set_data(temp->get_data());
-                    node->set_right(deleteNode(node->get_right(),temp->get_data()));
+                    child = buildTop(node_of, bounds[side][0], bounds[side][1], depth + 1, split_depth,
+                                     pending, pending_num);
+                if (child) {
+                    child->set_parent(node);
+                    if (side == 0) node->set_left(child);
+                    else node->set_right(child);
                 }
             }
+            return node;
+        }
 
-            if (node == nullptr)
-                return node;
+        /*the top nodes are done last, once their subtrees are*/
+        void finishTop(AvlTreeNode<T>* node, int depth, int split_depth, int full_levels) {
+            if (!node || depth == split_depth)
+                return;
+            finishTop(node->get_left(), depth + 1, split_depth, full_levels);
+            finishTop(node->get_right(), depth + 1, split_depth, full_levels);
+            TreeLinks<T>::resize(node);
+            Balance::afterBuild(node, depth, full_levels);
+        }
+
+        AvlTreeNode<T>* find_in_tree(const T& data_to_find) {
+            AvlTreeNode<T>* node = root;
+            while (node) {
+                if (compFunc(data_to_find, node->get_data()))
+                    node = node->get_left();
+                else if (compFunc(node->get_data(), data_to_find))
+                    node = node->get_right();
+                else
+                    return node;
+            }
+            return nullptr;
+        }
+
+        void updateEnds() {
+            youngest = TreeLinks<T>::minimum(root);
+            oldest = TreeLinks<T>::maximum(root);
+        }
 
-            // STEP 2: UPDATE HEIGHT OF THE CURRENT NODE
-            node->set_height(1+ max(node->get_left_height(),node->get_right_height()));
+        void accessNode(AvlTreeNode<T>* node) {
+            if (Balance::REORDERS_ON_ACCESS)
+                dropCompaction();
+            Balance::access(root, node);
+        }
 
-            int balance = node->get_left_height() - node->get_right_height();
+        static bool inBlock(NodeBlock* block, AvlTreeNode<T>* node) {
+            uintptr_t address = (uintptr_t)node;
+            return address >= (uintptr_t)block->nodes && address < (uintptr_t)(block->nodes + block->capacity);
+        }
 
-            // LL
-            if (balance > 1 && compFunc(data,node->get_left_data()) )
-                return rightRotate(node);
-            // RR
-            if (balance < -1 && compFunc(node->get_right_data(),data))
-                return leftRotate(node);
-            // LR
-            if (balance > 1 && compFunc(node->get_left_data(),data))
-            {
-                node->set_left(leftRotate(node->get_left()));
-                return rightRotate(node);
+        static void freeBlock(NodeBlock* block) {
+            ::operator delete(block->nodes);
+            delete block;
+        }
+
+        /*frees an unlinked node of an owning tree, wherever it lives*/
+        void releaseNode(AvlTreeNode<T>* node) {
+            NodeBlock** link = &blocks;
+            while (*link && !inBlock(*link, node))
+                link = &(*link)->next;
+            if (!*link) {
+                delete node;
+                return;
             }
-            // RL
-            if (balance < -1 && compFunc(data,node->get_right_data()))
-            {
-                node->set_right(rightRotate(node->get_right()));
-                return leftRotate(node);
+            NodeBlock* block = *link;
+            node->~AvlTreeNode<T>();
+            /*the block being filled is kept until its pass ends*/
+            if (--block->live == 0 && !(compacting && block == blocks)) {
+                *link = block->next;
+                freeBlock(block);
             }
-            return node;
+        }
+
+        /*a change to the tree - the pass's tasks may point anywhere now*/
+        void dropCompaction() {
+            compacted = false;
+            if (!compacting)
+                return;
+            compacting = false;
+            layout_tasks_num = 0;
+            delete[] layout_tasks;
+            layout_tasks = nullptr;
+            layout_tasks_capacity = 0;
+            if (blocks && blocks->live == 0) {
+                NodeBlock* block = blocks;
+                blocks = block->next;
+                freeBlock(block);
+            }
+        }
+
+        bool pushLayoutTask(AvlTreeNode<T>* node, int levels, bool whole) {
+            if (layout_tasks_num == layout_tasks_capacity) {
+                int capacity = layout_tasks_capacity ? 2 * layout_tasks_capacity : 64;
+                LayoutTask* tasks = new (std::nothrow) LayoutTask[capacity];
+                if (!tasks)
+                    return false;
+                for (int i = 0; i < layout_tasks_num; i++)
+                    tasks[i] = layout_tasks[i];
+                delete[] layout_tasks;
+                layout_tasks = tasks;
+                layout_tasks_capacity = capacity;
+            }
+            LayoutTask& task = layout_tasks[layout_tasks_num++];
+            task.node = node;
+            task.levels = levels;
+            task.whole = whole;
+            return true;
+        }
+
+        /*pushes tasks for node's descendants depth levels down, the leftmost on top*/
+        bool pushLevel(AvlTreeNode<T>* node, int depth, int levels, bool whole) {
+            if (!node)
+                return true;
+            if (depth == 0)
+                return pushLayoutTask(node, levels, whole);
+            return pushLevel(node->get_right(), depth - 1, levels, whole) &&
+                   pushLevel(node->get_left(), depth - 1, levels, whole);
+        }
+
+        /*levels of a perfectly balanced tree this size, deeper parts are laid out on their own*/
+        int layoutLevels() {
+            int levels = 1;
+            while ((1 << levels) <= size && levels < 30)
+                levels++;
+            return levels;
+        }
+
+        /*puts node in the next slot of the newest block, fixing the links to it*/
+        AvlTreeNode<T>* moveToBlock(AvlTreeNode<T>* node) {
+            NodeBlock* block = blocks;
+            AvlTreeNode<T>* slot = block->nodes + block->used++;
+            new (slot) AvlTreeNode<T>(node->get_data());
+            slot->set_balance_info(node->get_balance_info());
+            slot->set_subtree_size(node->get_subtree_size());
+            slot->set_left(node->get_left());
+            slot->set_right(node->get_right());
+            if (slot->get_left()) slot->get_left()->set_parent(slot);
+            if (slot->get_right()) slot->get_right()->set_parent(slot);
+            TreeLinks<T>::replaceChild(root, node->get_parent(), node, slot);
+            if (youngest == node) youngest = slot;
+            if (oldest == node) oldest = slot;
+            block->live++;
+            releaseNode(node);
+            return slot;
+        }
+
+        /*runs layout tasks until budget nodes moved, false if out of memory*/
+        bool runLayout(int& budget) {
+            while (budget > 0 && layout_tasks_num > 0) {
+                LayoutTask task = layout_tasks[--layout_tasks_num];
+                if (task.levels <= 1) {
+                    AvlTreeNode<T>* moved = moveToBlock(task.node);
+                    budget--;
+                    /*a whole subtree deeper than its estimate goes on below*/
+                    if (task.whole) {
+                        int levels = layoutLevels();
+                        if (moved->get_right() && !pushLayoutTask(moved->get_right(), levels, true))
+                            return false;
+                        if (moved->get_left() && !pushLayoutTask(moved->get_left(), levels, true))
+                            return false;
+                    }
+                    continue;
+                }
+                /*the top half levels first, then each subtree under them*/
+                int top = task.levels / 2;
+                if (!pushLevel(task.node, top, task.levels - top, task.whole) ||
+                    !pushLayoutTask(task.node, top, false))
+                    return false;
+            }
+            return true;
         }
 
     public:
+        AvlTree() : root(nullptr),compFunc(), youngest(nullptr), oldest(nullptr), size(0), blocks(nullptr),
+                    layout_tasks(nullptr), layout_tasks_num(0), layout_tasks_capacity(0), compacting(false),
+                    compacted(false) {}
+        AvlTree(T* arr, int max , int min) : root(nullptr),compFunc(), youngest(nullptr), oldest(nullptr),
+                                             size(max - min + 1 > 0 ? max - min + 1 : 0), blocks(nullptr),
+                                             layout_tasks(nullptr), layout_tasks_num(0), layout_tasks_capacity(0),
+                                             compacting(false), compacted(false) {
+            static_assert(OwnsNodes, "intrusive trees are built from their nodes");
+            auto node_of = [arr](int i) { return new AvlTreeNode<T>(arr[i]); };
+            buildTree(node_of, max, min);
+        }
+        /*intrusive build - node_of(i) is the hook of the i-th smallest element*/
+        template<typename NodeOf>
+        AvlTree(NodeOf node_of, int count) : root(nullptr),compFunc(), youngest(nullptr), oldest(nullptr),
+                                             size(count > 0 ? count : 0), blocks(nullptr), layout_tasks(nullptr),
+                                             layout_tasks_num(0), layout_tasks_capacity(0), compacting(false),
+                                             compacted(false) {
+            buildTree(node_of, count - 1, 0);
+        }
+        /**
+         * parallel intrusive build - the same tree, but the subtrees below
+         * split_depth are built by fork(n, task), which must call task(0) ..
+         * task(n - 1) (at the same time or not) and return once they are done.
+         * node_of is called from those tasks.
+         */
+        template<typename NodeOf, typename Fork>
+        AvlTree(NodeOf node_of, int count, int split_depth, Fork fork) : root(nullptr),compFunc(),
+                                             youngest(nullptr), oldest(nullptr), size(count > 0 ? count : 0),
+                                             blocks(nullptr), layout_tasks(nullptr), layout_tasks_num(0),
+                                             layout_tasks_capacity(0), compacting(false), compacted(false) {
+            if (split_depth <= 0 || size == 0) {
+                buildTree(node_of, count - 1, 0);
+                return;
+            }
+            int full_levels = fullLevels();
+            PendingSubtree* pending = new PendingSubtree[(size_t)2 << split_depth];
+            int pending_num = 0;
+            root = buildTop(node_of, count - 1, 0, 0, split_depth, pending, pending_num);
+            fork(pending_num, [&](int i) {
+                PendingSubtree& subtree = pending[i];
+                AvlTreeNode<T>* child = build(node_of, subtree.max, subtree.min, split_depth, full_levels);
+                child->set_parent(subtree.parent);
+                if (subtree.left) subtree.parent->set_left(child);
+                else subtree.parent->set_right(child);
+            });
+            delete[] pending;
+            finishTop(root, 0, split_depth, full_levels);
+            updateEnds();
+        }
+        ~AvlTree() {
+            if (!OwnsNodes)
+                return;
+            /*post order without recursion - splay trees can be deep*/
+            AvlTreeNode<T>* node = root;
+            while (node) {
+                if (node->get_left())
+                    node = node->get_left();
+                else if (node->get_right())
+                    node = node->get_right();
+                else {
+                    AvlTreeNode<T>* parent = node->get_parent();
+                    if (parent) {
+                        if (parent->get_left() == node) parent->set_left(nullptr);
+                        else parent->set_right(nullptr);
+                    }
+                    releaseNode(node);
+                    node = parent;
+                }
+            }
+            dropCompaction();
+        }
+        AvlTree(const AvlTree&) = delete;
+        AvlTree& operator=(const AvlTree&) = delete;
+
+        AvlTreeNode<T>* getRoot() {
+            return this->root;
+        }
 
         T& find(const T& data) {
-            AvlTreeNode<T>* node = find_in_tree(root,data);
+            AvlTreeNode<T>* node = find_in_tree(data);
             if(!node)
                 throw NotFound();
+            accessNode(node);
             return node->get_data();
         }
 
+        /*non throwing find - returns nullptr if data is not in the tree*/
+        T* tryFind(const T& data) {
+            AvlTreeNode<T>* node = find_in_tree(data);
+            if (!node)
+                return nullptr;
+            accessNode(node);
+            return &node->get_data();
+        }
+
+        /*links a node that is in no tree, equal keys go after existing ones*/
+        void insertNode(AvlTreeNode<T>* node) {
+            dropCompaction();
+            AvlTreeNode<T>* parent = nullptr;
+            AvlTreeNode<T>* current = root;
+            bool left = false;
+            while (current) {
+                parent = current;
+                current->set_subtree_size(current->get_subtree_size() + 1);
+                left = compFunc(node->get_data(), current->get_data());
+                current = left ? current->get_left() : current->get_right();
+            }
+            node->set_parent(parent);
+            node->set_left(nullptr);
+            node->set_right(nullptr);
+            node->set_subtree_size(1);
+            if (!parent)
+                root = node;
+            else if (left)
+                parent->set_left(node);
+            else
+                parent->set_right(node);
+            {
+                TraceSpan span(treeTrace(), "tree rebalance");
+                Balance::afterInsert(root, node);
+            }
+            size++;
+            if (!youngest || compFunc(node->get_data(), youngest->get_data()))
+                youngest = node;
+            if (!oldest || !compFunc(node->get_data(), oldest->get_data()))
+                oldest = node;
+        }
+
+        /*unlinks a node of this tree, the caller owns it afterwards*/
+        void removeNode(AvlTreeNode<T>* node) {
+            dropCompaction();
+            bool ends = node == youngest || node == oldest;
+            {
+                TraceSpan span(treeTrace(), "tree unlink and rebalance");
+                Balance::remove(root, node);
+            }
+            size--;
+            if (ends)
+                updateEnds();
+        }
+
         void deleteElement(T& data) {
-            root = deleteNode(root,data);
-            youngest = get_younget_child(root);
-            oldest = get_oldest_child(root);
+            static_assert(OwnsNodes, "use removeNode on intrusive trees");
+            AvlTreeNode<T>* node = find_in_tree(data);
+            if (!node)
+                return;
+            removeNode(node);
+            releaseNode(node);
         }
 
         void addElement(T& data) {
-            root = insert(data, this->root, this->root);
-            youngest = get_younget_child(root);
-            oldest = get_oldest_child(root);
+            static_assert(OwnsNodes, "use insertNode on intrusive trees");
+            insertNode(new AvlTreeNode<T>(data));
         }
 
         T& getOldestData()
@@ -307,10 +994,217 @@ namespace wet1
             return youngest->get_data();
         }
 
+        /*non throwing versions - return nullptr on an empty tree*/
+        T* tryGetOldest()
+        {
+            return oldest ? &oldest->get_data() : nullptr;
+        }
+
+        T* tryGetYoungest()
+        {
+            return youngest ? &youngest->get_data() : nullptr;
+        }
+
+        int getSize()
+        {
+            return size;
+        }
+
+        /*-1 for an empty tree, HEIGHT_UNTRACKED unless the policy keeps heights (AVL)*/
+        int getHeight()
+        {
+            return Balance::treeHeight(root);
+        }
+
         AvlTreeNode<T>* getYoungestNode()
         {
             return youngest;
         }
+
+        /**
+         * looks up n keys at once. The descents advance in lock step, a group
+         * at a time, and each next node (then the data it points to) is
+         * prefetched a step before it is read, so their cache misses overlap.
+         * comp(key, data) is <0, 0 or >0 like strcmp; results[i] is nullptr
+         * if keys[i] is not in the tree.
+         */
+        template<typename Key, typename KeyComp>
+        void findBatch(const Key* keys, int n, T** results, KeyComp comp) {
+            const int GROUP = 16;
+            AvlTreeNode<T>* lanes[GROUP];
+            AvlTreeNode<T>* found[GROUP];
+            bool data_fetched[GROUP];
+            for (int first = 0; first < n; first += GROUP) {
+                int count = n - first < GROUP ? n - first : GROUP;
+                int active = root ? count : 0;
+                for (int i = 0; i < count; i++) {
+                    lanes[i] = root;
+                    found[i] = nullptr;
+                    data_fetched[i] = false;
+                }
+                if (root)
+                    prefetch(root);
+                while (active > 0) {
+                    for (int i = 0; i < count; i++) {
+                        AvlTreeNode<T>* node = lanes[i];
+                        if (!node)
+                            continue;
+                        if (!data_fetched[i]) {
+                            prefetchPointee(node->get_data());
+                            data_fetched[i] = true;
+                            continue;
+                        }
+                        int order = comp(keys[first + i], node->get_data());
+                        if (order == 0) {
+                            found[i] = node;
+                            node = nullptr;
+                        }
+                        else
+                            node = order < 0 ? node->get_left() : node->get_right();
+                        lanes[i] = node;
+                        data_fetched[i] = false;
+                        if (node)
+                            prefetch(node);
+                        else
+                            active--;
+                    }
+                }
+                /*after the group's descents - splaying moves nodes under them*/
+                for (int i = 0; i < count; i++) {
+                    results[first + i] = found[i] ? &found[i]->get_data() : nullptr;
+                    if (found[i])
+                        accessNode(found[i]);
+                }
+            }
+        }
+
+        /**
+         * unlinks every node whose data matches pred - one in order pass and
+         * an O(n) rebuild of the rest, cheaper than removing many nodes one
+         * at a time. Removes them one by one if the pass buffer can't be had.
+         */
+        template<typename Pred>
+        void removeNodesIf(Pred pred)
+        {
+            static_assert(!OwnsNodes, "the unlinked nodes belong to the caller");
+            if (size == 0)
+                return;
+            TraceSpan span(treeTrace(), "tree filter and rebuild");
+            AvlTreeNode<T>** kept = new (std::nothrow) AvlTreeNode<T>*[size];
+            if (!kept) {
+                AvlTreeNode<T>* node = youngest;
+                while (node) {
+                    AvlTreeNode<T>* next = TreeLinks<T>::successor(node);
+                    if (pred(node->get_data()))
+                        removeNode(node);
+                    node = next;
+                }
+                return;
+            }
+            int kept_num = 0;
+            for (AvlTreeNode<T>* node = youngest; node; node = TreeLinks<T>::successor(node)) {
+                if (!pred(node->get_data()))
+                    kept[kept_num++] = node;
+            }
+            dropCompaction();
+            size = kept_num;
+            auto node_of = [kept](int i) { return kept[i]; };
+            buildTree(node_of, kept_num - 1, 0);
+            delete[] kept;
+        }
+
+        /**
+         * range helpers - below(data) must hold for a prefix of the tree's
+         * order, like "score < x". countBelow is the length of that prefix,
+         * lowerBoundNode the first node after it (nullptr if there is none).
+         */
+        template<typename Pred>
+        int countBelow(Pred below)
+        {
+            int count = 0;
+            AvlTreeNode<T>* node = root;
+            while (node) {
+                if (below(node->get_data())) {
+                    count += TreeLinks<T>::size(node->get_left()) + 1;
+                    node = node->get_right();
+                }
+                else
+                    node = node->get_left();
+            }
+            return count;
+        }
+
+        template<typename Pred>
+        AvlTreeNode<T>* lowerBoundNode(Pred below)
+        {
+            AvlTreeNode<T>* bound = nullptr;
+            AvlTreeNode<T>* node = root;
+            while (node) {
+                if (below(node->get_data()))
+                    node = node->get_right();
+                else {
+                    bound = node;
+                    node = node->get_left();
+                }
+            }
+            return bound;
+        }
+
+        /**
+         * moves up to budget nodes into one contiguous block in van Emde Boas
+         * order (the top half of the levels, then each subtree below them,
+         * recursively), so a descent touches O(log_B n) cache lines. Runs in
+         * slices - the tree stays valid between calls, and a change to it
+         * (or a splay lookup) drops the pass, the next call starts over.
+         * Returns the budget left, more than 0 once the tree is laid out, or
+         * COMPACT_OUT_OF_MEMORY - the pass is dropped, a later call retries.
+         */
+        int compactStep(int budget) {
+            static_assert(OwnsNodes, "intrusive nodes live in their elements");
+            if (compacted || size == 0)
+                return budget;
+            if (!compacting) {
+                NodeBlock* block = new (std::nothrow) NodeBlock;
+                void* nodes = block ? ::operator new(sizeof(AvlTreeNode<T>) * size, std::nothrow) : nullptr;
+                if (!nodes) {
+                    delete block;
+                    return COMPACT_OUT_OF_MEMORY;
+                }
+                block->nodes = static_cast<AvlTreeNode<T>*>(nodes);
+                block->capacity = size;
+                block->used = 0;
+                block->live = 0;
+                block->next = blocks;
+                blocks = block;
+                compacting = true;
+                if (!pushLayoutTask(root, layoutLevels(), true)) {
+                    dropCompaction();
+                    return COMPACT_OUT_OF_MEMORY;
+                }
+            }
+            if (!runLayout(budget)) {
+                dropCompaction();
+                return COMPACT_OUT_OF_MEMORY;
+            }
+            if (layout_tasks_num > 0)
+                return 0;
+            dropCompaction();
+            compacted = true;
+            return budget > 0 ? budget : 1;
+        }
+
+        /*compactStep without slices, false if it ran out of memory*/
+        bool compact() {
+            int left;
+            while ((left = compactStep(1 << 16)) == 0) {}
+            return left != COMPACT_OUT_OF_MEMORY;
+        }
+
+        /*the node with rank smaller nodes, nullptr if rank is out of range*/
+        AvlTreeNode<T>* selectNode(int rank)
+        {
+            return TreeLinks<T>::select(root, rank);
+        }
     };
 }
 #endif //AVLTREE_H
@@ -0,0 +1,223 @@
+#include "BinaryProtocol.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace wet1;
+
+static inline void put32(unsigned char* dst, int value)
+{
+    uint32_t v = (uint32_t)value;
+    dst[0] = v & 0xFF;
+    dst[1] = (v >> 8) & 0xFF;
+    dst[2] = (v >> 16) & 0xFF;
+    dst[3] = (v >> 24) & 0xFF;
+}
+
+static inline int get32(const unsigned char* src)
+{
+    return (int)((uint32_t)src[0] | ((uint32_t)src[1] << 8) |
+        ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24));
+}
+
+/*64 bit, so no 32 bit length from the input can overflow it*/
+static inline int64_t padded(int64_t len)
+{
+    return (len + RECORD_SIZE - 1) / RECORD_SIZE * RECORD_SIZE;
+}
+
+static void appendText(const char* text, int len, OutputBuffer& out)
+{
+    static const char zeros[RECORD_SIZE] = { 0 };
+    out.append(text, len);
+    out.append(zeros, padded(len) - len);
+}
+
+void wet1::encodeCommand(const Command& command, OutputBuffer& out)
+{
+    unsigned char record[RECORD_SIZE] = { 0 };
+    if(command.kind == CMD_COMMENT || command.kind == CMD_NONE)
+    {
+        record[0] = command.kind == CMD_COMMENT ? RECORD_COMMENT : RECORD_NONE;
+        put32(record + 4, command.text_len);
+        out.append((const char*)record, RECORD_SIZE);
+        appendText(command.text, command.text_len, out);
+        return;
+    }
+    record[0] = (unsigned char)command.kind;
+    record[1] = command.valid ? 0 : COMMAND_INVALID_ARGS;
+    for (int i = 0; i < commandArgsNum(command.kind); i++)
+    {
+        put32(record + 4 + 4 * i, command.args[i]);
+    }
+    out.append((const char*)record, RECORD_SIZE);
+}
+
+int64_t wet1::commandRecordSize(const char* header)
+{
+    const unsigned char* record = (const unsigned char*)header;
+    if(record[0] == RECORD_COMMENT || record[0] == RECORD_NONE)
+    {
+        int text_len = get32(record + 4);
+        return text_len < 0 ? RECORD_SIZE : RECORD_SIZE + padded(text_len);
+    }
+    return RECORD_SIZE;
+}
+
+bool wet1::decodeCommand(const char*& cursor, const char* end, Command& command)
+{
+    if(end - cursor < RECORD_SIZE)
+        return false;
+    const unsigned char* record = (const unsigned char*)cursor;
+    const char* body = cursor + RECORD_SIZE;
+    command.valid = true;
+    command.text = nullptr;
+    command.text_len = 0;
+    if(record[0] == RECORD_COMMENT || record[0] == RECORD_NONE)
+    {
+        command.kind = record[0] == RECORD_COMMENT ? CMD_COMMENT : CMD_NONE;
+        command.text_len = get32(record + 4);
+        if(command.text_len < 0 || end - body < padded(command.text_len))
+            return false;
+        command.text = body;
+        cursor = body + padded(command.text_len);
+        return true;
+    }
+    if(record[0] > CMD_STATS)
+        return false;
+    command.kind = (CommandKind)record[0];
+    command.valid = !(record[1] & COMMAND_INVALID_ARGS);
+    for (int i = 0; i < 3; i++)
+    {
+        command.args[i] = get32(record + 4 + 4 * i);
+    }
+    cursor = body;
+    return true;
+}
+
+void wet1::encodeResult(const Command& command, const CommandResult& result, OutputBuffer& out)
+{
+    unsigned char record[RECORD_SIZE] = { 0 };
+    if(command.kind == CMD_STATS && command.valid)
+    {
+        /*the report has no fixed layout, it is kept as a comment record*/
+        OutputBuffer report(-1, 1 << 16);
+        formatResult(command, result, report);
+        record[0] = RECORD_COMMENT;
+        put32(record + 4, (int)report.length());
+        out.append((const char*)record, RECORD_SIZE);
+        appendText(report.data(), (int)report.length(), out);
+        return;
+    }
+    if(command.kind == CMD_COMMENT || command.kind == CMD_NONE)
+    {
+        record[0] = command.kind == CMD_COMMENT ? RECORD_COMMENT : RECORD_NONE;
+        put32(record + 4, command.text_len);
+        out.append((const char*)record, RECORD_SIZE);
+        appendText(command.text, command.text_len, out);
+        return;
+    }
+    record[0] = (unsigned char)command.kind;
+    record[1] = (unsigned char)(signed char)result.status;
+    record[2] = command.valid ? 0 : RESULT_INVALID_ARGS;
+    put32(record + 4, result.value);
+    put32(record + 8, result.count);
+    out.append((const char*)record, RECORD_SIZE);
+    if(result.count == 0)
+        return;
+    unsigned char pair[8];
+    for (int i = 0; i < result.count; i++)
+    {
+        put32(pair, result.types[i]);
+        put32(pair + 4, result.models[i]);
+        out.append((const char*)pair, sizeof(pair));
+    }
+    if(result.count % 2)
+        out.append((const char*)record + RECORD_SIZE - 8, 8); //zero padding
+}
+
+bool wet1::decodeResult(const char*& cursor, const char* end, Command& command,
+    CommandResult& result, int*& types, int*& models, int& capacity)
+{
+    if(end - cursor < RECORD_SIZE)
+        return false;
+    const unsigned char* record = (const unsigned char*)cursor;
+    const char* body = cursor + RECORD_SIZE;
+    command.valid = true;
+    command.text = nullptr;
+    command.text_len = 0;
+    result.status = SUCCESS;
+    result.value = 0;
+    result.types = nullptr;
+    result.models = nullptr;
+    result.count = 0;
+    result.stop = false;
+    if(record[0] == RECORD_COMMENT || record[0] == RECORD_NONE)
+    {
+        command.kind = record[0] == RECORD_COMMENT ? CMD_COMMENT : CMD_NONE;
+        command.text_len = get32(record + 4);
+        if(command.text_len < 0 || end - body < padded(command.text_len))
+            return false;
+        command.text = body;
+        cursor = body + padded(command.text_len);
+        return true;
+    }
+    if(record[0] > CMD_STATS)
+        return false;
+    command.kind = (CommandKind)record[0];
+    command.valid = !(record[2] & RESULT_INVALID_ARGS);
+    result.status = (StatusType)(signed char)record[1];
+    result.value = get32(record + 4);
+    result.count = get32(record + 8);
+    if(result.count < 0 || end - body < padded((int64_t)result.count * 8))
+    {
+        result.count = 0;
+        return false;
+    }
+    if(result.count > capacity)
+    {
+        int* new_types = (int*)realloc(types, result.count * sizeof(int));
+        if(new_types)
+            types = new_types;
+        int* new_models = (int*)realloc(models, result.count * sizeof(int));
+        if(new_models)
+            models = new_models;
+        if(!new_types || !new_models)
+        {
+            result.count = 0;
+            return false;
+        }
+        capacity = result.count;
+    }
+    const unsigned char* pairs = (const unsigned char*)body;
+    for (int i = 0; i < result.count; i++)
+    {
+        types[i] = get32(pairs + 8 * (size_t)i);
+        models[i] = get32(pairs + 8 * (size_t)i + 4);
+    }
+    cursor = body + padded((int64_t)result.count * 8);
+    result.types = types;
+    result.models = models;
+    return true;
+}
+
+int wet1::runBinaryDriver(const char* path, int out_fd)
+{
+    InputFile input;
+    if(!input.open(path))
+        return 1;
+    OutputBuffer out(out_fd);
+    CommandExecutor executor;
+    Command command;
+    CommandResult result;
+    const char* cursor = input.begin();
+    while(decodeCommand(cursor, input.end(), command))
+    {
+        executor.execute(command, result);
+        encodeResult(command, result, out);
+        if(result.stop)
+            break;
+    }
+    out.flush();
+    return 0;
+}
@@ -0,0 +1,63 @@
+#ifndef BINARY_PROTOCOL_H
+#define BINARY_PROTOCOL_H
+
+#include "FastDriver.h"
+#include <stdint.h>
+
+namespace wet1
+{
+    /**
+     * Binary form of the shell's commands and output. All fields are little
+     * endian and every record is a multiple of RECORD_SIZE bytes.
+     *
+     * Command record:
+     *   u8 kind (CommandKind, or RECORD_COMMENT / RECORD_NONE)
+     *   u8 flags (COMMAND_INVALID_ARGS)
+     *   u16 reserved
+     *   i32 args[3]
+     * Result record:
+     *   u8 kind, i8 status, u8 flags (RESULT_INVALID_ARGS), u8 reserved
+     *   i32 value (CommandResult::value)
+     *   i32 count (GetWorstModels rows)
+     *   i32 reserved
+     *   followed by count (type, model) i32 pairs, zero padded to RECORD_SIZE
+     * Comment and unknown lines keep their text so results convert back to the
+     * exact shell output: args[0] / value hold the text length and the text
+     * follows the record, zero padded to RECORD_SIZE. Stats results are written
+     * as comment records holding the shell's report.
+     */
+    static const int RECORD_SIZE = 16;
+    static const unsigned char RECORD_COMMENT = 0xFF;
+    static const unsigned char RECORD_NONE = 0xFE;
+    static const unsigned char COMMAND_INVALID_ARGS = 1;
+    static const unsigned char RESULT_INVALID_ARGS = 1;
+
+    void encodeCommand(const Command& command, OutputBuffer& out);
+    /**
+     * size of the whole command record starting with the RECORD_SIZE bytes
+     * at header, for readers that get the input in pieces. Lengths come from
+     * the input, so it may be far more than any reader will buffer.
+     */
+    int64_t commandRecordSize(const char* header);
+    /**
+     * returns false at the end of the input or on a truncated or malformed
+     * record, and leaves cursor at that record
+     */
+    bool decodeCommand(const char*& cursor, const char* end, Command& command);
+
+    void encodeResult(const Command& command, const CommandResult& result, OutputBuffer& out);
+    /**
+     * decodes a result record into the command/result pair formatResult takes.
+     * GetWorstModels rows are copied to types/models, grown as needed. Fails
+     * like decodeCommand.
+     */
+    bool decodeResult(const char*& cursor, const char* end, Command& command,
+        CommandResult& result, int*& types, int*& models, int& capacity);
+
+    /**
+     * Replays binary command records from path and writes binary result
+     * records to out_fd. Returns 0 on success.
+     */
+    int runBinaryDriver(const char* path, int out_fd);
+}
+#endif
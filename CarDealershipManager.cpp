@@ -1,14 +1,50 @@
 #include "CarDealershipManager.h"
 #include "exceptions.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
 
 #define SAIL_POINTS 10
+/*results from this size on are filled by the thread pool*/
+#define PARALLEL_WORST_MIN (1 << 16)
+/*ranges per pool thread, so a slow range does not hold up the rest*/
+#define WORST_RANGES_PER_THREAD 4
+/*types from this size on are built by the thread pool*/
+#define PARALLEL_BUILD_MIN (1 << 16)
+/**
+ * a removal through the hooks does no search, so a filtering pass and a
+ * rebuild only pay off once the type holds this many 16ths of a tree
+ */
+#define REBUILD_SIXTEENTHS 15
+/*lookups handed to AvlTree::findBatch at a time*/
+#define BATCH_LOOKUP_SIZE 256
 
 using namespace wet1;
 
 
 /*CarModel application*/
 
-CarModel::CarModel(int type, int model) : model_type(type), model_num(model), sails(0), score(0) {}
+CarModel::CarModel(int type, int model) : model_type(type), model_num(model), sails(0), score(0),
+ sales_hook(this), score_hook(this), type_score_hook(this)
+#ifdef WET1_SALES_FREQ_LIST
+ , sales_bucket(nullptr)
+#endif
+ {}
+
+AvlTreeNode<CarModel*>* CarModel::salesHook()
+{
+    return &sales_hook;
+}
+
+AvlTreeNode<CarModel*>* CarModel::scoreHook()
+{
+    return &score_hook;
+}
+
+AvlTreeNode<CarModel*>* CarModel::typeScoreHook()
+{
+    return &type_score_hook;
+}
 
 int CarModel::getModelNum()
 {
@@ -41,23 +77,284 @@ void CarModel::complain(int t)
     score -= (100 / t);
 }
 
+void CarModel::applyDelta(int sales, int score_delta)
+{
+    sails += sales;
+    score += sales * SAIL_POINTS + score_delta;
+}
+
+#ifdef WET1_SALES_FREQ_LIST
+SalesBucket* CarModel::getSalesBucket()
+{
+    return sales_bucket;
+}
+
+void CarModel::setSalesBucket(SalesBucket* bucket)
+{
+    sales_bucket = bucket;
+}
+
+/**************************************************/
+/*SalesFrequencyList application*/
+
+SalesBucket::SalesBucket(int sales) : sales(sales), models(), prev(nullptr), next(nullptr) {}
+
+int SalesBucket::getSales()
+{
+    return sales;
+}
+
+AvlTree<CarModel*, CompModelSailes, DefaultBalance, false>& SalesBucket::getModels()
+{
+    return models;
+}
+
+SalesFrequencyList::SalesFrequencyList() : lowest(nullptr), highest(nullptr), size(0),
+ buckets_num(0), hint(nullptr), hint_model(nullptr) {}
+
+SalesFrequencyList::~SalesFrequencyList()
+{
+    while(lowest)
+    {
+        SalesBucket* next = lowest->next;
+        delete lowest;
+        lowest = next;
+    }
+}
+
+void SalesFrequencyList::unlinkBucket(SalesBucket* bucket)
+{
+    if(bucket->prev)
+        bucket->prev->next = bucket->next;
+    else
+        lowest = bucket->next;
+    if(bucket->next)
+        bucket->next->prev = bucket->prev;
+    else
+        highest = bucket->prev;
+    buckets_num--;
+    delete bucket;
+}
+
+void SalesFrequencyList::insertNode(AvlTreeNode<CarModel*>* hook)
+{
+    CarModel* model = hook->get_data();
+    int sales = model->getSails();
+    /*the last bucket with fewer sales, nullptr if there is none - a hint
+     * with as many sales would skip the model's own bucket*/
+    SalesBucket* before = hint_model == model && hint && hint->getSales() < sales ? hint : nullptr;
+    SalesBucket* bucket = before ? before->next : lowest;
+    while(bucket && bucket->getSales() < sales)
+    {
+        before = bucket;
+        bucket = bucket->next;
+    }
+    if(!bucket || bucket->getSales() != sales)
+    {
+        SalesBucket* created = new SalesBucket(sales);
+        created->prev = before;
+        created->next = bucket;
+        if(before)
+            before->next = created;
+        else
+            lowest = created;
+        if(bucket)
+            bucket->prev = created;
+        else
+            highest = created;
+        buckets_num++;
+        bucket = created;
+    }
+    bucket->getModels().insertNode(hook);
+    model->setSalesBucket(bucket);
+    hint_model = nullptr;
+    size++;
+}
+
+void SalesFrequencyList::removeNode(AvlTreeNode<CarModel*>* hook)
+{
+    CarModel* model = hook->get_data();
+    SalesBucket* bucket = model->getSalesBucket();
+    bucket->getModels().removeNode(hook);
+    model->setSalesBucket(nullptr);
+    size--;
+    hint_model = model;
+    if(bucket->getModels().getSize() > 0)
+    {
+        hint = bucket;
+        return;
+    }
+    hint = bucket->prev;
+    unlinkBucket(bucket);
+}
+
+void SalesFrequencyList::forgetHint()
+{
+    hint_model = nullptr;
+    hint = nullptr;
+}
+
+CarModel** SalesFrequencyList::tryGetOldest()
+{
+    return highest ? highest->getModels().tryGetOldest() : nullptr;
+}
+
+int SalesFrequencyList::getSize()
+{
+    return size;
+}
+
+int SalesFrequencyList::getHeight()
+{
+    return buckets_num;
+}
+#endif
+
+/**************************************************/
+/*ScoreBucketIndex application*/
+
+ScoreBucket::ScoreBucket(int score) : score(score), models() {}
+
+int ScoreBucket::getScore()
+{
+    return score;
+}
+
+AvlTree<CarModel*, CompModelScore, DefaultBalance, false>& ScoreBucket::getModels()
+{
+    return models;
+}
+
+bool CompBucketScore::operator()(ScoreBucket* const bucket1 , ScoreBucket* const bucket2)
+{
+    return bucket1->getScore() < bucket2->getScore();
+}
+
+ScoreBucketIndex::ScoreBucketIndex() : buckets(), size(0) {}
+
+ScoreBucketIndex::~ScoreBucketIndex()
+{
+    AvlTreeNode<ScoreBucket*>* node = buckets.getYoungestNode();
+    for (; node; node = TreeLinks<ScoreBucket*>::successor(node))
+    {
+        delete node->get_data();
+    }
+}
+
+/*returns nullptr if no model has this score*/
+ScoreBucket* ScoreBucketIndex::findBucket(int score)
+{
+    ScoreBucket tmp(score);
+    ScoreBucket** bucket = buckets.tryFind(&tmp);
+    return bucket ? *bucket : nullptr;
+}
+
+void ScoreBucketIndex::insertNode(AvlTreeNode<CarModel*>* hook)
+{
+    int score = hook->get_data()->getScore();
+    ScoreBucket* bucket = findBucket(score);
+    if(!bucket)
+    {
+        bucket = new ScoreBucket(score);
+        buckets.addElement(bucket);
+    }
+    bucket->getModels().insertNode(hook);
+    size++;
+}
+
+void ScoreBucketIndex::removeNode(AvlTreeNode<CarModel*>* hook)
+{
+    ScoreBucket* bucket = findBucket(hook->get_data()->getScore());
+    bucket->getModels().removeNode(hook);
+    size--;
+    if(bucket->getModels().getSize() == 0)
+    {
+        buckets.deleteElement(bucket);
+        delete bucket;
+    }
+}
+
+int ScoreBucketIndex::getSize()
+{
+    return size;
+}
+
+int ScoreBucketIndex::getHeight()
+{
+    return buckets.getHeight();
+}
+
+AvlTreeNode<ScoreBucket*>* ScoreBucketIndex::getYoungestNode()
+{
+    return buckets.getYoungestNode();
+}
+
+AvlTreeNode<ScoreBucket*>* ScoreBucketIndex::lowerBoundNode(int score)
+{
+    return buckets.lowerBoundNode([score](ScoreBucket* bucket) { return bucket->getScore() < score; });
+}
+
+int ScoreBucketIndex::compactStep(int budget)
+{
+    return buckets.compactStep(budget);
+}
+
 /**************************************************/
 /*CarType application*/
 
 /*ctor*/
-CarType::CarType(int type, int numOfModels) : typeId(type), models_num(numOfModels),
- best_seller_model(nullptr),models(nullptr), zero_score_modelIds(nullptr)
+CarType::CarType(int type, int numOfModels, ThreadPool* pool) : typeId(type), models_num(numOfModels),
+ best_seller_model(nullptr),models(nullptr), kept(nullptr), kept_num(0), referenced(false),
+ clock_prev(nullptr), clock_next(nullptr), zero_score_modelIds(nullptr), nonzero_score_models()
 {
-    models = new CarModel* [models_num];
-    for (int i = 0; i < models_num; i++)
+    /*one allocation for the models and, through their hooks, the zero tree*/
+    models = static_cast<CarModel*>(::operator new(sizeof(CarModel) * models_num));
+    CarModel* type_models = models;
+    auto node_of = [type_models](int i) { return type_models[i].scoreHook(); };
+    if(!pool || models_num < PARALLEL_BUILD_MIN)
     {
-        models[i] = new CarModel(typeId, i);
+        for (int i = 0; i < models_num; i++)
+        {
+            new (&models[i]) CarModel(typeId, i);
+        }
+        try{
+            zero_score_modelIds = new AvlTree<CarModel*, CompModelNum, DefaultBalance, false>(node_of, numOfModels);
+        }
+        catch(std::bad_alloc&){
+            ::operator delete(models);
+            throw;
+        }
+        return;
+    }
+    /*2^split_depth subtrees, a few per pool thread*/
+    int split_depth = 0;
+    while((1 << split_depth) < pool->getThreadsNum() * 4)
+        split_depth++;
+    int ranges = 1 << split_depth;
+    int chunk = (models_num + ranges - 1) / ranges;
+    int id = typeId;
+    pool->run(ranges, [type_models, chunk, numOfModels, id](int r) {
+        int end = std::min(numOfModels, (r + 1) * chunk);
+        for (int i = r * chunk; i < end; i++)
+        {
+            new (&type_models[i]) CarModel(id, i);
+        }
+    });
+    auto fork = [pool](int tasks, const std::function<void(int)>& task) { pool->run(tasks, task); };
+    try{
+        zero_score_modelIds = new AvlTree<CarModel*, CompModelNum, DefaultBalance, false>(
+            node_of, numOfModels, split_depth, fork);
+    }
+    catch(std::bad_alloc&){
+        ::operator delete(models);
+        throw;
     }
-    zero_score_modelIds = new AvlTree<CarModel*, CompModelNum>(models, numOfModels-1, 0);
 }
 
 CarType::CarType(int type) : typeId(type), models_num(0),
- best_seller_model(nullptr),models(nullptr), zero_score_modelIds(nullptr) {}
+ best_seller_model(nullptr),models(nullptr), kept(nullptr), kept_num(0), referenced(false),
+ clock_prev(nullptr), clock_next(nullptr), zero_score_modelIds(nullptr),
+ nonzero_score_models() {}
 
 /*dtor*/
 CarType::~CarType()
@@ -66,11 +363,16 @@ CarType::~CarType()
     {
         for (int i = 0; i < models_num; i++)
         {
-            delete models[i];
+            models[i].~CarModel();
         }
-        delete[] models;
+        ::operator delete(models);
         delete zero_score_modelIds;
     }
+    for (int i = 0; i < kept_num; i++)
+    {
+        kept[i].~CarModel();
+    }
+    ::operator delete(kept);
 }
 
 /**
@@ -78,7 +380,9 @@ CarType::~CarType()
  **/
 CarModel* CarType::getModelByNum(int modelNum)
 {
-    return models[models_num];
+    if(modelNum >= models_num)
+        return nullptr;
+    return &models[modelNum];
 }
 
 /**
@@ -102,6 +406,11 @@ CarModel* CarType::getBestSeller()
     return best_seller_model;
 }
 
+int CarType::getBestSellerNum()
+{
+    return best_seller_model ? best_seller_model->getModelNum() : 0;
+}
+
 /**
  * sets the best seller model num
 */
@@ -113,63 +422,252 @@ void CarType::setBestSeller(CarModel* new_best_seller)
 /*adds model to zero tree*/
 void CarType::addToZeroTree(CarModel* model)
 {
-    zero_score_modelIds->addElement(model);
+    zero_score_modelIds->insertNode(model->scoreHook());
 }
 
 /*removes model to zero tree*/
 void CarType::removeFromZeroTree(CarModel* model)
 {
-    zero_score_modelIds->deleteElement(model);
+    zero_score_modelIds->removeNode(model->scoreHook());
+}
+
+void CarType::addToScoreIndex(CarModel* model)
+{
+    nonzero_score_models.insertNode(model->typeScoreHook());
+}
+
+void CarType::removeFromScoreIndex(CarModel* model)
+{
+    nonzero_score_models.removeNode(model->typeScoreHook());
+}
+
+/*negative scores, the zero tree, then positive scores*/
+void CarType::getWorstModels(int numOfModels, int* model_nums)
+{
+    int index = 0;
+    AvlTreeNode<CarModel*>* node = nonzero_score_models.getYoungestNode();
+    for (; node && index < numOfModels && node->get_data()->getScore() < 0;
+         node = TreeLinks<CarModel*>::successor(node))
+    {
+        model_nums[index++] = node->get_data()->getModelNum();
+    }
+    AvlTreeNode<CarModel*>* zero = zero_score_modelIds->getYoungestNode();
+    for (; zero && index < numOfModels; zero = TreeLinks<CarModel*>::successor(zero))
+    {
+        model_nums[index++] = zero->get_data()->getModelNum();
+    }
+    for (; node && index < numOfModels; node = TreeLinks<CarModel*>::successor(node))
+    {
+        model_nums[index++] = node->get_data()->getModelNum();
+    }
 }
 
-void CarType::insertZeroScoreModels(int& amount, int& index, int* types, int* model_nums)
+void CarType::insertZeroScoreModels(int& amount, int& index, int* types, int* model_nums, int* scores)
 {
     if(amount > 0)
     {
-        efficiantInorder(zero_score_modelIds->getYoungestNode(), amount, index, types, model_nums);
+        efficiantInorder(zero_score_modelIds->getYoungestNode(), amount, index, types, model_nums, scores);
     }
 }
 
-void CarType::efficiantInorder(AvlTreeNode<CarModel*>* base,
-             int& amount, int& index, int* types, int* models)
+AvlTree<CarModel*, CompModelNum, DefaultBalance, false>& CarType::getZeroScoreModels()
 {
-    if(amount <= 0)
-        return;
-    if(base != nullptr)
+    return *zero_score_modelIds;
+}
+
+bool CarType::isResident()
+{
+    return models != nullptr;
+}
+
+long long CarType::getBlockBytes()
+{
+    return (long long)models_num * sizeof(CarModel);
+}
+
+static bool hasState(CarModel& model)
+{
+    return model.getSails() > 0 || model.getScore() != 0;
+}
+
+bool CarType::evict(const std::function<void(CarModel*, CarModel*)>& move)
+{
+    /*nonzero scores alone are too many - don't count*/
+    if(nonzero_score_models.getSize() * 2 > models_num)
+        return false;
+    int stateful = 0;
+    for (int i = 0; i < models_num; i++)
     {
-        --amount;
-        types[index] = base->get_data()->getType();
-        models[index] = base->get_data()->getModelNum();
-        index++;
-        if(amount > 0)
+        if(hasState(models[i]))
+            stateful++;
+    }
+    /*the kept copies would cost about what the block does*/
+    if(stateful * 2 > models_num)
+        return false;
+    CarModel* new_kept = nullptr;
+    if(stateful > 0)
+    {
+        new_kept = static_cast<CarModel*>(::operator new(sizeof(CarModel) * stateful, std::nothrow));
+        if(!new_kept)
+            return false;
+    }
+    CarModel* best = nullptr; //model 0, if the best seller was never sold
+    int index = 0;
+    for (int i = 0; i < models_num; i++)
+    {
+        if(!hasState(models[i]))
+            continue;
+        CarModel* copy = new (&new_kept[index++]) CarModel(typeId, i);
+        copy->applyDelta(models[i].getSails(), models[i].getScore() - models[i].getSails() * SAIL_POINTS);
+        move(&models[i], copy);
+        if(best_seller_model == &models[i])
+            best = copy;
+    }
+    for (int i = 0; i < models_num; i++)
+    {
+        models[i].~CarModel();
+    }
+    ::operator delete(models);
+    delete zero_score_modelIds;
+    models = nullptr;
+    zero_score_modelIds = nullptr;
+    best_seller_model = best;
+    kept = new_kept;
+    kept_num = stateful;
+    return true;
+}
+
+void CarType::pageIn(const std::function<void(CarModel*, CarModel*)>& move)
+{
+    CarModel* block = static_cast<CarModel*>(::operator new(sizeof(CarModel) * models_num));
+    for (int i = 0; i < models_num; i++)
+    {
+        new (&block[i]) CarModel(typeId, i);
+    }
+    for (int i = 0; i < kept_num; i++)
+    {
+        CarModel& copy = block[kept[i].getModelNum()];
+        copy.applyDelta(kept[i].getSails(), kept[i].getScore() - kept[i].getSails() * SAIL_POINTS);
+    }
+    /*the zero tree, built before anything is relinked so a failure changes nothing*/
+    int* zero_nums = nullptr;
+    AvlTree<CarModel*, CompModelNum, DefaultBalance, false>* zero_tree = nullptr;
+    try{
+        int zero_num = models_num;
+        for (int i = 0; i < kept_num; i++)
         {
-            inOrder(base->get_right(), amount, index, types, models);
+            if(kept[i].getScore() != 0)
+                zero_num--;
         }
-        if(amount > 0)
+        if(zero_num < models_num)
         {
-            efficiantInorder(base->get_parent(), amount, index, types, models);
+            zero_nums = new int[zero_num];
+            for (int i = 0, j = 0; i < models_num; i++)
+            {
+                if(block[i].getScore() == 0)
+                    zero_nums[j++] = i;
+            }
         }
+        auto node_of = [block, zero_nums](int i) { return block[zero_nums ? zero_nums[i] : i].scoreHook(); };
+        zero_tree = new AvlTree<CarModel*, CompModelNum, DefaultBalance, false>(node_of, zero_num);
     }
+    catch(std::bad_alloc&){
+        delete[] zero_nums;
+        for (int i = 0; i < models_num; i++)
+        {
+            block[i].~CarModel();
+        }
+        ::operator delete(block);
+        throw;
+    }
+    delete[] zero_nums;
+    CarModel* best = &block[0];
+    for (int i = 0; i < kept_num; i++)
+    {
+        CarModel* copy = &block[kept[i].getModelNum()];
+        move(&kept[i], copy);
+        if(best_seller_model == &kept[i])
+            best = copy;
+        kept[i].~CarModel();
+    }
+    ::operator delete(kept);
+    kept = nullptr;
+    kept_num = 0;
+    models = block;
+    zero_score_modelIds = zero_tree;
+    best_seller_model = best;
+}
+
+int CarType::getStoredNum()
+{
+    return models ? models_num : kept_num;
+}
+
+CarModel* CarType::getStoredModel(int i)
+{
+    return models ? &models[i] : &kept[i];
+}
+
+CarModel* CarType::findStoredModel(int modelNum)
+{
+    if(models)
+        return getModelByNum(modelNum);
+    CarModel* end = kept + kept_num;
+    CarModel* found = std::lower_bound(kept, end, modelNum,
+        [](CarModel& model, int num) { return model.getModelNum() < num; });
+    return found != end && found->getModelNum() == modelNum ? found : nullptr;
 }
 
-void CarType::inOrder(AvlTreeNode<CarModel*>* root,
-             int& amount, int& index, int* types, int* models)
+bool CarType::isReferenced()
 {
-    if(!root)
+    return referenced;
+}
+
+void CarType::setReferenced(bool value)
+{
+    referenced = value;
+}
+
+void CarType::linkClock(CarType* hand)
+{
+    if(!hand)
+    {
+        clock_prev = clock_next = this;
         return;
-    if(amount > 0)
-        inOrder(root->get_left(),amount, index, types, models);
-    if(amount > 0)
+    }
+    clock_next = hand;
+    clock_prev = hand->clock_prev;
+    clock_prev->clock_next = this;
+    hand->clock_prev = this;
+}
+
+void CarType::unlinkClock()
+{
+    clock_prev->clock_next = clock_next;
+    clock_next->clock_prev = clock_prev;
+    clock_prev = clock_next = nullptr;
+}
+
+CarType* CarType::getClockNext()
+{
+    return clock_next;
+}
+
+void CarType::efficiantInorder(AvlTreeNode<CarModel*>* base,
+             int& amount, int& index, int* types, int* models, int* scores)
+{
+    for (; base && amount > 0; base = TreeLinks<CarModel*>::successor(base))
     {
         --amount;
-        types[index] = root->get_data()->getType();
-        models[index] = root->get_data()->getModelNum();
+        types[index] = base->get_data()->getType();
+        models[index] = base->get_data()->getModelNum();
+        if(scores)
+            scores[index] = base->get_data()->getScore();
         index++;
     }
-    if(amount > 0)
-        inOrder(root->get_right(),amount, index, types, models);
 }
 
+
 /*************************************************/
 
 bool CompModelNum::operator()(CarModel* const model1 , CarModel* const model2)
@@ -206,179 +704,257 @@ bool CompTypeId::operator()(CarType* const type1 , CarType* const type2)
 
 /*************CarDealershipManager application*********************************************************/
 
+/**
+ * removes the `removed` models of car_type that are in index - one by one,
+ * O(mlog(M)), or with one filtering pass and a rebuild, O(M), when m is most of M
+ */
+template<typename Index, typename InIndex, typename HookOf>
+static void removeTypeModels(Index& index, CarType* car_type, int removed, InIndex in_index, HookOf hook_of)
+{
+    if(removed == 0)
+        return;
+    if((long)removed * 16 >= (long)index.getSize() * REBUILD_SIXTEENTHS)
+    {
+        int type_id = car_type->getId();
+        index.removeNodesIf([type_id](CarModel* model) { return model->getType() == type_id; });
+        return;
+    }
+    for (int i = 0; i < car_type->getStoredNum(); i++)
+    {
+        CarModel* model = car_type->getStoredModel(i);
+        if(in_index(model))
+            index.removeNode(hook_of(model));
+    }
+}
+
 /*ctor*/
 CarDealershipManager::CarDealershipManager() : carTypes(), modelSales(),
- PosModelScores(), NegModelScores(), types_num(0), num_of_models(0)
+ PosModelScores(), NegModelScores(), types_num(0), num_of_models(0),
+ worst_cache_size(0), worst_cache_valid(false), worst_cache_types(nullptr),
+ worst_cache_models(nullptr), cache_bound_score(0), cache_bound_type(0), cache_bound_model(0),
+ work_pool(nullptr), work_pool_checked(false), work_threads(0), trace(nullptr), trace_path(nullptr),
+ model_budget(0), resident_bytes(0), resident_types_num(0), cold_types_num(0), clock_hand(nullptr)
  {}
 
  CarDealershipManager::~CarDealershipManager()
  {
-    deleteCarTypes(carTypes.getRoot());
+    deleteCarTypes();
+    delete[] worst_cache_types;
+    delete[] worst_cache_models;
+    delete work_pool;
+    delete trace;
+    delete[] trace_path;
  }
 
- void CarDealershipManager::deleteCarTypes(AvlTreeNode<CarType*>* root)
+ void CarDealershipManager::deleteCarTypes()
 {
-    if(!root)
-        return;
-    delete root->get_data();
-    deleteCarTypes(root->get_left());
-    deleteCarTypes(root->get_right());
+    AvlTreeNode<CarType*>* type = carTypes.getYoungestNode();
+    for (; type; type = TreeLinks<CarType*>::successor(type))
+    {
+        delete type->get_data();
+    }
 }
 
 StatusType CarDealershipManager::AddCarType(int typeId, int numOfModels)
 {
+    TraceScope scope(trace, "AddCarType");
     if(typeId <=0 || numOfModels <= 0)
     {
         return INVALID_INPUT;
     }
-    CarType* car_type;
+    if(findCarType(typeId))
+        return FAILURE; //already exist
+    CarType* car_type = nullptr;
     try{
-        car_type = new CarType(typeId, numOfModels);
+        TraceSpan span(trace, "build type");
+        car_type = new CarType(typeId, numOfModels, numOfModels >= PARALLEL_BUILD_MIN ? workPool() : nullptr);
     }
-    catch(std::bad_alloc()){
-        delete car_type;
+    catch(std::bad_alloc&){
         return ALLOCATION_ERROR;
     }
-    try {
-        carTypes.find(car_type);
-    }
-    catch(NotFound()){
+    {
+        TraceSpan span(trace, "types tree insert");
         carTypes.addElement(car_type);
-        car_type->setBestSeller(0); //set best seller of this type as model 0
-        types_num++;
-        num_of_models += numOfModels;
-        return SUCCESS;
     }
-    //already exist
-    delete car_type;
-    return FAILURE;
+    car_type->setBestSeller(car_type->getModelByNum(0)); //set best seller of this type as model 0
+    if(isBeforeWorstCacheBound(0, typeId, 0))
+        worst_cache_valid = false;
+    types_num++;
+    num_of_models += numOfModels;
+    clockInsert(car_type);
+    enforceBudget();
+    return SUCCESS;
 }
 
 StatusType CarDealershipManager::RemoveCarType (int typeId)
 {
-    CarType* tmp = nullptr;
+    TraceScope scope(trace, "RemoveCarType");
     if(typeId <= 0)
         return INVALID_INPUT;
-    try{
-        tmp = new CarType(typeId);
-    }
-    catch(std::bad_alloc()){
-        return ALLOCATION_ERROR;
-    }
-    CarType* car_type = nullptr;
-    try{
-        car_type = carTypes.find(tmp);
-    }
-    catch(NotFound()){
-        delete tmp;
+    CarType* car_type = findCarType(typeId);
+    if(!car_type)
         return FAILURE;
-    }
-    delete tmp;
-    /*delete this type models of all trees O(mlog(M))*/
-    CarModel* model = nullptr;
-    for (int i = 0; i < car_type->getNumOfModels(); i++)
+    if(worstCacheHoldsType(typeId))
+        worst_cache_valid = false;
+    /*this type's models in each tree*/
+    int sold = 0, positive = 0, negative = 0;
     {
-        model = car_type->getModelByNum(i);
-        modelSales.deleteElement(model);
-        PosModelScores.deleteElement(model);
-        NegModelScores.deleteElement(model);
+        TraceSpan span(trace, "count models");
+        for (int i = 0; i < car_type->getStoredNum(); i++)
+        {
+            CarModel* model = car_type->getStoredModel(i);
+            if(model->getSails() > 0)
+                sold++;
+            if(model->getScore() > 0)
+                positive++;
+            else if(model->getScore() < 0)
+                negative++;
+        }
     }
-    num_of_models -= car_type->getNumOfModels();
-    delete car_type;
-    types_num--;
+    /*the trees are independent, big removals run side by side on the pool*/
+    static const char* const remove_spans[] = { "sales tree deletes", "positive tree deletes",
+     "negative tree deletes" };
+    std::function<void(int)> remove_models = [&](int tree) {
+        TraceScope task(trace, remove_spans[tree]);
+        if(tree == 0)
+            removeTypeModels(modelSales, car_type, sold,
+                [](CarModel* model) { return model->getSails() > 0; },
+                [](CarModel* model) { return model->salesHook(); });
+        else if(tree == 1)
+            removeTypeModels(PosModelScores, car_type, positive,
+                [](CarModel* model) { return model->getScore() > 0; },
+                [](CarModel* model) { return model->scoreHook(); });
+        else
+            removeTypeModels(NegModelScores, car_type, negative,
+                [](CarModel* model) { return model->getScore() < 0; },
+                [](CarModel* model) { return model->scoreHook(); });
+    };
+    ThreadPool* pool = car_type->getNumOfModels() >= PARALLEL_BUILD_MIN ? workPool() : nullptr;
+    if(pool)
+        pool->run(3, remove_models);
+    else
+    {
+        for (int tree = 0; tree < 3; tree++)
+        {
+            remove_models(tree);
+        }
+    }
+#ifdef WET1_SALES_FREQ_LIST
+    /*the models are freed, not re-bucketed - a new one may get the address*/
+    modelSales.forgetHint();
+#endif
+    num_of_models -= car_type->getNumOfModels();
+    if(car_type->isResident())
+        clockRemove(car_type);
+    else
+        cold_types_num--;
+    {
+        TraceSpan span(trace, "types tree delete");
+        carTypes.deleteElement(car_type);
+    }
+    {
+        TraceSpan span(trace, "free type");
+        delete car_type;
+    }
+    types_num--;
     return SUCCESS;
 }
 
 StatusType CarDealershipManager::SellCar (int typeId, int modelId)
 {
+    TraceScope scope(trace, "SellCar");
     if(typeId <=0 || modelId < 0)
     {
         return INVALID_INPUT;
     }
-    CarType* tmp = nullptr;
-    try{
-        tmp = new CarType(typeId);
-    }
-    catch(std::bad_alloc()){
-        return ALLOCATION_ERROR;
-    }
-    CarType* car_type = nullptr;
-    try{
-        car_type = carTypes.find(tmp);
-    }
-    catch(NotFound()){
-        delete tmp;
+    CarType* car_type = findCarType(typeId);
+    if(!car_type || modelId >= car_type->getNumOfModels())
         return FAILURE;
-    }
-    delete tmp;
+    if(!makeResident(car_type))
+        return ALLOCATION_ERROR;
     CarModel* model = car_type->getModelByNum(modelId);
-    modelSales.deleteElement(model);
-    NegModelScores.deleteElement(model);
+    int old_score = model->getScore();
+    if(model->getSails() > 0)
+    {
+        TraceSpan span(trace, "sales tree delete");
+        modelSales.removeNode(model->salesHook());
+    }
+    removeFromScoreTier(car_type, model);
     (*model)++; //add to model sales
     //update this type best seller
-    CarModel* type_best_seller = car_type->getBestSeller();
-    if(type_best_seller->getSails() < model->getSails())
+    CompModelSailes compSales;
+    if(compSales(car_type->getBestSeller(), model))
         car_type->setBestSeller(model);
-    modelSales.addElement(model);
-    if(model->getScore() > 0)
     {
-        car_type->removeFromZeroTree(model);
-        PosModelScores.addElement(model);
-    }
-    else if(model->getScore() < 0)
-    {
-        NegModelScores.addElement(model);
-    }
-    else //model new score is 0
-    {
-        car_type->addToZeroTree(model);
+        TraceSpan span(trace, "sales tree insert");
+        modelSales.insertNode(model->salesHook());
     }
+    addToScoreTier(car_type, model);
+    updateWorstCache(old_score, model);
+    enforceBudget();
     return SUCCESS;
 }
 
 StatusType CarDealershipManager::MakeComplaint (int typeId, int modelId, int t)
 {
+    TraceScope scope(trace, "MakeComplaint");
     if(typeId <=0 || modelId < 0 || t <= 0)
     {
         return INVALID_INPUT;
     }
-    CarType* tmp = nullptr;
-    try{
-        tmp = new CarType(typeId);
-    }
-    catch(std::bad_alloc()){
-        return ALLOCATION_ERROR;
-    }
-    CarType* car_type = nullptr;
-    try{
-        car_type = carTypes.find(tmp);
-    }
-    catch(NotFound()){
-        delete tmp;
+    CarType* car_type = findCarType(typeId);
+    if(!car_type || modelId >= car_type->getNumOfModels())
         return FAILURE;
-    }
-    delete tmp;
+    if(!makeResident(car_type))
+        return ALLOCATION_ERROR;
     CarModel* model = car_type->getModelByNum(modelId);
-    PosModelScores.deleteElement(model);
+    int old_score = model->getScore();
+    removeFromScoreTier(car_type, model);
     model->complain(t);
-    if(model->getScore() > 0)
+    addToScoreTier(car_type, model);
+    updateWorstCache(old_score, model);
+    enforceBudget();
+    return SUCCESS;
+}
+
+StatusType CarDealershipManager::ApplyModelDelta (int typeId, int modelId, int sales, int score_delta)
+{
+    TraceScope scope(trace, "ApplyModelDelta");
+    if(typeId <=0 || modelId < 0 || sales < 0)
     {
-        PosModelScores.addElement(model);
+        return INVALID_INPUT;
     }
-    else if(model->getScore() < 0)
+    CarType* car_type = findCarType(typeId);
+    if(!car_type || modelId >= car_type->getNumOfModels())
+        return FAILURE;
+    if(!makeResident(car_type))
+        return ALLOCATION_ERROR;
+    CarModel* model = car_type->getModelByNum(modelId);
+    int old_score = model->getScore();
+    if(sales > 0 && model->getSails() > 0)
     {
-        car_type->removeFromZeroTree(model);
-        NegModelScores.addElement(model);
+        TraceSpan span(trace, "sales tree delete");
+        modelSales.removeNode(model->salesHook());
     }
-    else //model new score is 0
+    removeFromScoreTier(car_type, model);
+    model->applyDelta(sales, score_delta);
+    if(sales > 0)
     {
-        car_type->addToZeroTree(model);
+        CompModelSailes compSales;
+        if(compSales(car_type->getBestSeller(), model))
+            car_type->setBestSeller(model);
+        TraceSpan span(trace, "sales tree insert");
+        modelSales.insertNode(model->salesHook());
     }
+    addToScoreTier(car_type, model);
+    updateWorstCache(old_score, model);
+    enforceBudget();
     return SUCCESS;
 }
 
  StatusType CarDealershipManager::GetBestSellerModelByType (int typeId, int* modelId)
  {
+    TraceScope scope(trace, "GetBestSellerModelByType");
      if(typeId < 0)
     {
         return INVALID_INPUT;
@@ -389,134 +965,766 @@ StatusType CarDealershipManager::MakeComplaint (int typeId, int modelId, int t)
     }
     if(typeId == 0)
     {
-        CarModel* best_seller = nullptr;
-        try{
-            best_seller = modelSales.getOldestData();
-        }
+        CarModel** best_seller = modelSales.tryGetOldest();
         //all models have zero sales
-        catch(EmptyTree()){
+        if(!best_seller)
+        {
             *modelId = 0;
             return SUCCESS;
         }
-        *modelId = best_seller->getModelNum();
+        *modelId = (*best_seller)->getModelNum();
         return SUCCESS;
     }
     else
     {
-        CarType* tmp = nullptr;
-        try{
-            tmp = new CarType(typeId);
-        }
-        catch(std::bad_alloc()){
-            delete tmp;
-            return ALLOCATION_ERROR;
-        }
-        CarType* car_type = nullptr;
-        try{
-            car_type = carTypes.find(tmp);
-        }
-        catch(NotFound()){
-            delete tmp;
+        CarType* car_type = findCarType(typeId);
+        if(!car_type)
             return FAILURE;
-        }
-        delete tmp;
-        *modelId = car_type->getBestSeller()->getModelNum();
+        *modelId = car_type->getBestSellerNum();
         return SUCCESS;
     }
  }
 
  StatusType CarDealershipManager::GetWorstModels (int numOfModels, int* types, int* models)
  {
+    TraceScope scope(trace, "GetWorstModels");
     if(numOfModels <= 0)
         return INVALID_INPUT;
     if(numOfModels > num_of_models)
         return FAILURE;
-    int index = 0;
-    int amount = numOfModels;
-    efficiantInorder(NegModelScores.getYoungestNode(),amount, index, types, models);
-    if(amount > 0)
+    if(numOfModels <= worst_cache_size && worst_cache_size <= num_of_models)
     {
-        efficiantInorderZeroScores(carTypes.getYoungestNode(),amount, index, types, models);
+        if(!worst_cache_valid)
+        {
+            if(!pageInZeroTypes(worst_cache_size))
+                return ALLOCATION_ERROR;
+            TraceSpan span(trace, "worst cache fill");
+            fillWorstCache();
+        }
+        memcpy(types, worst_cache_types, numOfModels * sizeof(int));
+        memcpy(models, worst_cache_models, numOfModels * sizeof(int));
+        enforceBudget();
+        return SUCCESS;
     }
-    if(amount > 0)
+    if(!pageInZeroTypes(numOfModels))
+        return ALLOCATION_ERROR;
+    fillWorstModels(numOfModels, types, models, nullptr);
+    enforceBudget();
+    return SUCCESS;
+ }
+
+StatusType CarDealershipManager::CountModelsInScoreRange(int lo, int hi, int* count)
+{
+    TraceScope scope(trace, "CountModelsInScoreRange");
+    if(lo > hi || !count)
+        return INVALID_INPUT;
+    *count = 0;
+    if(lo < 0)
+        *count += tierCountBelow(NegModelScores, hi, true) - tierCountBelow(NegModelScores, lo, false);
+    if(lo <= 0 && hi >= 0)
+        *count += num_of_models - NegModelScores.getSize() - PosModelScores.getSize();
+    if(hi > 0)
+        *count += tierCountBelow(PosModelScores, hi, true) - tierCountBelow(PosModelScores, lo, false);
+    return SUCCESS;
+}
+
+StatusType CarDealershipManager::EnumerateModelsInScoreRange(int lo, int hi, ModelVisitor visitor, void* context)
+{
+    TraceScope scope(trace, "EnumerateModelsInScoreRange");
+    if(lo > hi || !visitor)
+        return INVALID_INPUT;
+    if(lo < 0 && !tierEnumerate(NegModelScores, lo, hi, visitor, context))
+        return SUCCESS;
+    bool more = true;
+    if(lo <= 0 && hi >= 0)
     {
-        efficiantInorder(PosModelScores.getYoungestNode(),amount, index, types, models);
+        /*zero score models are by type, then model - cold types are not paged in*/
+        AvlTreeNode<CarType*>* type = carTypes.getYoungestNode();
+        for (; type && more; type = TreeLinks<CarType*>::successor(type))
+        {
+            CarType* car_type = type->get_data();
+            if(car_type->isResident())
+                more = visitModels(car_type->getZeroScoreModels().getYoungestNode(), 0, visitor, context);
+            else
+                more = visitColdZeros(car_type, visitor, context);
+        }
     }
+    if(hi > 0 && more)
+        tierEnumerate(PosModelScores, lo, hi, visitor, context);
     return SUCCESS;
- }
+}
 
-void CarDealershipManager::efficiantInorder(AvlTreeNode<CarModel*>* base,
-             int& amount, int& index, int* types, int* models)
+int CarDealershipManager::tierCountBelow(ScoreTier& tier, int bound, bool inclusive)
 {
-    if(amount <= 0)
-        return;
-    if(base != nullptr)
+#ifdef WET1_SCORE_BUCKETS
+    /*buckets hold no model counts of their subtrees - sum them up*/
+    int count = 0;
+    AvlTreeNode<ScoreBucket*>* bucket = tier.getYoungestNode();
+    for (; bucket; bucket = TreeLinks<ScoreBucket*>::successor(bucket))
     {
-        --amount;
-        types[index] = base->get_data()->getType();
-        models[index] = base->get_data()->getModelNum();
-        index++;
-        if(amount > 0)
+        int score = bucket->get_data()->getScore();
+        if(score > bound || (score == bound && !inclusive))
+            break;
+        count += bucket->get_data()->getModels().getSize();
+    }
+    return count;
+#else
+    return tier.countBelow([bound, inclusive](CarModel* model) {
+        return model->getScore() < bound || (inclusive && model->getScore() == bound);
+    });
+#endif
+}
+
+bool CarDealershipManager::tierEnumerate(ScoreTier& tier, int lo, int hi, ModelVisitor visitor, void* context)
+{
+#ifdef WET1_SCORE_BUCKETS
+    AvlTreeNode<ScoreBucket*>* bucket = tier.lowerBoundNode(lo);
+    for (; bucket && bucket->get_data()->getScore() <= hi; bucket = TreeLinks<ScoreBucket*>::successor(bucket))
+    {
+        if(!visitModels(bucket->get_data()->getModels().getYoungestNode(), hi, visitor, context))
+            return false;
+    }
+    return true;
+#else
+    AvlTreeNode<CarModel*>* first = tier.lowerBoundNode([lo](CarModel* model) { return model->getScore() < lo; });
+    return visitModels(first, hi, visitor, context);
+#endif
+}
+
+/*visits node and its successors up to score hi*/
+bool CarDealershipManager::visitModels(AvlTreeNode<CarModel*>* node, int hi, ModelVisitor visitor, void* context)
+{
+    for (; node && node->get_data()->getScore() <= hi; node = TreeLinks<CarModel*>::successor(node))
+    {
+        CarModel* model = node->get_data();
+        if(visitor(context, model->getType(), model->getModelNum(), model->getScore()))
+            return false;
+    }
+    return true;
+}
+
+/*a cold type's models past its kept ones are all in their initial state, score 0*/
+bool CarDealershipManager::visitColdZeros(CarType* car_type, ModelVisitor visitor, void* context)
+{
+    int kept = 0;
+    for (int i = 0; i < car_type->getNumOfModels(); i++)
+    {
+        if(kept < car_type->getStoredNum() && car_type->getStoredModel(kept)->getModelNum() == i)
+        {
+            if(car_type->getStoredModel(kept++)->getScore() != 0)
+                continue;
+        }
+        if(visitor(context, car_type->getId(), i, 0))
+            return false;
+    }
+    return true;
+}
+
+StatusType CarDealershipManager::GetWorstModelsByType(int typeId, int numOfModels, int* models)
+{
+    TraceScope scope(trace, "GetWorstModelsByType");
+    if(typeId <= 0 || numOfModels <= 0 || !models)
+        return INVALID_INPUT;
+    CarType* car_type = findCarType(typeId);
+    if(!car_type || numOfModels > car_type->getNumOfModels())
+        return FAILURE;
+    if(!makeResident(car_type))
+        return ALLOCATION_ERROR;
+    {
+        TraceSpan span(trace, "type inorder");
+        car_type->getWorstModels(numOfModels, models);
+    }
+    enforceBudget();
+    return SUCCESS;
+}
+
+/*returns nullptr if there is no such type*/
+CarType* CarDealershipManager::findCarType(int typeId)
+{
+    TraceSpan span(trace, "lookup");
+    CarType tmp(typeId);
+    CarType** car_type = carTypes.tryFind(&tmp);
+    if(!car_type)
+        return nullptr;
+    if(model_budget > 0)
+        (*car_type)->setReferenced(true);
+    return *car_type;
+}
+
+void CarDealershipManager::findCarTypes(const int* typeIds, int n, CarType** types)
+{
+    /*results point into the tree's nodes, each holding a CarType**/
+    CarType** found[BATCH_LOOKUP_SIZE];
+    TraceSpan span(trace, "batch lookup");
+    for (int first = 0; first < n; first += BATCH_LOOKUP_SIZE)
+    {
+        int count = std::min(n - first, BATCH_LOOKUP_SIZE);
+        carTypes.findBatch(typeIds + first, count, found,
+            [](int typeId, CarType* car_type) { return typeId < car_type->getId() ? -1 : typeId > car_type->getId(); });
+        for (int i = 0; i < count; i++)
         {
-            inOrder(base->get_right(), amount, index, types, models);
+            types[first + i] = found[i] ? *found[i] : nullptr;
+            if(types[first + i] && model_budget > 0)
+                types[first + i]->setReferenced(true);
         }
-        if(amount > 0)
+    }
+}
+
+StatusType CarDealershipManager::GetBestSellerModelByTypeBatch(int n, const int* typeIds, int* modelIds,
+             StatusType* results)
+{
+    TraceScope scope(trace, "GetBestSellerModelByTypeBatch");
+    if(n < 0 || (n > 0 && (!typeIds || !modelIds || !results)))
+        return INVALID_INPUT;
+    CarType* types[BATCH_LOOKUP_SIZE];
+    for (int first = 0; first < n; first += BATCH_LOOKUP_SIZE)
+    {
+        int count = std::min(n - first, BATCH_LOOKUP_SIZE);
+        findCarTypes(typeIds + first, count, types);
+        for (int i = 0; i < count; i++)
         {
-            efficiantInorder(base->get_parent(), amount, index, types, models);
+            int typeId = typeIds[first + i];
+            /*the rest has no lookup to save*/
+            if(typeId <= 0 || types_num == 0)
+                results[first + i] = GetBestSellerModelByType(typeId, &modelIds[first + i]);
+            else if(!types[i])
+                results[first + i] = FAILURE;
+            else
+            {
+                modelIds[first + i] = types[i]->getBestSellerNum();
+                results[first + i] = SUCCESS;
+            }
         }
     }
+    return SUCCESS;
+}
+
+OperationStats& CarDealershipManager::getOperationStats()
+{
+    return operation_stats;
+}
+
+StatusType CarDealershipManager::GetStats(DealershipStats* stats)
+{
+    if(!stats)
+        return INVALID_INPUT;
+    operation_stats.copyTo(stats);
+    stats->types_num = types_num;
+    stats->num_of_models = num_of_models;
+    stats->negative_models = NegModelScores.getSize();
+    stats->positive_models = PosModelScores.getSize();
+    stats->zero_models = num_of_models - stats->negative_models - stats->positive_models;
+    stats->types_height = carTypes.getHeight();
+    stats->sales_height = modelSales.getHeight();
+    stats->negative_height = NegModelScores.getHeight();
+    stats->positive_height = PosModelScores.getHeight();
+    return SUCCESS;
+}
+
+StatusType CarDealershipManager::EnableTracing(int capacity, bool trees, const char* path)
+{
+    if(capacity < 0)
+        return INVALID_INPUT;
+    TraceBuffer* new_trace = nullptr;
+    char* new_path = nullptr;
+    try{
+        if(capacity > 0)
+        {
+            new_trace = new TraceBuffer(capacity, trees);
+            if(path)
+            {
+                new_path = new char[strlen(path) + 1];
+                strcpy(new_path, path);
+            }
+        }
+    }
+    catch(std::bad_alloc&){
+        delete new_trace;
+        return ALLOCATION_ERROR;
+    }
+    delete trace;
+    delete[] trace_path;
+    trace = new_trace;
+    trace_path = new_path;
+    return SUCCESS;
+}
+
+StatusType CarDealershipManager::DumpTrace(const char* path)
+{
+    if(!path)
+        path = trace_path;
+    if(!trace || !path)
+        return FAILURE;
+    return trace->dump(path) ? SUCCESS : FAILURE;
+}
+
+int CarDealershipManager::getTypesNum()
+{
+    return types_num;
+}
+
+int CarDealershipManager::getModelsNum()
+{
+    return num_of_models;
+}
+
+StatusType CarDealershipManager::GetTopSeller(int* sales, int* typeId, int* modelId)
+{
+    CarModel** best_seller = modelSales.tryGetOldest();
+    if(!best_seller)
+        return FAILURE;
+    *sales = (*best_seller)->getSails();
+    *typeId = (*best_seller)->getType();
+    *modelId = (*best_seller)->getModelNum();
+    return SUCCESS;
 }
 
-void CarDealershipManager::inOrder(AvlTreeNode<CarModel*>* root,
-             int& amount, int& index, int* types, int* models)
+StatusType CarDealershipManager::GetWorstModelsWithScores(int numOfModels, int* types, int* models, int* scores)
 {
-    if(!root)
+    TraceScope scope(trace, "GetWorstModelsWithScores");
+    if(numOfModels <= 0)
+        return INVALID_INPUT;
+    if(numOfModels > num_of_models)
+        return FAILURE;
+    if(!pageInZeroTypes(numOfModels))
+        return ALLOCATION_ERROR;
+    fillWorstModels(numOfModels, types, models, scores);
+    enforceBudget();
+    return SUCCESS;
+}
+
+void CarDealershipManager::fillWorstModels(int numOfModels, int* types, int* models, int* scores)
+{
+    if(numOfModels >= PARALLEL_WORST_MIN && workPool())
+    {
+        fillWorstModelsParallel(numOfModels, types, models, scores);
         return;
-    if(amount > 0)
-        inOrder(root->get_left(),amount, index, types, models);
+    }
+    int index = 0;
+    int amount = numOfModels;
+    {
+        TraceSpan span(trace, "negative inorder");
+        tierInorder(NegModelScores, amount, index, types, models, scores);
+    }
     if(amount > 0)
     {
-        --amount;
-        types[index] = root->get_data()->getType();
-        models[index] = root->get_data()->getModelNum();
-        index++;
+        TraceSpan span(trace, "zero inorder");
+        efficiantInorderZeroScores(carTypes.getYoungestNode(),amount, index, types, models, scores);
     }
     if(amount > 0)
-        inOrder(root->get_right(),amount, index, types, models);
+    {
+        TraceSpan span(trace, "positive inorder");
+        tierInorder(PosModelScores, amount, index, types, models, scores);
+    }
 }
 
-void CarDealershipManager::efficiantInorderZeroScores(AvlTreeNode<CarType*>* base,
-             int& amount, int& index, int* types, int* models)
+ThreadPool* CarDealershipManager::workPool()
 {
-    if(amount <= 0)
-        return;
-    if(base != nullptr)
+    if(!work_pool_checked)
+    {
+        work_pool_checked = true;
+        unsigned threads = work_threads > 0 ? work_threads : std::thread::hardware_concurrency();
+        if(threads > 1)
+            work_pool = new ThreadPool(threads);
+    }
+    return work_pool;
+}
+
+void CarDealershipManager::fillWorstModelsParallel(int numOfModels, int* types, int* models, int* scores)
+{
+    int max_ranges = work_pool->getThreadsNum() * WORST_RANGES_PER_THREAD;
+    int chunk = (numOfModels + max_ranges - 1) / max_ranges;
+    /*every tier part may end with a short range*/
+    WorstRange* ranges = new WorstRange[max_ranges + 3];
+    int ranges_num = 0;
+    int neg_count = std::min(numOfModels, NegModelScores.getSize());
+    int zero_models = num_of_models - NegModelScores.getSize() - PosModelScores.getSize();
+    int zero_count = std::min(numOfModels - neg_count, zero_models);
+    int pos_count = numOfModels - neg_count - zero_count;
+    addTierRanges(NegModelScores, WORST_NEG, 0, neg_count, chunk, ranges, ranges_num);
+    addZeroRanges(neg_count, zero_count, chunk, ranges, ranges_num);
+    addTierRanges(PosModelScores, WORST_POS, neg_count + zero_count, pos_count, chunk, ranges, ranges_num);
+    work_pool->run(ranges_num, [&](int i) {
+        TraceScope task(trace, "worst range inorder");
+        fillWorstRange(ranges[i], types, models, scores);
+    });
+    delete[] ranges;
+}
+
+void CarDealershipManager::addTierRanges(ScoreTier& tier, WorstTier tier_id, int index, int count, int chunk,
+             WorstRange* ranges, int& ranges_num)
+{
+#ifdef WET1_SCORE_BUCKETS
+    /*buckets hold no model counts of their subtrees - walk them once*/
+    AvlTreeNode<ScoreBucket*>* bucket = tier.getYoungestNode();
+    int bucket_first = 0; //rank of the bucket's first model
+    for (int rank = 0; rank < count; rank += chunk)
+    {
+        while(rank >= bucket_first + bucket->get_data()->getModels().getSize())
+        {
+            bucket_first += bucket->get_data()->getModels().getSize();
+            bucket = TreeLinks<ScoreBucket*>::successor(bucket);
+        }
+        WorstRange& range = ranges[ranges_num++];
+        range.tier = tier_id;
+        range.index = index + rank;
+        range.count = std::min(chunk, count - rank);
+        range.model = bucket->get_data()->getModels().selectNode(rank - bucket_first);
+        range.type = nullptr;
+        range.bucket = bucket;
+    }
+#else
+    for (int rank = 0; rank < count; rank += chunk)
+    {
+        WorstRange& range = ranges[ranges_num++];
+        range.tier = tier_id;
+        range.index = index + rank;
+        range.count = std::min(chunk, count - rank);
+        range.model = tier.selectNode(rank);
+        range.type = nullptr;
+    }
+#endif
+}
+
+void CarDealershipManager::addZeroRanges(int index, int count, int chunk, WorstRange* ranges, int& ranges_num)
+{
+    /*types hold no zero counts of their subtrees - walk them once*/
+    AvlTreeNode<CarType*>* type = carTypes.getYoungestNode();
+    int type_first = 0; //rank of the type's first zero score model
+    for (int rank = 0; rank < count; rank += chunk)
+    {
+        while(rank >= type_first + type->get_data()->getZeroScoreModels().getSize())
+        {
+            type_first += type->get_data()->getZeroScoreModels().getSize();
+            type = TreeLinks<CarType*>::successor(type);
+        }
+        WorstRange& range = ranges[ranges_num++];
+        range.tier = WORST_ZERO;
+        range.index = index + rank;
+        range.count = std::min(chunk, count - rank);
+        range.model = type->get_data()->getZeroScoreModels().selectNode(rank - type_first);
+        range.type = type;
+#ifdef WET1_SCORE_BUCKETS
+        range.bucket = nullptr;
+#endif
+    }
+}
+
+void CarDealershipManager::fillWorstRange(WorstRange& range, int* types, int* models, int* scores)
+{
+    AvlTreeNode<CarModel*>* node = range.model;
+    AvlTreeNode<CarType*>* type = range.type;
+#ifdef WET1_SCORE_BUCKETS
+    AvlTreeNode<ScoreBucket*>* bucket = range.bucket;
+#endif
+    int end = range.index + range.count;
+    for (int i = range.index; i < end; i++)
     {
-        base->get_data()->insertZeroScoreModels(amount, index, types, models);
-        if(amount > 0)
+        CarModel* model = node->get_data();
+        types[i] = model->getType();
+        models[i] = model->getModelNum();
+        if(scores)
+            scores[i] = model->getScore();
+        if(i + 1 == end)
+            break;
+        node = TreeLinks<CarModel*>::successor(node);
+        if(node)
+            continue;
+        /*end of a zero tree or a score bucket, go on to the next one*/
+        if(range.tier == WORST_ZERO)
         {
-            inOrderZeroScores(base->get_right(), amount, index, types, models);
+            do
+            {
+                type = TreeLinks<CarType*>::successor(type);
+            } while(type->get_data()->getZeroScoreModels().getSize() == 0);
+            node = type->get_data()->getZeroScoreModels().getYoungestNode();
         }
-        if(amount > 0)
+#ifdef WET1_SCORE_BUCKETS
+        else
+        {
+            bucket = TreeLinks<ScoreBucket*>::successor(bucket);
+            node = bucket->get_data()->getModels().getYoungestNode();
+        }
+#endif
+    }
+}
+
+StatusType CarDealershipManager::CompactStep(int budget, bool* done)
+{
+    TraceScope scope(trace, "CompactStep");
+    if(budget <= 0 || !done)
+        return INVALID_INPUT;
+    /*the score trees are intrusive - their nodes stay in the models*/
+    budget = carTypes.compactStep(budget);
+#ifdef WET1_SCORE_BUCKETS
+    if(budget > 0)
+        budget = NegModelScores.compactStep(budget);
+    if(budget > 0)
+        budget = PosModelScores.compactStep(budget);
+#endif
+    if(budget == COMPACT_OUT_OF_MEMORY)
+    {
+        *done = false;
+        return ALLOCATION_ERROR;
+    }
+    *done = budget > 0;
+    return SUCCESS;
+}
+
+StatusType CarDealershipManager::SetWorstModelsCacheSize(int cacheSize)
+{
+    if(cacheSize < 0)
+        return INVALID_INPUT;
+    int* new_types = nullptr;
+    int* new_models = nullptr;
+    try{
+        if(cacheSize > 0)
+        {
+            new_types = new int[cacheSize];
+            new_models = new int[cacheSize];
+        }
+    }
+    catch(std::bad_alloc&){
+        delete[] new_types;
+        return ALLOCATION_ERROR;
+    }
+    delete[] worst_cache_types;
+    delete[] worst_cache_models;
+    worst_cache_types = new_types;
+    worst_cache_models = new_models;
+    worst_cache_size = cacheSize;
+    worst_cache_valid = false;
+    return SUCCESS;
+}
+
+StatusType CarDealershipManager::SetModelMemoryBudget(long long bytes)
+{
+    TraceScope scope(trace, "SetModelMemoryBudget");
+    if(bytes < 0)
+        return INVALID_INPUT;
+    model_budget = bytes;
+    enforceBudget();
+    return SUCCESS;
+}
+
+StatusType CarDealershipManager::SetWorkThreads(int threads)
+{
+    if(threads < 0)
+        return INVALID_INPUT;
+    /*made again on the next big call*/
+    delete work_pool;
+    work_pool = nullptr;
+    work_pool_checked = false;
+    work_threads = threads;
+    return SUCCESS;
+}
+
+void CarDealershipManager::moveModel(CarType* car_type, CarModel* from, CarModel* to)
+{
+    if(from->getSails() > 0)
+    {
+        modelSales.removeNode(from->salesHook());
+        modelSales.insertNode(to->salesHook());
+    }
+    /*zero score models are only in the zero tree, which is dropped and rebuilt*/
+    if(from->getScore() != 0)
+    {
+        removeFromScoreTier(car_type, from);
+        addToScoreTier(car_type, to);
+    }
+}
+
+bool CarDealershipManager::makeResident(CarType* car_type)
+{
+    if(car_type->isResident())
+        return true;
+    TraceSpan span(trace, "page in");
+    try{
+        car_type->pageIn([this, car_type](CarModel* from, CarModel* to) { moveModel(car_type, from, to); });
+    }
+    catch(std::bad_alloc&){
+        return false;
+    }
+    cold_types_num--;
+    clockInsert(car_type);
+    return true;
+}
+
+bool CarDealershipManager::makeCold(CarType* car_type)
+{
+    TraceSpan span(trace, "evict");
+    if(!car_type->evict([this, car_type](CarModel* from, CarModel* to) { moveModel(car_type, from, to); }))
+        return false;
+    clockRemove(car_type);
+    cold_types_num++;
+    return true;
+}
+
+/*CLOCK - one sweep at most, so types that can't be evicted don't stall operations*/
+void CarDealershipManager::enforceBudget()
+{
+    if(model_budget <= 0)
+        return;
+    int steps = resident_types_num * 2;
+    while(resident_bytes > model_budget && clock_hand && steps-- > 0)
+    {
+        CarType* car_type = clock_hand;
+        clock_hand = car_type->getClockNext();
+        if(car_type->isReferenced())
         {
-            inOrderZeroScores(base->get_parent(), amount, index, types, models);
+            car_type->setReferenced(false);
+            continue;
         }
+        makeCold(car_type);
+    }
+}
+
+void CarDealershipManager::clockInsert(CarType* car_type)
+{
+    car_type->linkClock(clock_hand);
+    if(!clock_hand)
+        clock_hand = car_type;
+    car_type->setReferenced(true);
+    resident_types_num++;
+    resident_bytes += car_type->getBlockBytes();
+}
+
+void CarDealershipManager::clockRemove(CarType* car_type)
+{
+    if(clock_hand == car_type)
+        clock_hand = car_type->getClockNext() == car_type ? nullptr : car_type->getClockNext();
+    car_type->unlinkClock();
+    resident_types_num--;
+    resident_bytes -= car_type->getBlockBytes();
+}
+
+bool CarDealershipManager::pageInZeroTypes(long long needed)
+{
+    if(cold_types_num == 0)
+        return true;
+    needed -= NegModelScores.getSize();
+    AvlTreeNode<CarType*>* type = carTypes.getYoungestNode();
+    for (; type && needed > 0; type = TreeLinks<CarType*>::successor(type))
+    {
+        if(!makeResident(type->get_data()))
+            return false;
+        needed -= type->get_data()->getZeroScoreModels().getSize();
+    }
+    return true;
+}
+
+void CarDealershipManager::fillWorstCache()
+{
+    fillWorstModels(worst_cache_size, worst_cache_types, worst_cache_models, nullptr);
+    cache_bound_type = worst_cache_types[worst_cache_size - 1];
+    cache_bound_model = worst_cache_models[worst_cache_size - 1];
+    /*the bound may be a positive or negative model of a cold type*/
+    CarModel* bound = findCarType(cache_bound_type)->findStoredModel(cache_bound_model);
+    cache_bound_score = bound ? bound->getScore() : 0;
+    worst_cache_valid = true;
+}
+
+bool CarDealershipManager::isBeforeWorstCacheBound(int score, int type, int model)
+{
+    if(!worst_cache_valid)
+        return false;
+    if(score != cache_bound_score)
+        return score < cache_bound_score;
+    if(type != cache_bound_type)
+        return type < cache_bound_type;
+    return model <= cache_bound_model;
+}
+
+void CarDealershipManager::updateWorstCache(int old_score, CarModel* model)
+{
+    if(isBeforeWorstCacheBound(old_score, model->getType(), model->getModelNum()) ||
+        isBeforeWorstCacheBound(model->getScore(), model->getType(), model->getModelNum()))
+    {
+        worst_cache_valid = false;
+    }
+}
+
+bool CarDealershipManager::worstCacheHoldsType(int typeId)
+{
+    if(!worst_cache_valid)
+        return false;
+    for (int i = 0; i < worst_cache_size; i++)
+    {
+        if(worst_cache_types[i] == typeId)
+            return true;
     }
+    return false;
 }
 
-void CarDealershipManager::inOrderZeroScores(AvlTreeNode<CarType*>* root,
-             int& amount, int& index, int* types, int* models)
+void CarDealershipManager::removeFromScoreTier(CarType* car_type, CarModel* model)
 {
-    if(!root)
+    if(model->getScore() == 0)
+    {
+        TraceSpan span(trace, "zero tree delete");
+        car_type->removeFromZeroTree(model);
         return;
-    if(amount > 0)
-        inOrderZeroScores(root->get_left(),amount, index, types, models);
-    if(amount > 0)
+    }
+    TraceSpan span(trace, "score tree delete");
+    if(model->getScore() > 0)
+        PosModelScores.removeNode(model->scoreHook());
+    else
+        NegModelScores.removeNode(model->scoreHook());
+    car_type->removeFromScoreIndex(model);
+}
+
+void CarDealershipManager::addToScoreTier(CarType* car_type, CarModel* model)
+{
+    if(model->getScore() == 0)
     {
-        root->get_data()->insertZeroScoreModels(amount, index, types, models);
+        TraceSpan span(trace, "zero tree insert");
+        car_type->addToZeroTree(model);
+        return;
     }
-    if(amount > 0)
-        inOrderZeroScores(root->get_right(),amount, index, types, models);
+    TraceSpan span(trace, "score tree insert");
+    if(model->getScore() > 0)
+        PosModelScores.insertNode(model->scoreHook());
+    else
+        NegModelScores.insertNode(model->scoreHook());
+    car_type->addToScoreIndex(model);
 }
 
+void CarDealershipManager::tierInorder(ScoreTier& tier,
+             int& amount, int& index, int* types, int* models, int* scores)
+{
+#ifdef WET1_SCORE_BUCKETS
+    AvlTreeNode<ScoreBucket*>* bucket = tier.getYoungestNode();
+    for (; bucket && amount > 0; bucket = TreeLinks<ScoreBucket*>::successor(bucket))
+    {
+        efficiantInorder(bucket->get_data()->getModels().getYoungestNode(), amount, index, types, models, scores);
+    }
+#else
+    efficiantInorder(tier.getYoungestNode(), amount, index, types, models, scores);
+#endif
+}
+
+void CarDealershipManager::efficiantInorder(AvlTreeNode<CarModel*>* base,
+             int& amount, int& index, int* types, int* models, int* scores)
+{
+    for (; base && amount > 0; base = TreeLinks<CarModel*>::successor(base))
+    {
+        --amount;
+        types[index] = base->get_data()->getType();
+        models[index] = base->get_data()->getModelNum();
+        if(scores)
+            scores[index] = base->get_data()->getScore();
+        index++;
+    }
+}
+
+
+void CarDealershipManager::efficiantInorderZeroScores(AvlTreeNode<CarType*>* base,
+             int& amount, int& index, int* types, int* models, int* scores)
+{
+    for (; base && amount > 0; base = TreeLinks<CarType*>::successor(base))
+    {
+        base->get_data()->insertZeroScoreModels(amount, index, types, models, scores);
+    }
+}
+
+
 /*********************************************************************/
\ No newline at end of file
@@ -3,6 +3,9 @@
 
 #include "AvlTree.h"
 #include "library.h"
+#include "OperationStats.h"
+#include "ThreadPool.h"
+#include "Trace.h"
 
 typedef enum {
     CAR_TPYES,
@@ -12,12 +15,35 @@ typedef enum {
 
 namespace wet1
 {
+    class SalesBucket;
+
     class CarModel
     {
         private:
             int model_type, model_num, sails, score;
+            /**
+             * intrusive tree hooks - modelSales holds the model once it sold,
+             * the score hook is in exactly one of NegModelScores, the type's
+             * zero tree and PosModelScores, the type score hook is in the
+             * type's nonzero score tree while the score is not 0
+             */
+            AvlTreeNode<CarModel*> sales_hook;
+            AvlTreeNode<CarModel*> score_hook;
+            AvlTreeNode<CarModel*> type_score_hook;
+#ifdef WET1_SALES_FREQ_LIST
+            SalesBucket* sales_bucket; //the SalesFrequencyList bucket holding sales_hook
+#endif
         public:
             CarModel(int type, int model);
+            CarModel(const CarModel&) = delete;
+            CarModel& operator=(const CarModel&) = delete;
+            AvlTreeNode<CarModel*>* salesHook();
+            AvlTreeNode<CarModel*>* scoreHook();
+            AvlTreeNode<CarModel*>* typeScoreHook();
+#ifdef WET1_SALES_FREQ_LIST
+            SalesBucket* getSalesBucket();
+            void setSalesBucket(SalesBucket* bucket);
+#endif
             int getType();
             int getModelNum();
             int getScore();
@@ -26,6 +52,8 @@ namespace wet1
             void operator++(int);
             /*for complaint*/
             void complain (int t);
+            /*for a batch of sales and complaints, score_delta is the complaints part*/
+            void applyDelta (int sales, int score_delta);
     };
 
     /**
@@ -59,40 +87,231 @@ namespace wet1
             bool operator() (CarModel* const model1 , CarModel* const model2);
     };
 
+    /**
+     * Models sharing one score, ordered by (type, model) through their
+     * score hooks.
+     */
+    class ScoreBucket
+    {
+        int score;
+        AvlTree<CarModel*, CompModelScore, DefaultBalance, false> models;
+
+        public:
+            explicit ScoreBucket(int score);
+            int getScore();
+            AvlTree<CarModel*, CompModelScore, DefaultBalance, false>& getModels();
+    };
+
+    /**
+     * object function to compare buckets by score
+     */
+    class CompBucketScore
+    {
+        public:
+            bool operator() (ScoreBucket* const bucket1 , ScoreBucket* const bucket2);
+    };
+
+    /**
+     * Two level score index - a tree of the distinct scores, each with a
+     * bucket of its models. Same insertNode/removeNode interface as the
+     * intrusive score trees; re-scoring touches two buckets, and a walk
+     * goes bucket by bucket.
+     */
+    class ScoreBucketIndex
+    {
+        AvlTree<ScoreBucket*, CompBucketScore> buckets;
+        int size;
+
+        ScoreBucket* findBucket(int score);
+
+        public:
+            ScoreBucketIndex();
+            ~ScoreBucketIndex();
+            ScoreBucketIndex(const ScoreBucketIndex&) = delete;
+            ScoreBucketIndex& operator=(const ScoreBucketIndex&) = delete;
+            void insertNode(AvlTreeNode<CarModel*>* hook);
+            void removeNode(AvlTreeNode<CarModel*>* hook);
+            /*AvlTree::removeNodesIf on every bucket, empty buckets are dropped*/
+            template<typename Pred>
+            void removeNodesIf(Pred pred)
+            {
+                AvlTreeNode<ScoreBucket*>* node = buckets.getYoungestNode();
+                while(node)
+                {
+                    AvlTreeNode<ScoreBucket*>* next = TreeLinks<ScoreBucket*>::successor(node);
+                    ScoreBucket* bucket = node->get_data();
+                    size -= bucket->getModels().getSize();
+                    bucket->getModels().removeNodesIf(pred);
+                    size += bucket->getModels().getSize();
+                    if(bucket->getModels().getSize() == 0)
+                    {
+                        buckets.deleteElement(bucket);
+                        delete bucket;
+                    }
+                    node = next;
+                }
+            }
+            int getSize();
+            /*height of the scores tree*/
+            int getHeight();
+            /*the lowest score's bucket*/
+            AvlTreeNode<ScoreBucket*>* getYoungestNode();
+            /*the lowest bucket with a score of at least score*/
+            AvlTreeNode<ScoreBucket*>* lowerBoundNode(int score);
+            /*AvlTree::compactStep of the scores tree*/
+            int compactStep(int budget);
+    };
+
+#ifdef WET1_SALES_FREQ_LIST
+    /**
+     * Models with the same number of sales, ordered like modelSales.
+     */
+    class SalesBucket
+    {
+        int sales;
+        AvlTree<CarModel*, CompModelSailes, DefaultBalance, false> models;
+
+        public:
+            SalesBucket* prev; //fewer sales
+            SalesBucket* next; //more sales
+            explicit SalesBucket(int sales);
+            int getSales();
+            AvlTree<CarModel*, CompModelSailes, DefaultBalance, false>& getModels();
+    };
+
+    /**
+     * LFU style frequency list - a doubly linked list of sales buckets in
+     * increasing order. Sales only grow, so a model moves forward from the
+     * bucket it was just removed from, usually to the next one. The best
+     * seller is the best model of the last bucket. Same interface as the
+     * modelSales tree; models must be removed before their sales change.
+     */
+    class SalesFrequencyList
+    {
+        SalesBucket* lowest;
+        SalesBucket* highest;
+        int size, buckets_num;
+        /*where the last removed model was, to start its re-insert from*/
+        SalesBucket* hint;
+        CarModel* hint_model;
+
+        void unlinkBucket(SalesBucket* bucket);
+
+        public:
+            SalesFrequencyList();
+            ~SalesFrequencyList();
+            SalesFrequencyList(const SalesFrequencyList&) = delete;
+            SalesFrequencyList& operator=(const SalesFrequencyList&) = delete;
+            void insertNode(AvlTreeNode<CarModel*>* hook);
+            void removeNode(AvlTreeNode<CarModel*>* hook);
+            /*AvlTree::removeNodesIf on every bucket, empty buckets are dropped*/
+            template<typename Pred>
+            void removeNodesIf(Pred pred)
+            {
+                hint_model = nullptr;
+                SalesBucket* bucket = lowest;
+                while(bucket)
+                {
+                    SalesBucket* next = bucket->next;
+                    size -= bucket->getModels().getSize();
+                    bucket->getModels().removeNodesIf(pred);
+                    size += bucket->getModels().getSize();
+                    if(bucket->getModels().getSize() == 0)
+                        unlinkBucket(bucket);
+                    bucket = next;
+                }
+            }
+            /*for models removed for good, so the next insert doesn't start from their bucket*/
+            void forgetHint();
+            CarModel** tryGetOldest();
+            int getSize();
+            /*the number of buckets, as deep as the list goes*/
+            int getHeight();
+    };
+
+    typedef SalesFrequencyList SalesIndex;
+#else
+    typedef AvlTree<CarModel*, CompModelSailes, DefaultBalance, false> SalesIndex;
+#endif
+
+#ifdef WET1_SCORE_BUCKETS
+    typedef ScoreBucketIndex ScoreTier;
+#else
+    typedef AvlTree<CarModel*, CompModelScore, DefaultBalance, false> ScoreTier;
+#endif
+
     class CarType
     {
         int typeId, models_num;
-        CarModel* best_seller_model;
-        CarModel** models; //array of models
+        CarModel* best_seller_model; //nullptr in a cold type - model 0, nothing was sold
+        CarModel* models; //the type's models, one contiguous block - nullptr when cold
+        /*a cold type's models that have sales or a score, by model number*/
+        CarModel* kept;
+        int kept_num;
+        /*CLOCK ring of the types that have their block, see CarDealershipManager*/
+        bool referenced;
+        CarType* clock_prev;
+        CarType* clock_next;
         /*zeros tree*/
-        AvlTree<CarModel*, CompModelNum>* zero_score_modelIds;//zero score models tree
+        AvlTree<CarModel*, CompModelNum, DefaultBalance, false>* zero_score_modelIds;//zero score models tree
+        /*the other models, by score - with the zero tree, the type's own worst list*/
+        AvlTree<CarModel*, CompModelScore, DefaultBalance, false> nonzero_score_models;
 
         /**
-         * Scan models tree from base up and feels the given
+         * Scan models tree from base on, in order, and feels the given
          * models and types arrays
         */
         void efficiantInorder(AvlTreeNode<CarModel*>* base,
-             int& amount, int& index, int* types, int* models);
-        /**
-         * Scan models tree by inOrder and feels the given
-         * models and types arrays
-        */
-        void inOrder(AvlTreeNode<CarModel*>* root,
-             int& amount, int& index, int* types, int* models);
+             int& amount, int& index, int* types, int* models, int* scores);
 
         public:
-            CarType(int id, int numOfModels);
+            /*big types are built on pool, if there is one*/
+            CarType(int id, int numOfModels, ThreadPool* pool = nullptr);
             /*ctor for dummy CarType that will only hold typeID, used for searching*/
             explicit CarType(int id);
             ~CarType();
+            /*resident types only*/
             CarModel* getModelByNum(int modelNum);
             int getId();
             int getNumOfModels();
+            /*resident types only*/
             CarModel* getBestSeller();
+            int getBestSellerNum();
             void setBestSeller(CarModel* new_best_seller);
+            /**
+             * Tiering. A cold type keeps only its models that have sales or a
+             * score - the ones linked into the manager's trees. The others are
+             * all in their initial state, so they are dropped with the block
+             * and the zero tree and made again by pageIn. move(from, to) relinks
+             * a kept model's hooks to its new copy.
+             */
+            bool isResident();
+            long long getBlockBytes();
+            /*false if that would not save memory or the kept array can't be had*/
+            bool evict(const std::function<void(CarModel*, CarModel*)>& move);
+            /*throws bad_alloc, then nothing changed*/
+            void pageIn(const std::function<void(CarModel*, CarModel*)>& move);
+            /*every model while resident, the kept ones when cold*/
+            int getStoredNum();
+            CarModel* getStoredModel(int i);
+            /*nullptr for a cold type's model in its initial state*/
+            CarModel* findStoredModel(int modelNum);
+            bool isReferenced();
+            void setReferenced(bool value);
+            /*links before hand, or makes a ring of its own*/
+            void linkClock(CarType* hand);
+            void unlinkClock();
+            CarType* getClockNext();
             void addToZeroTree(CarModel* model);
             void removeFromZeroTree(CarModel* model);
-            void insertZeroScoreModels(int& amount, int& index, int* types, int* models_nums);
+            /*for models with a nonzero score*/
+            void addToScoreIndex(CarModel* model);
+            void removeFromScoreIndex(CarModel* model);
+            /*the type's numOfModels worst models, numOfModels <= getNumOfModels()*/
+            void getWorstModels(int numOfModels, int* model_nums);
+            void insertZeroScoreModels(int& amount, int& index, int* types, int* models_nums, int* scores);
+            /*the type's zero score models, by model number*/
+            AvlTree<CarModel*, CompModelNum, DefaultBalance, false>& getZeroScoreModels();
     };
 
     /**
@@ -108,35 +327,136 @@ namespace wet1
     {
         private:
             AvlTree<CarType*, CompTypeId> carTypes;
-            AvlTree<CarModel*, CompModelSailes> modelSales;
-            AvlTree<CarModel*, CompModelScore> PosModelScores;
-            AvlTree<CarModel*, CompModelScore> NegModelScores;
+            /*intrusive - linked through the models' hooks*/
+            /*sales tree, or a frequency list with WET1_SALES_FREQ_LIST*/
+            SalesIndex modelSales;
+            /*score trees, or score bucket indexes with WET1_SCORE_BUCKETS*/
+            ScoreTier PosModelScores;
+            ScoreTier NegModelScores;
             int types_num, num_of_models;
             
             /**The same function as in CarType
              * used to scan PosScore and NegScore trees
             */
             void efficiantInorder(AvlTreeNode<CarModel*>* base,
-             int& amount, int& index, int* types, int* models);
+             int& amount, int& index, int* types, int* models, int* scores);
 
-            /*Same as in CarType*/
-            void inOrder(AvlTreeNode<CarModel*>* root,
-             int& amount, int& index, int* types, int* models);
+            /*efficiantInorder over a whole score tier*/
+            void tierInorder(ScoreTier& tier,
+             int& amount, int& index, int* types, int* models, int* scores);
 
             /**
-             * Scan carTypes tree from base up and feels the given
+             * Scan carTypes tree from base on, in order, and feels the given
              * models and types arrays
              * calls CarType.efficiantInOrder() func for each type
              */
             void efficiantInorderZeroScores(AvlTreeNode<CarType*>* base,
-             int& amount, int& index, int* types, int* models);
+             int& amount, int& index, int* types, int* models, int* scores);
 
-            /*regular inOrder used by efficiantInorderZeroScores*/
-            void inOrderZeroScores(AvlTreeNode<CarType*>* root,
-             int& amount, int& index, int* types, int* mode);
+            /*looks up a type without throwing on a miss*/
+            CarType* findCarType(int typeId);
+            /*findCarType for n ids at once, with interleaved descents*/
+            void findCarTypes(const int* typeIds, int n, CarType** types);
 
              /*deletes all carTypes*/
-            void deleteCarTypes(AvlTreeNode<CarType*>* root);
+            void deleteCarTypes();
+
+            /*moves a model out of / into the score tier matching its current score*/
+            void removeFromScoreTier(CarType* car_type, CarModel* model);
+            void addToScoreTier(CarType* car_type, CarModel* model);
+
+            /*models of a tier with a score below bound, or at most bound if inclusive*/
+            int tierCountBelow(ScoreTier& tier, int bound, bool inclusive);
+            /*visits the tier's models with lo <= score <= hi, false if the visitor stopped*/
+            bool tierEnumerate(ScoreTier& tier, int lo, int hi, ModelVisitor visitor, void* context);
+            bool visitModels(AvlTreeNode<CarModel*>* node, int hi, ModelVisitor visitor, void* context);
+            /*visits a cold type's zero score models without paging it in*/
+            bool visitColdZeros(CarType* car_type, ModelVisitor visitor, void* context);
+
+            /*writes the numOfModels worst models to the given arrays*/
+            void fillWorstModels(int numOfModels, int* types, int* models, int* scores);
+
+            /**
+             * Parallel fillWorstModels for big results. Each tier's part of the
+             * result is cut into ranges with known output offsets, the first
+             * model of each range is located by rank (subtree sizes), and the
+             * pool fills the ranges at the same time.
+             */
+            typedef enum {
+                WORST_NEG,
+                WORST_ZERO,
+                WORST_POS,
+            } WorstTier;
+            struct WorstRange
+            {
+                WorstTier tier;
+                int index, count; //output offset and length
+                AvlTreeNode<CarModel*>* model; //first model of the range
+                AvlTreeNode<CarType*>* type; //its type, zero tier only
+#ifdef WET1_SCORE_BUCKETS
+                AvlTreeNode<ScoreBucket*>* bucket; //its score bucket
+#endif
+            };
+            /*nullptr on a single core machine*/
+            ThreadPool* workPool();
+            void fillWorstModelsParallel(int numOfModels, int* types, int* models, int* scores);
+            /*adds the ranges of count models of a tier from rank 0, written from index on*/
+            void addTierRanges(ScoreTier& tier, WorstTier tier_id, int index, int count, int chunk,
+             WorstRange* ranges, int& ranges_num);
+            void addZeroRanges(int index, int count, int chunk, WorstRange* ranges, int& ranges_num);
+            void fillWorstRange(WorstRange& range, int* types, int* models, int* scores);
+
+            /**
+             * Worst models cache - holds the worst_cache_size worst models and the
+             * (score, type, model) key of the last one. A change invalidates the
+             * cache only if the model's old or new key is at or before that bound.
+             */
+            int worst_cache_size;
+            bool worst_cache_valid;
+            int* worst_cache_types;
+            int* worst_cache_models;
+            int cache_bound_score, cache_bound_type, cache_bound_model;
+            void fillWorstCache();
+            bool isBeforeWorstCacheBound(int score, int type, int model);
+            void updateWorstCache(int old_score, CarModel* model);
+            bool worstCacheHoldsType(int typeId);
+
+            /*fork join pool for big GetWorstModels results and AddCarType calls, made on first use*/
+            ThreadPool* work_pool;
+            bool work_pool_checked;
+            int work_threads; //0 - one per hardware thread
+
+            OperationStats operation_stats;
+
+            /*spans of the operations and their phases, nullptr while tracing is off*/
+            TraceBuffer* trace;
+            char* trace_path; //DumpTrace(nullptr) writes here
+
+            /**
+             * Tiering - the model blocks of resident types are kept within
+             * model_budget bytes (0 - no limit) by making types cold, see
+             * CarType::evict. Lookups set a type's referenced bit and the
+             * CLOCK hand gives referenced types a second chance. Anything that
+             * needs a cold type's models pages it in first - but
+             * EnumerateModelsInScoreRange, which can't fail once the visitor
+             * has run, reads a cold type's zero scores off its kept models.
+             * The budget is enforced when an operation ends, so pages in
+             * can't pull a type out from under a walk.
+             */
+            long long model_budget;
+            long long resident_bytes;
+            int resident_types_num, cold_types_num;
+            CarType* clock_hand;
+            /*relinks the hooks of a model that moves between a block and a kept array*/
+            void moveModel(CarType* car_type, CarModel* from, CarModel* to);
+            /*false if there was no memory for it*/
+            bool makeResident(CarType* car_type);
+            bool makeCold(CarType* car_type);
+            void enforceBudget();
+            void clockInsert(CarType* car_type);
+            void clockRemove(CarType* car_type);
+            /*pages in the types, in order, that hold the first `needed` zero score models*/
+            bool pageInZeroTypes(long long needed);
         public:
             CarDealershipManager();
             ~CarDealershipManager();
@@ -145,7 +465,53 @@ namespace wet1
             StatusType SellCar (int typeId, int modelId);
             StatusType MakeComplaint (int typeId, int modelId, int t);
             StatusType GetBestSellerModelByType (int typeId, int* modelId);
+            /*n GetBestSellerModelByType calls, results[i] is the status of the i-th*/
+            StatusType GetBestSellerModelByTypeBatch (int n, const int* typeIds, int* modelIds, StatusType* results);
             StatusType GetWorstModels (int numOfModels, int* types, int* models);
+            /*score range queries, lo <= score <= hi*/
+            StatusType CountModelsInScoreRange (int lo, int hi, int* count);
+            StatusType EnumerateModelsInScoreRange (int lo, int hi, ModelVisitor visitor, void* context);
+            /*the numOfModels worst models of one type, O(log(m) + numOfModels)*/
+            StatusType GetWorstModelsByType (int typeId, int numOfModels, int* models);
+            /**
+             * applies `sales` sales and complaints summing to score_delta to one
+             * model, moving it in the trees once. Same as the matching SellCar
+             * and MakeComplaint calls in any order.
+             */
+            StatusType ApplyModelDelta (int typeId, int modelId, int sales, int score_delta);
+            /**
+             * moves up to budget nodes of the trees that own their nodes
+             * (carTypes, and the score buckets) into a van Emde Boas layout,
+             * see AvlTree::compactStep. *done once they are all laid out.
+             * ALLOCATION_ERROR, not done, if a pass could not get its memory.
+             */
+            StatusType CompactStep (int budget, bool* done);
+            /*0 disables the worst models cache*/
+            StatusType SetWorstModelsCacheSize (int cacheSize);
+            /*bytes of model blocks to keep in memory, 0 for no limit*/
+            StatusType SetModelMemoryBudget (long long bytes);
+            /*threads splitting the big calls, 0 for one per hardware thread, 1 for none*/
+            StatusType SetWorkThreads (int threads);
+
+            /*timed by the library.h wrappers*/
+            OperationStats& getOperationStats();
+            StatusType GetStats (DealershipStats* stats);
+            /**
+             * starts recording the last capacity spans, dropping any earlier
+             * ones - 0 stops tracing. trees adds a span per tree rebalance.
+             * path (may be nullptr) is where DumpTrace(nullptr) writes.
+             */
+            StatusType EnableTracing (int capacity, bool trees, const char* path);
+            /*writes the recorded spans as Chrome trace JSON*/
+            StatusType DumpTrace (const char* path);
+
+            /*used by ShardedCarDealershipManager to merge the shards results*/
+            int getTypesNum();
+            int getModelsNum();
+            /*the global best seller's sales, type and model, FAILURE if nothing was sold*/
+            StatusType GetTopSeller (int* sales, int* typeId, int* modelId);
+            /*GetWorstModels that also reports the score of each model*/
+            StatusType GetWorstModelsWithScores (int numOfModels, int* types, int* models, int* scores);
     };
 
 }
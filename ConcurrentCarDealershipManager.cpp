@@ -0,0 +1,184 @@
+#include "ConcurrentCarDealershipManager.h"
+
+#define INITIAL_TABLE_CAPACITY 64
+
+using namespace wet1;
+
+ConcurrentCarDealershipManager::ConcurrentCarDealershipManager() : manager(),
+ table(newTable(INITIAL_TABLE_CAPACITY)), global_best_seller(), reclaimer()
+{}
+
+ConcurrentCarDealershipManager::~ConcurrentCarDealershipManager()
+{
+    deleteTable(table.load());
+}
+
+ConcurrentCarDealershipManager::BestSellerTable* ConcurrentCarDealershipManager::newTable(int capacity)
+{
+    BestSellerTable* new_table = new BestSellerTable;
+    new_table->capacity = capacity;
+    new_table->used = 0;
+    new_table->slots = new BestSellerSlot[capacity];
+    for (int i = 0; i < capacity; i++)
+    {
+        new_table->slots[i].typeId.store(0, std::memory_order_relaxed);
+        new_table->slots[i].modelId.store(NO_TYPE, std::memory_order_relaxed);
+    }
+    return new_table;
+}
+
+void ConcurrentCarDealershipManager::deleteTable(void* table)
+{
+    BestSellerTable* to_delete = (BestSellerTable*)table;
+    delete[] to_delete->slots;
+    delete to_delete;
+}
+
+/**
+ * returns the slot of typeId, or the empty slot that ends its probe sequence
+ * (capacity is a power of 2 and the table is never more than half used)
+ */
+ConcurrentCarDealershipManager::BestSellerSlot* ConcurrentCarDealershipManager::findSlot(
+    BestSellerTable* table, int typeId)
+{
+    unsigned mask = table->capacity - 1;
+    unsigned index = ((unsigned)typeId * 2654435761u) & mask;
+    while(true)
+    {
+        BestSellerSlot* slot = &table->slots[index];
+        int slot_type = slot->typeId.load(std::memory_order_acquire);
+        if(slot_type == typeId || slot_type == 0)
+            return slot;
+        index = (index + 1) & mask;
+    }
+}
+
+void ConcurrentCarDealershipManager::publishType(int typeId, int modelId)
+{
+    BestSellerTable* current = table.load(std::memory_order_relaxed);
+    BestSellerSlot* slot = findSlot(current, typeId);
+    if(slot->typeId.load(std::memory_order_relaxed) == typeId)
+    {
+        slot->modelId.store(modelId, std::memory_order_release);
+        return;
+    }
+    if(modelId == NO_TYPE)
+        return;
+    if(2 * (current->used + 1) > current->capacity)
+    {
+        /*rehash the live types into a bigger table, readers move over on their next read*/
+        BestSellerTable* grown = newTable(current->capacity * 2);
+        for (int i = 0; i < current->capacity; i++)
+        {
+            int type = current->slots[i].typeId.load(std::memory_order_relaxed);
+            int model = current->slots[i].modelId.load(std::memory_order_relaxed);
+            if(type == 0 || model == NO_TYPE)
+                continue;
+            BestSellerSlot* moved = findSlot(grown, type);
+            moved->modelId.store(model, std::memory_order_relaxed);
+            moved->typeId.store(type, std::memory_order_relaxed);
+            grown->used++;
+        }
+        table.store(grown);
+        reclaimer.retire(current, deleteTable);
+        current = grown;
+        slot = findSlot(current, typeId);
+    }
+    slot->modelId.store(modelId, std::memory_order_relaxed);
+    slot->typeId.store(typeId, std::memory_order_release);
+    current->used++;
+}
+
+void ConcurrentCarDealershipManager::publishGlobal()
+{
+    int values[2];
+    values[GLOBAL_TYPES_NUM] = manager.getTypesNum();
+    values[GLOBAL_BEST_SELLER] = 0;
+    manager.GetBestSellerModelByType(0, &values[GLOBAL_BEST_SELLER]);
+    global_best_seller.write(values);
+}
+
+StatusType ConcurrentCarDealershipManager::AddCarType(int typeId, int numOfModels)
+{
+    std::lock_guard<std::mutex> guard(writer_lock);
+    StatusType res = manager.AddCarType(typeId, numOfModels);
+    if(res == SUCCESS)
+    {
+        publishType(typeId, 0);
+        publishGlobal();
+    }
+    reclaimer.reclaim();
+    return res;
+}
+
+StatusType ConcurrentCarDealershipManager::RemoveCarType(int typeId)
+{
+    std::lock_guard<std::mutex> guard(writer_lock);
+    StatusType res = manager.RemoveCarType(typeId);
+    if(res == SUCCESS)
+    {
+        publishType(typeId, NO_TYPE);
+        publishGlobal();
+    }
+    reclaimer.reclaim();
+    return res;
+}
+
+StatusType ConcurrentCarDealershipManager::SellCar(int typeId, int modelId)
+{
+    std::lock_guard<std::mutex> guard(writer_lock);
+    StatusType res = manager.SellCar(typeId, modelId);
+    if(res == SUCCESS)
+    {
+        int best_seller = 0;
+        manager.GetBestSellerModelByType(typeId, &best_seller);
+        publishType(typeId, best_seller);
+        publishGlobal();
+    }
+    return res;
+}
+
+StatusType ConcurrentCarDealershipManager::MakeComplaint(int typeId, int modelId, int t)
+{
+    /*complaints change scores only, nothing to publish*/
+    std::lock_guard<std::mutex> guard(writer_lock);
+    return manager.MakeComplaint(typeId, modelId, t);
+}
+
+StatusType ConcurrentCarDealershipManager::GetWorstModels(int numOfModels, int* types, int* models)
+{
+    std::lock_guard<std::mutex> guard(writer_lock);
+    return manager.GetWorstModels(numOfModels, types, models);
+}
+
+StatusType ConcurrentCarDealershipManager::lockedBestSeller(int typeId, int* modelId)
+{
+    std::lock_guard<std::mutex> guard(writer_lock);
+    return manager.GetBestSellerModelByType(typeId, modelId);
+}
+
+StatusType ConcurrentCarDealershipManager::GetBestSellerModelByType(int typeId, int* modelId)
+{
+    if(typeId < 0)
+        return INVALID_INPUT;
+    if(typeId == 0)
+    {
+        int values[2];
+        global_best_seller.read(values);
+        if(values[GLOBAL_TYPES_NUM] == 0)
+            return FAILURE;
+        *modelId = values[GLOBAL_BEST_SELLER];
+        return SUCCESS;
+    }
+    if(!reclaimer.enter())
+        return lockedBestSeller(typeId, modelId);
+    BestSellerSlot* slot = findSlot(table.load(), typeId);
+    int model = NO_TYPE;
+    if(slot->typeId.load(std::memory_order_acquire) == typeId)
+        model = slot->modelId.load(std::memory_order_acquire);
+    reclaimer.exit();
+    if(model == NO_TYPE)
+        return FAILURE;
+    *modelId = model;
+    return SUCCESS;
+}
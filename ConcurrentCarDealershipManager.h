@@ -0,0 +1,67 @@
+#ifndef CONCURRENT_CAR_DEALER
+#define CONCURRENT_CAR_DEALER
+
+#include <atomic>
+#include <mutex>
+#include "CarDealershipManager.h"
+#include "EpochReclaimer.h"
+#include "SeqLock.h"
+
+namespace wet1
+{
+    /**
+     * One writer at a time applies mutations to a CarDealershipManager.
+     * After each mutation the writer publishes the best sellers it changed:
+     * the global one (and the number of types) through a seqlock and the per
+     * type ones in an open addressing table of atomics.
+     * GetBestSellerModelByType readers never take the writer lock - they read
+     * the published values, so a long RemoveCarType does not block them.
+     * Tables replaced on growth are freed by epoch based reclamation.
+     */
+    class ConcurrentCarDealershipManager
+    {
+        private:
+            struct BestSellerSlot
+            {
+                std::atomic<int> typeId; //0 - empty slot
+                std::atomic<int> modelId; //NO_TYPE after the type was removed
+            };
+            struct BestSellerTable
+            {
+                int capacity;
+                int used; //live and removed slots, writer only
+                BestSellerSlot* slots;
+            };
+            static const int NO_TYPE = -1;
+            static const int GLOBAL_TYPES_NUM = 0;
+            static const int GLOBAL_BEST_SELLER = 1;
+
+            CarDealershipManager manager;
+            std::mutex writer_lock;
+            std::atomic<BestSellerTable*> table;
+            SeqLock<2> global_best_seller;
+            EpochReclaimer reclaimer;
+
+            static BestSellerTable* newTable(int capacity);
+            static void deleteTable(void* table);
+            static BestSellerSlot* findSlot(BestSellerTable* table, int typeId);
+            void publishType(int typeId, int modelId);
+            void publishGlobal();
+            StatusType lockedBestSeller(int typeId, int* modelId);
+
+        public:
+            ConcurrentCarDealershipManager();
+            ~ConcurrentCarDealershipManager();
+            ConcurrentCarDealershipManager(const ConcurrentCarDealershipManager&) = delete;
+            ConcurrentCarDealershipManager& operator=(const ConcurrentCarDealershipManager&) = delete;
+            /*writer side - serialized*/
+            StatusType AddCarType (int typeId, int numOfModels);
+            StatusType RemoveCarType (int typeId);
+            StatusType SellCar (int typeId, int modelId);
+            StatusType MakeComplaint (int typeId, int modelId, int t);
+            StatusType GetWorstModels (int numOfModels, int* types, int* models);
+            /*reader side - lock free*/
+            StatusType GetBestSellerModelByType (int typeId, int* modelId);
+    };
+}
+#endif
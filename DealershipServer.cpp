@@ -0,0 +1,353 @@
+#include "DealershipServer.h"
+#include "BinaryProtocol.h"
+#include <errno.h>
+#include <stdint.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace wet1;
+
+static const int MAX_EVENTS = 64;
+static const size_t READ_CHUNK = 64 * 1024;
+/*requests buffered per connection - a longer line or record closes it*/
+static const size_t MAX_INPUT = 16 << 20;
+/*a connection with this much unsent output is not read or executed until it drains*/
+static const size_t OUTPUT_HIGH_WATER = 4 << 20;
+/*after this long without requests the trees are compacted, a slice at a time*/
+static const int IDLE_COMPACT_MS = 50;
+static const int COMPACT_SLICE = 4096;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void onStopSignal(int)
+{
+    stop_requested = 1;
+}
+
+typedef enum {
+    PROTOCOL_UNKNOWN,
+    PROTOCOL_TEXT,
+    PROTOCOL_BINARY
+} ProtocolType;
+
+struct DealershipServer::Connection
+{
+    int fd;
+    ProtocolType protocol;
+    char* input;
+    size_t input_size, input_capacity;
+    OutputBuffer output;
+    bool eof; //the client closed its side (or reading failed)
+    bool closing; //Quit or an unknown command - close once output is sent
+    bool paused; //stopped executing at the output high water mark
+    unsigned events; //registered with epoll
+
+    explicit Connection(int fd) : fd(fd), protocol(PROTOCOL_UNKNOWN), input(nullptr),
+     input_size(0), input_capacity(0), output(-1, READ_CHUNK), eof(false), closing(false),
+     paused(false), events(EPOLLIN | EPOLLRDHUP)
+    {}
+    ~Connection()
+    {
+        free(input);
+    }
+};
+
+DealershipServer::DealershipServer() : listen_fd(-1), epoll_fd(-1), socket_path(nullptr)
+{
+    Command init = { CMD_INIT, true, { 0, 0, 0 }, nullptr, 0 };
+    CommandResult result;
+    executor.execute(init, result);
+}
+
+DealershipServer::~DealershipServer()
+{
+    if(listen_fd >= 0)
+    {
+        close(listen_fd);
+        unlink(socket_path);
+    }
+    if(epoll_fd >= 0)
+        close(epoll_fd);
+}
+
+bool DealershipServer::listen(const char* path)
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(address.sun_path))
+        return false;
+    strcpy(address.sun_path, path);
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(listen_fd < 0)
+        return false;
+    unlink(path);
+    if(bind(listen_fd, (sockaddr*)&address, sizeof(address)) < 0 ||
+        ::listen(listen_fd, SOMAXCONN) < 0)
+    {
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    socket_path = path;
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(epoll_fd < 0)
+        return false;
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr; //the listening socket
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) == 0;
+}
+
+void DealershipServer::acceptClients()
+{
+    while(true)
+    {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0)
+            return;
+        Connection* connection = new Connection(fd);
+        epoll_event event;
+        event.events = connection->events;
+        event.data.ptr = connection;
+        if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+        {
+            close(fd);
+            delete connection;
+        }
+    }
+}
+
+bool DealershipServer::readRequests(Connection* connection)
+{
+    /*once full, the rest waits in the socket until these requests ran*/
+    while(connection->input_size < MAX_INPUT)
+    {
+        if(connection->input_capacity - connection->input_size < READ_CHUNK &&
+            connection->input_capacity < MAX_INPUT)
+        {
+            size_t capacity = connection->input_capacity * 2;
+            if(capacity < connection->input_size + READ_CHUNK)
+                capacity = connection->input_size + READ_CHUNK;
+            if(capacity > MAX_INPUT)
+                capacity = MAX_INPUT;
+            char* grown = (char*)realloc(connection->input, capacity);
+            if(!grown)
+                return false;
+            connection->input = grown;
+            connection->input_capacity = capacity;
+        }
+        ssize_t res = read(connection->fd, connection->input + connection->input_size,
+            connection->input_capacity - connection->input_size);
+        if(res > 0)
+        {
+            connection->input_size += res;
+            continue;
+        }
+        if(res == 0)
+            return false; //client closed its side
+        if(errno == EINTR)
+            continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    return true;
+}
+
+void DealershipServer::executeRequests(Connection* connection)
+{
+    connection->paused = false;
+    if(connection->closing)
+        return;
+    if(connection->input_size == 0)
+    {
+        connection->closing = connection->eof;
+        return;
+    }
+    const char* begin = connection->input;
+    const char* end = begin + connection->input_size;
+    if(connection->protocol == PROTOCOL_UNKNOWN)
+    {
+        unsigned char first = (unsigned char)begin[0];
+        connection->protocol = first <= CMD_STATS || first == RECORD_COMMENT ||
+            first == RECORD_NONE ? PROTOCOL_BINARY : PROTOCOL_TEXT;
+    }
+    Command command;
+    CommandResult result;
+    const char* cursor = begin;
+    if(connection->protocol == PROTOCOL_TEXT)
+    {
+        /*only whole lines, the rest waits for the next read (or the client's EOF)*/
+        const char* last_newline = (const char*)memrchr(begin, '\n', end - begin);
+        const char* lines_end = connection->eof ? end : last_newline ? last_newline + 1 : begin;
+        /*a line that doesn't fit in the input buffer will never be whole*/
+        if(lines_end == begin && connection->input_size >= MAX_INPUT)
+            connection->closing = true;
+        while(!connection->closing && connection->output.length() < OUTPUT_HIGH_WATER &&
+            parseCommand(cursor, lines_end, command))
+        {
+            if(command.kind == CMD_QUIT && command.valid)
+            {
+                result.status = SUCCESS;
+                connection->closing = true;
+            }
+            else
+            {
+                executor.execute(command, result);
+                connection->closing = result.stop;
+            }
+            formatResult(command, result, connection->output);
+        }
+    }
+    else
+    {
+        while(!connection->closing && connection->output.length() < OUTPUT_HIGH_WATER &&
+            end - cursor >= RECORD_SIZE)
+        {
+            int64_t size = commandRecordSize(cursor);
+            if(size > (int64_t)MAX_INPUT)
+            {
+                connection->closing = true; //a record that can never be buffered
+                break;
+            }
+            if(end - cursor < size)
+                break;
+            if(!decodeCommand(cursor, end, command))
+            {
+                connection->closing = true; //not a command record
+                break;
+            }
+            if(command.kind == CMD_QUIT && command.valid)
+            {
+                result.status = SUCCESS;
+                result.value = 0;
+                result.count = 0;
+                connection->closing = true;
+            }
+            else
+            {
+                executor.execute(command, result);
+                connection->closing = result.stop;
+            }
+            encodeResult(command, result, connection->output);
+        }
+    }
+    size_t left = end - cursor;
+    memmove(connection->input, cursor, left);
+    connection->input_size = left;
+    if(connection->closing)
+        return;
+    /*the rest runs once the output drains, what is left after eof is a partial record*/
+    connection->paused = left > 0 && connection->output.length() >= OUTPUT_HIGH_WATER;
+    if(connection->eof && !connection->paused)
+        connection->closing = true;
+}
+
+bool DealershipServer::writeResponses(Connection* connection)
+{
+    OutputBuffer& output = connection->output;
+    while(output.length() > 0)
+    {
+        ssize_t res = send(connection->fd, output.data(), output.length(), MSG_NOSIGNAL);
+        if(res > 0)
+        {
+            output.consume(res);
+            continue;
+        }
+        if(res < 0 && errno == EINTR)
+            continue;
+        if(res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        return false;
+    }
+    bool pending = output.length() > 0;
+    /*a closing connection only waits to send what is left, a full one for its output to drain*/
+    bool reading = !connection->closing && !connection->eof && !connection->paused &&
+        output.length() < OUTPUT_HIGH_WATER && connection->input_size < MAX_INPUT;
+    unsigned events = (reading ? EPOLLIN | EPOLLRDHUP : 0) | (pending ? EPOLLOUT : 0);
+    if(events != connection->events)
+    {
+        epoll_event event;
+        event.events = events;
+        event.data.ptr = connection;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+        connection->events = events;
+    }
+    return pending || !connection->closing;
+}
+
+void DealershipServer::closeConnection(Connection* connection)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection->fd, nullptr);
+    close(connection->fd);
+    delete connection;
+}
+
+int DealershipServer::run()
+{
+    epoll_event events[MAX_EVENTS];
+    bool compact_pending = true;
+    while(!stop_requested)
+    {
+        int ready = epoll_wait(epoll_fd, events, MAX_EVENTS, compact_pending ? IDLE_COMPACT_MS : -1);
+        if(ready < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return 1;
+        }
+        if(ready == 0)
+        {
+            compact_pending = !executor.compact(COMPACT_SLICE);
+            continue;
+        }
+        for (int i = 0; i < ready; i++)
+        {
+            Connection* connection = (Connection*)events[i].data.ptr;
+            if(!connection)
+            {
+                acceptClients();
+                continue;
+            }
+            if(!connection->closing && !connection->eof &&
+                (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+            {
+                /*a client that closed its side still gets its responses*/
+                connection->eof = !readRequests(connection);
+                compact_pending = true;
+            }
+            executeRequests(connection);
+            bool open = writeResponses(connection);
+            /*output that drained at once lets paused requests go on*/
+            while(open && connection->paused && connection->output.length() < OUTPUT_HIGH_WATER)
+            {
+                executeRequests(connection);
+                open = writeResponses(connection);
+            }
+            if(!open)
+                closeConnection(connection);
+        }
+    }
+    return 0;
+}
+
+int wet1::runServer(const char* path)
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onStopSignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    DealershipServer server;
+    if(!server.listen(path))
+    {
+        fprintf(stderr, "can't listen on %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    return server.run();
+}
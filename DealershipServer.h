@@ -0,0 +1,49 @@
+#ifndef DEALERSHIP_SERVER_H
+#define DEALERSHIP_SERVER_H
+
+#include "FastDriver.h"
+
+namespace wet1
+{
+    /**
+     * Hosts one data structure behind a Unix-domain socket. All clients share
+     * it; the server runs Init itself, so a client's Init gets
+     * "init was already called." and its Quit only ends its own connection.
+     *
+     * Each connection speaks the text shell protocol or the binary records of
+     * BinaryProtocol.h, told apart by its first byte. Clients may pipeline
+     * requests - everything that arrived in one read is executed in order and
+     * the responses are sent back with one write. A connection buffers a
+     * bounded amount of requests, and one whose client doesn't read its
+     * responses is neither read nor executed until they drain.
+     */
+    class DealershipServer
+    {
+        struct Connection;
+
+        int listen_fd, epoll_fd;
+        const char* socket_path;
+        CommandExecutor executor;
+
+        void acceptClients();
+        /*returns false once the connection should be closed*/
+        bool readRequests(Connection* connection);
+        /*after eof (the client closed its side) a last line without a newline runs too*/
+        void executeRequests(Connection* connection);
+        bool writeResponses(Connection* connection);
+        void closeConnection(Connection* connection);
+
+        public:
+            DealershipServer();
+            ~DealershipServer();
+            DealershipServer(const DealershipServer&) = delete;
+            DealershipServer& operator=(const DealershipServer&) = delete;
+            /*binds path, replacing a stale socket file*/
+            bool listen(const char* path);
+            /*serves clients until SIGINT / SIGTERM*/
+            int run();
+    };
+
+    int runServer(const char* path);
+}
+#endif
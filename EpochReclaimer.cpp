@@ -0,0 +1,88 @@
+#include "EpochReclaimer.h"
+
+using namespace wet1;
+
+/*the slot this thread pinned last, tried first on the next enter()*/
+static thread_local int slot_hint = -1;
+
+EpochReclaimer::EpochReclaimer() : global_epoch(1), retired(nullptr)
+{
+    for (int i = 0; i < MAX_READERS; i++)
+    {
+        slots[i].state.store(0);
+    }
+}
+
+EpochReclaimer::~EpochReclaimer()
+{
+    while(retired)
+    {
+        Retired* next = retired->next;
+        retired->deleter(retired->object);
+        delete retired;
+        retired = next;
+    }
+}
+
+bool EpochReclaimer::enter()
+{
+    unsigned long epoch = global_epoch.load();
+    int start = slot_hint >= 0 ? slot_hint : 0;
+    for (int i = 0; i < MAX_READERS; i++)
+    {
+        int slot = (start + i) % MAX_READERS;
+        unsigned long expected = 0;
+        if(slots[slot].state.compare_exchange_strong(expected, epoch))
+        {
+            slot_hint = slot;
+            return true;
+        }
+    }
+    return false;
+}
+
+void EpochReclaimer::exit()
+{
+    slots[slot_hint].state.store(0, std::memory_order_release);
+}
+
+void EpochReclaimer::retire(void* object, Deleter deleter)
+{
+    Retired* node = new Retired;
+    node->object = object;
+    node->deleter = deleter;
+    node->epoch = global_epoch.fetch_add(1);
+    std::lock_guard<std::mutex> guard(retired_lock);
+    node->next = retired;
+    retired = node;
+}
+
+void EpochReclaimer::reclaim()
+{
+    std::lock_guard<std::mutex> guard(retired_lock);
+    if(!retired)
+        return;
+    /*oldest epoch still pinned by a reader*/
+    unsigned long min_pinned = global_epoch.load();
+    for (int i = 0; i < MAX_READERS; i++)
+    {
+        unsigned long pinned = slots[i].state.load();
+        if(pinned != 0 && pinned < min_pinned)
+            min_pinned = pinned;
+    }
+    Retired** link = &retired;
+    while(*link)
+    {
+        Retired* node = *link;
+        if(node->epoch < min_pinned)
+        {
+            *link = node->next;
+            node->deleter(node->object);
+            delete node;
+        }
+        else
+        {
+            link = &node->next;
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef EPOCH_RECLAIMER_H
+#define EPOCH_RECLAIMER_H
+
+#include <atomic>
+#include <mutex>
+
+namespace wet1
+{
+    /**
+     * Epoch based reclamation for objects unlinked by a single writer while
+     * lock free readers may still hold them.
+     * A reader pins the current epoch in a free slot for the length of a read
+     * (each thread first tries the slot it used last time, so slots are not
+     * shared in the common case). A retired object is freed once every pinned
+     * slot has moved past the epoch in which it was retired.
+     * With more than MAX_READERS concurrent reads enter() returns false and
+     * the caller has to fall back to a locked read.
+     */
+    class EpochReclaimer
+    {
+        public:
+            static const int MAX_READERS = 64;
+            typedef void (*Deleter)(void*);
+
+            EpochReclaimer();
+            ~EpochReclaimer();
+            EpochReclaimer(const EpochReclaimer&) = delete;
+            EpochReclaimer& operator=(const EpochReclaimer&) = delete;
+
+            /*reader side*/
+            bool enter();
+            void exit();
+
+            /*writer side*/
+            void retire(void* object, Deleter deleter);
+            void reclaim();
+
+        private:
+            struct alignas(64) ReaderSlot
+            {
+                /*0 - free, otherwise the pinned epoch*/
+                std::atomic<unsigned long> state;
+            };
+            struct Retired
+            {
+                void* object;
+                Deleter deleter;
+                unsigned long epoch;
+                Retired* next;
+            };
+            ReaderSlot slots[MAX_READERS];
+            std::atomic<unsigned long> global_epoch;
+            std::mutex retired_lock;
+            Retired* retired;
+    };
+}
+#endif //EPOCH_RECLAIMER_H
@@ -0,0 +1,640 @@
+#include "FastDriver.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace wet1;
+
+static const char* const command_names[] = {
+        "Init",
+        "AddCarType",
+        "RemoveCarType",
+        "SellCar",
+        "MakeComplaint",
+        "GetBestSellerModelByType",
+        "GetWorstModels",
+        "Quit",
+        "Stats" };
+static const int command_names_len[] = { 4, 10, 13, 7, 13, 24, 14, 4, 5 };
+static const int command_args_num[] = { 0, 2, 1, 2, 3, 1, 1, 0, 0 };
+/*the shell fgets lines into 255 chars, so longer lines come as several*/
+static const size_t MAX_LINE_LEN = 254;
+
+static const char* returnValToStr(StatusType val)
+{
+    switch (val) {
+        case SUCCESS:
+            return "SUCCESS";
+        case ALLOCATION_ERROR:
+            return "ALLOCATION_ERROR";
+        case FAILURE:
+            return "FAILURE";
+        case INVALID_INPUT:
+            return "INVALID_INPUT";
+        default:
+            return "";
+    }
+}
+
+const char* wet1::commandName(CommandKind kind)
+{
+    return command_names[kind];
+}
+
+int wet1::commandArgsNum(CommandKind kind)
+{
+    return command_args_num[kind];
+}
+
+/**************************************************/
+/*OutputBuffer application*/
+
+OutputBuffer::OutputBuffer(int fd, size_t capacity) : buffer(nullptr), size(0),
+ capacity(capacity), fd(fd)
+{
+    buffer = new char[capacity];
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    flush();
+    delete[] buffer;
+}
+
+void OutputBuffer::reserve(size_t needed)
+{
+    size_t grown_capacity = capacity * 2 > needed ? capacity * 2 : needed;
+    char* grown = new char[grown_capacity];
+    memcpy(grown, buffer, size);
+    delete[] buffer;
+    buffer = grown;
+    capacity = grown_capacity;
+}
+
+void OutputBuffer::append(const char* str, size_t len)
+{
+    if(size + len > capacity)
+    {
+        flush();
+        /*bigger than the whole buffer, or nowhere to flush to - grow it*/
+        if(size + len > capacity)
+            reserve(size + len);
+    }
+    memcpy(buffer + size, str, len);
+    size += len;
+}
+
+void OutputBuffer::append(const char* str)
+{
+    append(str, strlen(str));
+}
+
+void OutputBuffer::appendChar(char c)
+{
+    if(size == capacity)
+    {
+        flush();
+        if(size == capacity)
+            reserve(size + 1);
+    }
+    buffer[size++] = c;
+}
+
+void OutputBuffer::appendInt(int value)
+{
+    char digits[12];
+    int pos = sizeof(digits);
+    unsigned magnitude = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+    do {
+        digits[--pos] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude);
+    if(value < 0)
+        digits[--pos] = '-';
+    append(digits + pos, sizeof(digits) - pos);
+}
+
+void OutputBuffer::flush()
+{
+    if(fd < 0)
+        return;
+    size_t written = 0;
+    while(written < size)
+    {
+        ssize_t res = write(fd, buffer + written, size - written);
+        if(res <= 0)
+            break;
+        written += res;
+    }
+    size = 0;
+}
+
+const char* OutputBuffer::data()
+{
+    return buffer;
+}
+
+size_t OutputBuffer::length()
+{
+    return size;
+}
+
+void OutputBuffer::clear()
+{
+    size = 0;
+}
+
+void OutputBuffer::consume(size_t len)
+{
+    if(len >= size)
+    {
+        size = 0;
+        return;
+    }
+    memmove(buffer, buffer + len, size - len);
+    size -= len;
+}
+
+/**************************************************/
+/*parsing*/
+
+static inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/*sscanf("%d") on [cursor, end)*/
+static bool parseInt(const char*& cursor, const char* end, int& value)
+{
+    while(cursor < end && isSpace(*cursor))
+        cursor++;
+    bool negative = false;
+    if(cursor < end && (*cursor == '-' || *cursor == '+'))
+    {
+        negative = *cursor == '-';
+        cursor++;
+    }
+    if(cursor == end || *cursor < '0' || *cursor > '9')
+        return false;
+    unsigned result = 0;
+    while(cursor < end && *cursor >= '0' && *cursor <= '9')
+    {
+        result = result * 10 + (*cursor - '0');
+        cursor++;
+    }
+    value = negative ? (int)(0u - result) : (int)result;
+    return true;
+}
+
+/*the command whose name prefixes the line, by first character*/
+static CommandKind matchCommand(const char* line, size_t len)
+{
+    CommandKind kind = CMD_NONE;
+    switch(line[0])
+    {
+        case 'I':
+            kind = CMD_INIT;
+            break;
+        case 'A':
+            kind = CMD_ADD_CAR_TYPE;
+            break;
+        case 'R':
+            kind = CMD_REMOVE_CAR_TYPE;
+            break;
+        case 'S':
+            /*SellCar / Stats*/
+            if(len > 1)
+                kind = line[1] == 't' ? CMD_STATS : CMD_SELL_CAR;
+            break;
+        case 'M':
+            kind = CMD_MAKE_COMPLAINT;
+            break;
+        case 'G':
+            /*GetBestSellerModelByType / GetWorstModels*/
+            if(len > 3)
+                kind = line[3] == 'B' ? CMD_GET_BEST_SELLER_MODEL_BY_TYPE : CMD_GET_WORST_MODELS;
+            break;
+        case 'Q':
+            kind = CMD_QUIT;
+            break;
+        default:
+            return CMD_NONE;
+    }
+    if(kind == CMD_NONE)
+        return CMD_NONE;
+    size_t name_len = command_names_len[kind];
+    if(len < name_len || memcmp(line, command_names[kind], name_len) != 0)
+        return CMD_NONE;
+    return kind;
+}
+
+bool wet1::parseCommand(const char*& cursor, const char* end, Command& command)
+{
+    if(cursor >= end)
+        return false;
+    const char* line = cursor;
+    size_t max_len = (size_t)(end - cursor) < MAX_LINE_LEN ? end - cursor : MAX_LINE_LEN;
+    const char* newline = (const char*)memchr(cursor, '\n', max_len);
+    const char* line_end = newline ? newline + 1 : cursor + max_len;
+    cursor = line_end;
+    size_t len = line_end - line;
+
+    command.kind = CMD_NONE;
+    command.valid = true;
+    command.text = line;
+    command.text_len = (int)len;
+    if(line[0] == '\n')
+        return true;
+    if(line[0] == '#')
+    {
+        command.kind = CMD_COMMENT;
+        return true;
+    }
+    command.kind = matchCommand(line, len);
+    if(command.kind == CMD_NONE)
+        return true;
+    /*like the shell, arguments start one character after the name*/
+    const char* args = line + command_names_len[command.kind] + 1;
+    for (int i = 0; i < command_args_num[command.kind]; i++)
+    {
+        if(args > line_end || !parseInt(args, line_end, command.args[i]))
+        {
+            command.valid = false;
+            break;
+        }
+    }
+    return true;
+}
+
+/**************************************************/
+/*CommandExecutor application*/
+
+CommandExecutor::CommandExecutor() : DS(NULL), is_init(false), types(nullptr),
+ models(nullptr), capacity(0)
+{}
+
+CommandExecutor::~CommandExecutor()
+{
+    if(DS != NULL)
+        Quit(&DS);
+    free(types);
+    free(models);
+}
+
+bool CommandExecutor::compact(int budget)
+{
+    int done = 1;
+    /*out of memory - don't retry until the next change*/
+    if(DS != NULL && CompactStep(DS, budget, &done) != SUCCESS)
+        return true;
+    return done != 0;
+}
+
+void CommandExecutor::execute(const Command& command, CommandResult& result)
+{
+    result.status = SUCCESS;
+    result.value = 0;
+    result.types = nullptr;
+    result.models = nullptr;
+    result.count = 0;
+    result.stop = false;
+    result.stats = nullptr;
+    if(command.kind == CMD_COMMENT)
+        return;
+    if(command.kind == CMD_NONE || !command.valid)
+    {
+        result.stop = true;
+        return;
+    }
+    const int* args = command.args;
+    switch(command.kind)
+    {
+        case CMD_INIT:
+            if(is_init)
+            {
+                result.value = 1;
+                break;
+            }
+            is_init = true;
+            DS = Init();
+            if(DS == NULL)
+            {
+                result.status = FAILURE;
+                result.stop = true;
+            }
+            break;
+        case CMD_ADD_CAR_TYPE:
+            result.status = AddCarType(DS, args[0], args[1]);
+            break;
+        case CMD_REMOVE_CAR_TYPE:
+            result.status = RemoveCarType(DS, args[0]);
+            break;
+        case CMD_SELL_CAR:
+            result.status = SellCar(DS, args[0], args[1]);
+            break;
+        case CMD_MAKE_COMPLAINT:
+            result.status = MakeComplaint(DS, args[0], args[1], args[2]);
+            break;
+        case CMD_GET_BEST_SELLER_MODEL_BY_TYPE:
+            result.status = GetBestSellerModelByType(DS, args[0], &result.value);
+            break;
+        case CMD_GET_WORST_MODELS:
+        {
+            int num = args[0];
+            if(num > capacity)
+            {
+                int* new_types = (int*)realloc(types, num * sizeof(int));
+                if(new_types)
+                    types = new_types;
+                int* new_models = (int*)realloc(models, num * sizeof(int));
+                if(new_models)
+                    models = new_models;
+                if(!new_types || !new_models)
+                {
+                    result.status = ALLOCATION_ERROR;
+                    break;
+                }
+                capacity = num;
+            }
+            result.status = GetWorstModels(DS, num, num > 0 ? types : NULL, num > 0 ? models : NULL);
+            if(result.status == SUCCESS)
+            {
+                result.types = types;
+                result.models = models;
+                result.count = num;
+            }
+            break;
+        }
+        case CMD_QUIT:
+            Quit(&DS);
+            if(DS != NULL)
+            {
+                result.status = FAILURE;
+                result.stop = true;
+                break;
+            }
+            is_init = false;
+            break;
+        case CMD_STATS:
+            result.status = GetStats(DS, &stats);
+            if(result.status == SUCCESS)
+                result.stats = &stats;
+            break;
+        default:
+            break;
+    }
+}
+
+/**************************************************/
+/*formatting*/
+
+static const char* const stats_op_names[STATS_OPS_NUM] = {
+        "AddCarType",
+        "RemoveCarType",
+        "SellCar",
+        "MakeComplaint",
+        "GetBestSellerModelByType",
+        "GetWorstModels" };
+
+static void appendTab(const char* label, int value, OutputBuffer& out)
+{
+    out.append(label);
+    out.appendInt(value);
+}
+
+/*some tree policies keep no heights*/
+static void appendHeight(const char* label, int height, OutputBuffer& out)
+{
+    if(height != STATS_HEIGHT_UNTRACKED)
+    {
+        appendTab(label, height, out);
+        return;
+    }
+    out.append(label);
+    out.append("n/a");
+}
+
+static int bucketNanoseconds(int bucket, double ticks_per_ns)
+{
+    return (int)(StatsBucketLowerBound(bucket) / ticks_per_ns);
+}
+
+/*lower bound, in ns, of the bucket holding the p quantile*/
+static int histogramPercentile(const long long* histogram, long long calls, double p,
+    double ticks_per_ns)
+{
+    long long rank = (long long)(p * calls + 0.999999);
+    long long seen = 0;
+    for (int i = 0; i < STATS_HISTOGRAM_BUCKETS; i++)
+    {
+        seen += histogram[i];
+        if(seen >= rank && seen > 0)
+            return bucketNanoseconds(i, ticks_per_ns);
+    }
+    return 0;
+}
+
+void wet1::formatStats(const DealershipStats& stats, OutputBuffer& out)
+{
+    out.append("--Start of stats--\n");
+    appendTab("CarTypes: ", stats.types_num, out);
+    appendTab("\tModels: ", stats.num_of_models, out);
+    appendTab("\nScores: negative ", stats.negative_models, out);
+    appendTab("\tzero ", stats.zero_models, out);
+    appendTab("\tpositive ", stats.positive_models, out);
+    appendHeight("\nHeights: types ", stats.types_height, out);
+    appendHeight("\tsales ", stats.sales_height, out);
+    appendHeight("\tnegative ", stats.negative_height, out);
+    appendHeight("\tpositive ", stats.positive_height, out);
+    out.append("\nOperation\t|\tCalls\t|\tp50 ns\t|\tp99 ns\t|\tp999 ns\n");
+    for (int op = 0; op < STATS_OPS_NUM; op++)
+    {
+        const long long* histogram = stats.histogram[op];
+        out.append(stats_op_names[op]);
+        appendTab("\t|\t", (int)stats.calls[op], out);
+        appendTab("\t|\t", histogramPercentile(histogram, stats.calls[op], 0.5, stats.ticks_per_ns), out);
+        appendTab("\t|\t", histogramPercentile(histogram, stats.calls[op], 0.99, stats.ticks_per_ns), out);
+        appendTab("\t|\t", histogramPercentile(histogram, stats.calls[op], 0.999, stats.ticks_per_ns), out);
+        out.appendChar('\n');
+    }
+    out.append("--Latency histograms--\nOperation\t|\tFrom ns\t|\tCalls\n");
+    for (int op = 0; op < STATS_OPS_NUM; op++)
+    {
+        for (int i = 0; i < STATS_HISTOGRAM_BUCKETS; i++)
+        {
+            if(stats.histogram[op][i] == 0)
+                continue;
+            out.append(stats_op_names[op]);
+            appendTab("\t|\t", bucketNanoseconds(i, stats.ticks_per_ns), out);
+            appendTab("\t|\t", (int)stats.histogram[op][i], out);
+            out.appendChar('\n');
+        }
+    }
+    out.append("--End of stats--\n");
+}
+
+static void formatStatus(CommandKind kind, StatusType status, OutputBuffer& out)
+{
+    out.append(command_names[kind], command_names_len[kind]);
+    out.append(": ", 2);
+    out.append(returnValToStr(status));
+    out.appendChar('\n');
+}
+
+void wet1::formatResult(const Command& command, const CommandResult& result, OutputBuffer& out)
+{
+    if(command.kind == CMD_COMMENT)
+    {
+        if(command.text_len > 1)
+            out.append(command.text, command.text_len);
+        return;
+    }
+    if(command.kind == CMD_NONE)
+        return;
+    if(!command.valid)
+    {
+        out.append(command_names[command.kind], command_names_len[command.kind]);
+        out.append(" failed.\n");
+        return;
+    }
+    switch(command.kind)
+    {
+        case CMD_INIT:
+            if(result.value)
+                out.append("init was already called.\n");
+            else if(result.status != SUCCESS)
+                out.append("init failed.\n");
+            else
+                out.append("init done.\n");
+            break;
+        case CMD_GET_BEST_SELLER_MODEL_BY_TYPE:
+            if(result.status != SUCCESS)
+            {
+                formatStatus(command.kind, result.status, out);
+                break;
+            }
+            out.append("GetBestSellerModelByType: ");
+            out.appendInt(result.value);
+            out.appendChar('\n');
+            break;
+        case CMD_GET_WORST_MODELS:
+            if(result.status != SUCCESS)
+            {
+                formatStatus(command.kind, result.status, out);
+                break;
+            }
+            out.append("--Start of worst models--\nCarType\t|\tModel\n");
+            for (int i = 0; i < result.count; i++)
+            {
+                out.appendInt(result.types[i]);
+                out.append("\t|\t", 3);
+                out.appendInt(result.models[i]);
+                out.appendChar('\n');
+            }
+            out.append("--End of worst models--\n");
+            formatStatus(command.kind, result.status, out);
+            break;
+        case CMD_QUIT:
+            out.append(result.status == SUCCESS ? "quit done.\n" : "quit failed.\n");
+            break;
+        case CMD_STATS:
+            if(result.status == SUCCESS)
+                formatStats(*result.stats, out);
+            formatStatus(command.kind, result.status, out);
+            break;
+        default:
+            formatStatus(command.kind, result.status, out);
+            break;
+    }
+}
+
+/**************************************************/
+/*InputFile application*/
+
+InputFile::InputFile() : data(nullptr), size(0), mapped(false) {}
+
+InputFile::~InputFile()
+{
+    if(mapped)
+        munmap((void*)data, size);
+    else
+        free((void*)data);
+}
+
+bool InputFile::open(const char* path)
+{
+    int fd = strcmp(path, "-") == 0 ? 0 : ::open(path, O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat st;
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(addr != MAP_FAILED)
+        {
+            madvise(addr, st.st_size, MADV_SEQUENTIAL);
+            data = (const char*)addr;
+            size = st.st_size;
+            mapped = true;
+            if(fd != 0)
+                close(fd);
+            return true;
+        }
+    }
+    /*pipes and other unmappable input - read it all*/
+    size_t capacity = 1 << 20;
+    char* buffer = (char*)malloc(capacity);
+    ssize_t res;
+    while(buffer && (res = read(fd, buffer + size, capacity - size)) > 0)
+    {
+        size += res;
+        if(size == capacity)
+        {
+            capacity *= 2;
+            char* grown = (char*)realloc(buffer, capacity);
+            if(!grown)
+                free(buffer);
+            buffer = grown;
+        }
+    }
+    if(fd != 0)
+        close(fd);
+    data = buffer;
+    return buffer != nullptr;
+}
+
+const char* InputFile::begin()
+{
+    return data;
+}
+
+const char* InputFile::end()
+{
+    return data + size;
+}
+
+/**************************************************/
+
+int wet1::runFastDriver(const char* path, int out_fd)
+{
+    InputFile input;
+    if(!input.open(path))
+        return 1;
+    OutputBuffer out(out_fd);
+    CommandExecutor executor;
+    Command command;
+    CommandResult result;
+    const char* cursor = input.begin();
+    while(parseCommand(cursor, input.end(), command))
+    {
+        executor.execute(command, result);
+        formatResult(command, result, out);
+        if(result.stop)
+            break;
+    }
+    out.flush();
+    return 0;
+}
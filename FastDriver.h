@@ -0,0 +1,139 @@
+#ifndef FAST_DRIVER_H
+#define FAST_DRIVER_H
+
+#include <stddef.h>
+#include "library.h"
+
+namespace wet1
+{
+    /*same numbering as the shell's commandType in main1.cpp*/
+    typedef enum {
+        CMD_NONE = -2,
+        CMD_COMMENT = -1,
+        CMD_INIT = 0,
+        CMD_ADD_CAR_TYPE = 1,
+        CMD_REMOVE_CAR_TYPE = 2,
+        CMD_SELL_CAR = 3,
+        CMD_MAKE_COMPLAINT = 4,
+        CMD_GET_BEST_SELLER_MODEL_BY_TYPE = 5,
+        CMD_GET_WORST_MODELS = 6,
+        CMD_QUIT = 7,
+        CMD_STATS = 8
+    } CommandKind;
+
+    const char* commandName(CommandKind kind);
+    int commandArgsNum(CommandKind kind);
+
+    struct Command
+    {
+        CommandKind kind;
+        bool valid; //false if the arguments could not be parsed
+        int args[3];
+        const char* text; //the whole line, for comments
+        int text_len;
+    };
+
+    /**
+     * Result of executing a Command. For GetWorstModels types/models point
+     * to buffers owned by the executor, valid until its next execute().
+     */
+    struct CommandResult
+    {
+        StatusType status;
+        int value; //GetBestSellerModelByType model, 1 if Init was already called
+        int* types;
+        int* models;
+        int count;
+        bool stop; //the shell stops reading after this command
+        const DealershipStats* stats; //Stats, owned by the executor
+    };
+
+    /**
+     * Buffers output and writes it to fd in large chunks. With fd < 0 it
+     * only collects the output, growing as needed.
+     */
+    class OutputBuffer
+    {
+        char* buffer;
+        size_t size, capacity;
+        int fd;
+        void reserve(size_t needed);
+
+        public:
+            explicit OutputBuffer(int fd, size_t capacity = 1 << 20);
+            ~OutputBuffer();
+            OutputBuffer(const OutputBuffer&) = delete;
+            OutputBuffer& operator=(const OutputBuffer&) = delete;
+            void append(const char* str, size_t len);
+            void append(const char* str);
+            void appendInt(int value);
+            void appendChar(char c);
+            void flush();
+            /*for callers that write the buffer themselves (sockets)*/
+            const char* data();
+            size_t length();
+            void clear();
+            /*drops the first len bytes, after a partial write*/
+            void consume(size_t len);
+    };
+
+    /**
+     * Parses the next line of [cursor, end) into command and advances cursor
+     * past it - lines longer than the shell reads at once are split the same
+     * way. Returns false at the end of the input.
+     */
+    bool parseCommand(const char*& cursor, const char* end, Command& command);
+
+    /**
+     * Runs commands on its own data structure with the shell's semantics
+     * (Init once, calls before Init get a NULL DS).
+     */
+    class CommandExecutor
+    {
+        void* DS;
+        bool is_init;
+        int* types;
+        int* models;
+        int capacity;
+        DealershipStats stats;
+
+        public:
+            CommandExecutor();
+            ~CommandExecutor();
+            CommandExecutor(const CommandExecutor&) = delete;
+            CommandExecutor& operator=(const CommandExecutor&) = delete;
+            void execute(const Command& command, CommandResult& result);
+            /*a CompactStep slice for idle time, true once there is nothing left to do (or no memory for it)*/
+            bool compact(int budget);
+    };
+
+    /*writes the exact text main1.cpp prints for this command and result*/
+    void formatResult(const Command& command, const CommandResult& result, OutputBuffer& out);
+
+    /*the Stats command's report, shared with the shell*/
+    void formatStats(const DealershipStats& stats, OutputBuffer& out);
+
+    /**
+     * Replays the commands file at path (mapped into memory) and writes the
+     * shell's output to out_fd. Returns 0 on success.
+     */
+    int runFastDriver(const char* path, int out_fd);
+
+    /*maps (or reads, if it can't be mapped) a whole file, "-" is stdin*/
+    class InputFile
+    {
+        const char* data;
+        size_t size;
+        bool mapped;
+
+        public:
+            InputFile();
+            ~InputFile();
+            InputFile(const InputFile&) = delete;
+            InputFile& operator=(const InputFile&) = delete;
+            bool open(const char* path);
+            const char* begin();
+            const char* end();
+    };
+}
+#endif
@@ -0,0 +1,60 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+
+namespace wet1
+{
+    /**
+     * Intrusive lock free multi producer single consumer queue (Vyukov).
+     * T must have a `std::atomic<T*> next` member. push never waits, pop
+     * returns nullptr when the queue is empty or a producer is in the middle
+     * of linking its node (the node shows up on a later pop).
+     */
+    template<typename T>
+    class MpscQueue {
+        std::atomic<T*> head;
+        T* tail;
+        T stub;
+
+    public:
+        MpscQueue() : head(&stub), tail(&stub), stub() {
+            stub.next.store(nullptr, std::memory_order_relaxed);
+        }
+        MpscQueue(const MpscQueue&) = delete;
+        MpscQueue& operator=(const MpscQueue&) = delete;
+
+        void push(T* node) {
+            node->next.store(nullptr, std::memory_order_relaxed);
+            T* prev = head.exchange(node, std::memory_order_acq_rel);
+            prev->next.store(node, std::memory_order_release);
+        }
+
+        /*consumer only*/
+        T* pop() {
+            T* first = tail;
+            T* next = first->next.load(std::memory_order_acquire);
+            if (first == &stub) {
+                if (!next)
+                    return nullptr;
+                tail = next;
+                first = next;
+                next = next->next.load(std::memory_order_acquire);
+            }
+            if (next) {
+                tail = next;
+                return first;
+            }
+            if (first != head.load(std::memory_order_acquire))
+                return nullptr;
+            push(&stub);
+            next = first->next.load(std::memory_order_acquire);
+            if (next) {
+                tail = next;
+                return first;
+            }
+            return nullptr;
+        }
+    };
+}
+#endif //MPSC_QUEUE_H
@@ -0,0 +1,49 @@
+#include "OperationStats.h"
+#include <chrono>
+#include <string.h>
+
+using namespace wet1;
+
+OperationStats::OperationStats()
+{
+    memset(calls, 0, sizeof(calls));
+    memset(histogram, 0, sizeof(histogram));
+}
+
+void OperationStats::copyTo(DealershipStats* stats)
+{
+    memcpy(stats->calls, calls, sizeof(calls));
+    memcpy(stats->histogram, histogram, sizeof(histogram));
+    stats->ticks_per_ns = ticksPerNanosecond();
+}
+
+static double measureTicksPerNanosecond()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    uint64_t start_ticks = readTicks();
+    Clock::time_point now;
+    do {
+        now = Clock::now();
+    } while(now - start < std::chrono::milliseconds(10));
+    uint64_t ticks = readTicks() - start_ticks;
+    return ticks / (double)std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count();
+#else
+    return 1.0;
+#endif
+}
+
+double wet1::ticksPerNanosecond()
+{
+    static const double ticks_per_ns = measureTicksPerNanosecond();
+    return ticks_per_ns;
+}
+
+long long StatsBucketLowerBound(int bucket)
+{
+    if(bucket < STATS_SUB_BUCKETS)
+        return bucket;
+    int msb = bucket / STATS_SUB_BUCKETS + 1;
+    return (long long)(STATS_SUB_BUCKETS + bucket % STATS_SUB_BUCKETS) << (msb - 2);
+}
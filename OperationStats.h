@@ -0,0 +1,74 @@
+#ifndef OPERATION_STATS_H
+#define OPERATION_STATS_H
+
+#include <stdint.h>
+#include "library.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+namespace wet1
+{
+    /*timestamp counter, or a nanosecond clock where there is none*/
+    static inline uint64_t readTicks()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    /*measured once against the steady clock*/
+    double ticksPerNanosecond();
+
+    static inline int statsBucket(uint64_t ticks)
+    {
+        if(ticks < STATS_SUB_BUCKETS)
+            return (int)ticks;
+        int msb = 63 - __builtin_clzll(ticks);
+        int bucket = (msb - 1) * STATS_SUB_BUCKETS + (int)((ticks >> (msb - 2)) & (STATS_SUB_BUCKETS - 1));
+        return bucket < STATS_HISTOGRAM_BUCKETS ? bucket : STATS_HISTOGRAM_BUCKETS - 1;
+    }
+
+    /**
+     * Call counts and latency histograms of one manager. Plain counters - the
+     * manager is single threaded, so recording is two increments.
+     */
+    class OperationStats
+    {
+        long long calls[STATS_OPS_NUM];
+        long long histogram[STATS_OPS_NUM][STATS_HISTOGRAM_BUCKETS];
+
+        public:
+            OperationStats();
+            void record(StatsOperation op, uint64_t ticks)
+            {
+                calls[op]++;
+                histogram[op][statsBucket(ticks)]++;
+            }
+            void copyTo(DealershipStats* stats);
+    };
+
+    /*records the time from construction to destruction*/
+    class OperationTimer
+    {
+        OperationStats& stats;
+        StatsOperation op;
+        uint64_t start;
+
+        public:
+            OperationTimer(OperationStats& stats, StatsOperation op) : stats(stats), op(op),
+             start(readTicks()) {}
+            ~OperationTimer()
+            {
+                stats.record(op, readTicks() - start);
+            }
+            OperationTimer(const OperationTimer&) = delete;
+            OperationTimer& operator=(const OperationTimer&) = delete;
+    };
+}
+#endif
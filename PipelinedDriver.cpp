@@ -0,0 +1,187 @@
+#include "PipelinedDriver.h"
+#include "FastDriver.h"
+#include "SpscRing.h"
+#include <atomic>
+#include <functional>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+using namespace wet1;
+
+namespace
+{
+    const size_t RING_CAPACITY = 4096;
+
+    struct ParsedItem
+    {
+        Command command;
+        bool end; //end of the input, not a command
+    };
+
+    /**
+     * An executed command. The result's arrays and stats are copied out of
+     * the executor (which reuses them) and freed by the formatter.
+     */
+    struct ExecutedItem
+    {
+        Command command;
+        CommandResult result;
+        bool end; //nothing more to format
+    };
+
+    /*spins for a while, then gives the core away*/
+    class Backoff
+    {
+        int spins;
+
+        public:
+            Backoff() : spins(0) {}
+            void wait()
+            {
+                if(++spins < 64)
+                    return;
+                std::this_thread::yield();
+            }
+    };
+
+    template<typename T, size_t CAPACITY>
+    void pushWaiting(SpscRing<T, CAPACITY>& ring, const T& item, std::atomic<bool>& stopped)
+    {
+        Backoff backoff;
+        while(!ring.tryPush(item) && !stopped.load(std::memory_order_relaxed))
+            backoff.wait();
+    }
+
+    template<typename T, size_t CAPACITY>
+    void popWaiting(SpscRing<T, CAPACITY>& ring, T& item)
+    {
+        Backoff backoff;
+        while(!ring.tryPop(item))
+            backoff.wait();
+    }
+
+    /*moves what the result points at out of the executor's buffers*/
+    bool ownResult(CommandResult& result)
+    {
+        if(result.count > 0)
+        {
+            int* types = (int*)malloc(result.count * sizeof(int));
+            int* models = (int*)malloc(result.count * sizeof(int));
+            if(!types || !models)
+            {
+                free(types);
+                free(models);
+                return false;
+            }
+            memcpy(types, result.types, result.count * sizeof(int));
+            memcpy(models, result.models, result.count * sizeof(int));
+            result.types = types;
+            result.models = models;
+        }
+        if(result.stats)
+        {
+            DealershipStats* stats = (DealershipStats*)malloc(sizeof(DealershipStats));
+            if(!stats)
+            {
+                /*the rows copied above are ours now*/
+                if(result.count > 0)
+                {
+                    free(result.types);
+                    free(result.models);
+                }
+                return false;
+            }
+            memcpy(stats, result.stats, sizeof(DealershipStats));
+            result.stats = stats;
+        }
+        return true;
+    }
+
+    void freeResult(CommandResult& result)
+    {
+        if(result.count > 0)
+        {
+            free(result.types);
+            free(result.models);
+        }
+        free((void*)result.stats);
+    }
+
+    void parseStage(const char* begin, const char* end, SpscRing<ParsedItem, RING_CAPACITY>& parsed,
+        std::atomic<bool>& stopped)
+    {
+        ParsedItem item;
+        item.end = false;
+        const char* cursor = begin;
+        while(!stopped.load(std::memory_order_relaxed) && parseCommand(cursor, end, item.command))
+            pushWaiting(parsed, item, stopped);
+        item.end = true;
+        pushWaiting(parsed, item, stopped);
+    }
+
+    void executeStage(SpscRing<ParsedItem, RING_CAPACITY>& parsed,
+        SpscRing<ExecutedItem, RING_CAPACITY>& executed, std::atomic<bool>& stopped)
+    {
+        CommandExecutor executor;
+        ParsedItem in;
+        ExecutedItem out;
+        out.end = false;
+        std::atomic<bool> never_stopped(false); //the formatter drains everything
+        while(true)
+        {
+            popWaiting(parsed, in);
+            if(in.end)
+                break;
+            out.command = in.command;
+            executor.execute(in.command, out.result);
+            if(!ownResult(out.result))
+            {
+                /*no memory to hand the rows over*/
+                out.result.status = ALLOCATION_ERROR;
+                out.result.count = 0;
+                out.result.stats = nullptr;
+            }
+            pushWaiting(executed, out, never_stopped);
+            if(out.result.stop)
+            {
+                /*the parser may be blocked on a full ring, let it go*/
+                stopped.store(true, std::memory_order_relaxed);
+                break;
+            }
+        }
+        out.end = true;
+        pushWaiting(executed, out, never_stopped);
+    }
+
+    void formatStage(SpscRing<ExecutedItem, RING_CAPACITY>& executed, int out_fd)
+    {
+        OutputBuffer out(out_fd);
+        ExecutedItem item;
+        while(true)
+        {
+            popWaiting(executed, item);
+            if(item.end)
+                break;
+            formatResult(item.command, item.result, out);
+            freeResult(item.result);
+        }
+        out.flush();
+    }
+}
+
+int wet1::runPipelinedDriver(const char* path, int out_fd)
+{
+    InputFile input;
+    if(!input.open(path))
+        return 1;
+    SpscRing<ParsedItem, RING_CAPACITY> parsed;
+    SpscRing<ExecutedItem, RING_CAPACITY> executed;
+    std::atomic<bool> stopped(false);
+    std::thread parser(parseStage, input.begin(), input.end(), std::ref(parsed), std::ref(stopped));
+    std::thread executor(executeStage, std::ref(parsed), std::ref(executed), std::ref(stopped));
+    formatStage(executed, out_fd);
+    executor.join();
+    parser.join();
+    return 0;
+}
@@ -0,0 +1,14 @@
+#ifndef PIPELINED_DRIVER_H
+#define PIPELINED_DRIVER_H
+
+namespace wet1
+{
+    /**
+     * runFastDriver split into three threads connected by SpscRings: one
+     * parses the input into Commands, one executes them in order and one
+     * formats the results. The output is the same as runFastDriver's.
+     * Returns 0 on success.
+     */
+    int runPipelinedDriver(const char* path, int out_fd);
+}
+#endif
@@ -0,0 +1,45 @@
+#ifndef SEQ_LOCK_H
+#define SEQ_LOCK_H
+
+#include <atomic>
+
+namespace wet1
+{
+    /**
+     * Single writer sequence lock over WORDS ints.
+     * The writer never waits, readers retry while a write is in progress
+     * (odd sequence) or if the sequence moved while they were copying.
+     */
+    template<int WORDS>
+    class SeqLock {
+        std::atomic<unsigned> seq;
+        std::atomic<int> words[WORDS];
+
+    public:
+        SeqLock() : seq(0) {
+            for (int i = 0; i < WORDS; i++)
+                words[i].store(0, std::memory_order_relaxed);
+        }
+
+        void write(const int* values) {
+            unsigned s = seq.load(std::memory_order_relaxed);
+            seq.store(s + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            for (int i = 0; i < WORDS; i++)
+                words[i].store(values[i], std::memory_order_relaxed);
+            seq.store(s + 2, std::memory_order_release);
+        }
+
+        void read(int* values) const {
+            unsigned before, after;
+            do {
+                before = seq.load(std::memory_order_acquire);
+                for (int i = 0; i < WORDS; i++)
+                    values[i] = words[i].load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                after = seq.load(std::memory_order_relaxed);
+            } while ((before & 1) || before != after);
+        }
+    };
+}
+#endif //SEQ_LOCK_H
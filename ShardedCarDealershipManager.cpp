@@ -0,0 +1,260 @@
+#include "ShardedCarDealershipManager.h"
+#include <new>
+
+using namespace wet1;
+
+ShardedCarDealershipManager::ShardedCarDealershipManager(int shardsNum) : shards(nullptr),
+ shards_num(shardsNum > 0 ? shardsNum : 1), shard_lengths(nullptr), shard_heads(nullptr), shard_capacities(nullptr),
+ shard_types(nullptr), shard_models(nullptr), shard_scores(nullptr), merge_heap(nullptr)
+{
+    shards = new Shard[shards_num];
+    shard_lengths = new int[shards_num];
+    shard_heads = new int[shards_num];
+    shard_capacities = new int[shards_num]();
+    shard_types = new int*[shards_num]();
+    shard_models = new int*[shards_num]();
+    shard_scores = new int*[shards_num]();
+    merge_heap = new int[shards_num];
+}
+
+ShardedCarDealershipManager::~ShardedCarDealershipManager()
+{
+    freeBuffers();
+    delete[] shard_lengths;
+    delete[] shard_heads;
+    delete[] shard_capacities;
+    delete[] shard_types;
+    delete[] shard_models;
+    delete[] shard_scores;
+    delete[] merge_heap;
+    delete[] shards;
+}
+
+int ShardedCarDealershipManager::getShardsNum()
+{
+    return shards_num;
+}
+
+/*types are spread by typeId, invalid ids go to shard 0 which rejects them*/
+ShardedCarDealershipManager::Shard& ShardedCarDealershipManager::shardOf(int typeId)
+{
+    if(typeId <= 0)
+        return shards[0];
+    return shards[typeId % shards_num];
+}
+
+void ShardedCarDealershipManager::lockAll()
+{
+    for (int i = 0; i < shards_num; i++)
+    {
+        shards[i].lock.lock();
+    }
+}
+
+void ShardedCarDealershipManager::unlockAll()
+{
+    for (int i = shards_num - 1; i >= 0; i--)
+    {
+        shards[i].lock.unlock();
+    }
+}
+
+void ShardedCarDealershipManager::freeBuffers()
+{
+    for (int i = 0; i < shards_num; i++)
+    {
+        delete[] shard_types[i];
+        delete[] shard_models[i];
+        delete[] shard_scores[i];
+        shard_types[i] = shard_models[i] = shard_scores[i] = nullptr;
+        shard_capacities[i] = 0;
+    }
+}
+
+StatusType ShardedCarDealershipManager::fetchRows(int shard, int rows)
+{
+    if(rows > shard_capacities[shard])
+    {
+        int capacity = shard_capacities[shard] * 2 > rows ? shard_capacities[shard] * 2 : rows;
+        int* types = new (std::nothrow) int[capacity];
+        int* models = new (std::nothrow) int[capacity];
+        int* scores = new (std::nothrow) int[capacity];
+        if(!types || !models || !scores)
+        {
+            delete[] types;
+            delete[] models;
+            delete[] scores;
+            return ALLOCATION_ERROR;
+        }
+        /*the rows are fetched again from the start, nothing to copy*/
+        delete[] shard_types[shard];
+        delete[] shard_models[shard];
+        delete[] shard_scores[shard];
+        shard_types[shard] = types;
+        shard_models[shard] = models;
+        shard_scores[shard] = scores;
+        shard_capacities[shard] = capacity;
+    }
+    StatusType res = shards[shard].manager.GetWorstModelsWithScores(rows, shard_types[shard],
+        shard_models[shard], shard_scores[shard]);
+    if(res == SUCCESS)
+        shard_lengths[shard] = rows;
+    return res;
+}
+
+/*by (score, type, model) of the shards next rows*/
+bool ShardedCarDealershipManager::headBefore(int shard, int other)
+{
+    int h = shard_heads[shard], o = shard_heads[other];
+    if(shard_scores[shard][h] != shard_scores[other][o])
+        return shard_scores[shard][h] < shard_scores[other][o];
+    if(shard_types[shard][h] != shard_types[other][o])
+        return shard_types[shard][h] < shard_types[other][o];
+    return shard_models[shard][h] < shard_models[other][o];
+}
+
+void ShardedCarDealershipManager::siftDown(int pos, int heap_size)
+{
+    while(true)
+    {
+        int min = pos, left = 2 * pos + 1, right = left + 1;
+        if(left < heap_size && headBefore(merge_heap[left], merge_heap[min]))
+            min = left;
+        if(right < heap_size && headBefore(merge_heap[right], merge_heap[min]))
+            min = right;
+        if(min == pos)
+            return;
+        int tmp = merge_heap[pos];
+        merge_heap[pos] = merge_heap[min];
+        merge_heap[min] = tmp;
+        pos = min;
+    }
+}
+
+StatusType ShardedCarDealershipManager::AddCarType(int typeId, int numOfModels)
+{
+    Shard& shard = shardOf(typeId);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    return shard.manager.AddCarType(typeId, numOfModels);
+}
+
+StatusType ShardedCarDealershipManager::RemoveCarType(int typeId)
+{
+    Shard& shard = shardOf(typeId);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    return shard.manager.RemoveCarType(typeId);
+}
+
+StatusType ShardedCarDealershipManager::SellCar(int typeId, int modelId)
+{
+    Shard& shard = shardOf(typeId);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    return shard.manager.SellCar(typeId, modelId);
+}
+
+StatusType ShardedCarDealershipManager::MakeComplaint(int typeId, int modelId, int t)
+{
+    Shard& shard = shardOf(typeId);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    return shard.manager.MakeComplaint(typeId, modelId, t);
+}
+
+StatusType ShardedCarDealershipManager::GetBestSellerModelByType(int typeId, int* modelId)
+{
+    if(typeId > 0)
+    {
+        Shard& shard = shardOf(typeId);
+        std::lock_guard<std::mutex> guard(shard.lock);
+        return shard.manager.GetBestSellerModelByType(typeId, modelId);
+    }
+    if(typeId < 0)
+        return INVALID_INPUT;
+    /*merge the shards best sellers - more sales wins, then lower type and model*/
+    int types_num = 0;
+    bool found = false;
+    int best_sales = 0, best_type = 0, best_model = 0;
+    lockAll();
+    for (int i = 0; i < shards_num; i++)
+    {
+        types_num += shards[i].manager.getTypesNum();
+        int sales, type, model;
+        if(shards[i].manager.GetTopSeller(&sales, &type, &model) != SUCCESS)
+            continue;
+        if(!found || sales > best_sales || (sales == best_sales &&
+            (type < best_type || (type == best_type && model < best_model))))
+        {
+            found = true;
+            best_sales = sales;
+            best_type = type;
+            best_model = model;
+        }
+    }
+    unlockAll();
+    if(types_num == 0)
+        return FAILURE;
+    *modelId = found ? best_model : 0;
+    return SUCCESS;
+}
+
+StatusType ShardedCarDealershipManager::GetWorstModels(int numOfModels, int* types, int* models)
+{
+    if(numOfModels <= 0)
+        return INVALID_INPUT;
+    std::lock_guard<std::mutex> merge_guard(merge_lock);
+    lockAll();
+    int total = 0;
+    for (int i = 0; i < shards_num; i++)
+    {
+        total += shards[i].manager.getModelsNum();
+    }
+    if(numOfModels > total)
+    {
+        unlockAll();
+        return FAILURE;
+    }
+    /**
+     * k-way merge by (score, type, model) over a heap of the shards heads.
+     * Each shard first gives about its share of the rows, and twice as many
+     * whenever the merge runs out of them, so the rows fetched stay within a
+     * few times numOfModels however the worst models are spread.
+     */
+    StatusType res = SUCCESS;
+    int share = numOfModels / shards_num + 1;
+    int heap_size = 0;
+    for (int i = 0; i < shards_num && res == SUCCESS; i++)
+    {
+        int shard_models_num = shards[i].manager.getModelsNum();
+        shard_lengths[i] = shard_heads[i] = 0;
+        if(shard_models_num > 0)
+            res = fetchRows(i, shard_models_num < share ? shard_models_num : share);
+        if(res == SUCCESS && shard_lengths[i] > 0)
+            merge_heap[heap_size++] = i;
+    }
+    for (int i = heap_size / 2 - 1; i >= 0 && res == SUCCESS; i--)
+    {
+        siftDown(i, heap_size);
+    }
+    for (int index = 0; index < numOfModels && res == SUCCESS; index++)
+    {
+        int min = merge_heap[0];
+        types[index] = shard_types[min][shard_heads[min]];
+        models[index] = shard_models[min][shard_heads[min]];
+        if(++shard_heads[min] == shard_lengths[min])
+        {
+            int shard_models_num = shards[min].manager.getModelsNum();
+            if(shard_lengths[min] == shard_models_num)
+                merge_heap[0] = merge_heap[--heap_size];
+            else
+            {
+                int rows = shard_lengths[min] * 2;
+                res = fetchRows(min, rows < shard_models_num ? rows : shard_models_num);
+                if(res != SUCCESS)
+                    break;
+            }
+        }
+        siftDown(0, heap_size);
+    }
+    /*a shard that failed (paging in a cold type) left the output part written*/
+    unlockAll();
+    return res;
+}
@@ -0,0 +1,63 @@
+#ifndef SHARDED_CAR_DEALER
+#define SHARDED_CAR_DEALER
+
+#include <mutex>
+#include "CarDealershipManager.h"
+
+namespace wet1
+{
+    /**
+     * Partitions the car types between shardsNum CarDealershipManagers by
+     * typeId. Each shard has its own lock, so calls that touch a single type
+     * from different threads only contend when they hit the same shard.
+     * Global queries lock all the shards (in order) and merge their results.
+     */
+    class ShardedCarDealershipManager
+    {
+        private:
+            struct Shard
+            {
+                std::mutex lock;
+                CarDealershipManager manager;
+            };
+            Shard* shards;
+            int shards_num;
+            /**
+             * GetWorstModels merge state, guarded by merge_lock. Each shard's
+             * buffers hold a prefix of its worst models, shard_lengths rows of
+             * it fetched and shard_heads of them merged. merge_heap holds the
+             * shards with rows left, the one with the smallest head first.
+             */
+            std::mutex merge_lock;
+            int* shard_lengths;
+            int* shard_heads;
+            int* shard_capacities;
+            int** shard_types;
+            int** shard_models;
+            int** shard_scores;
+            int* merge_heap;
+
+            Shard& shardOf(int typeId);
+            void lockAll();
+            void unlockAll();
+            /*fetches the shard's rows worst models again, all shards locked*/
+            StatusType fetchRows(int shard, int rows);
+            bool headBefore(int shard, int other);
+            void siftDown(int pos, int heap_size);
+            void freeBuffers();
+
+        public:
+            explicit ShardedCarDealershipManager(int shardsNum);
+            ~ShardedCarDealershipManager();
+            ShardedCarDealershipManager(const ShardedCarDealershipManager&) = delete;
+            ShardedCarDealershipManager& operator=(const ShardedCarDealershipManager&) = delete;
+            int getShardsNum();
+            StatusType AddCarType (int typeId, int numOfModels);
+            StatusType RemoveCarType (int typeId);
+            StatusType SellCar (int typeId, int modelId);
+            StatusType MakeComplaint (int typeId, int modelId, int t);
+            StatusType GetBestSellerModelByType (int typeId, int* modelId);
+            StatusType GetWorstModels (int numOfModels, int* types, int* models);
+    };
+}
+#endif
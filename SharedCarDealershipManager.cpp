@@ -0,0 +1,677 @@
+#include "SharedCarDealershipManager.h"
+#include <fcntl.h>
+#include <new>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#define SAIL_POINTS 10
+/*"wet1shm" and a layout version*/
+#define SHARED_MAGIC 0x7765743173686d01ull
+/*records start on their own cache line after the header*/
+#define FIRST_RECORD ((sizeof(SharedHeader) + 63) / 64 * 64)
+/*a freed run is split only if this much is left over*/
+#define SPLIT_MIN 64
+/*no AVL tree that fits in memory is higher - a longer walk was torn*/
+#define MAX_TREE_HEIGHT 64
+
+using namespace wet1;
+
+namespace
+{
+    /*a freed run of the segment, in the writer's free list*/
+    struct FreeRun
+    {
+        uint64_t size;
+        uint64_t next;
+    };
+
+    const SharedType* typeIn(const char* base, uint64_t offset)
+    {
+        return (const SharedType*)(base + offset);
+    }
+
+    const SharedModel* modelIn(const char* base, uint64_t offset)
+    {
+        return (const SharedModel*)(base + offset);
+    }
+
+    struct SharedTypeOrder
+    {
+        const char* base;
+        bool operator()(uint64_t type1, uint64_t type2)
+        {
+            return typeIn(base, type1)->typeId < typeIn(base, type2)->typeId;
+        }
+    };
+
+    /*CompModelNum*/
+    struct SharedModelNumOrder
+    {
+        const char* base;
+        bool operator()(uint64_t model1, uint64_t model2)
+        {
+            return modelIn(base, model1)->model < modelIn(base, model2)->model;
+        }
+    };
+
+    /*CompModelSailes*/
+    struct SharedSalesOrder
+    {
+        const char* base;
+        bool operator()(uint64_t offset1, uint64_t offset2)
+        {
+            const SharedModel* model1 = modelIn(base, offset1);
+            const SharedModel* model2 = modelIn(base, offset2);
+            if(model1->sales == model2->sales)
+            {
+                if(model1->type == model2->type)
+                    return model1->model > model2->model;
+                return model1->type > model2->type;
+            }
+            return model1->sales < model2->sales;
+        }
+    };
+
+    /*CompModelScore*/
+    struct SharedScoreOrder
+    {
+        const char* base;
+        bool operator()(uint64_t offset1, uint64_t offset2)
+        {
+            const SharedModel* model1 = modelIn(base, offset1);
+            const SharedModel* model2 = modelIn(base, offset2);
+            if(model1->score == model2->score)
+            {
+                if(model1->type == model2->type)
+                    return model1->model < model2->model;
+                return model1->type < model2->type;
+            }
+            return model1->score < model2->score;
+        }
+    };
+
+    /**
+     * What a query runs on. expected is the sequence the query started at -
+     * for the writer it never moves. Fields the writer may be changing are
+     * read with single loads, so a checked offset can't change under us.
+     */
+    struct SegmentView
+    {
+        const char* base;
+        uint64_t size;
+        const std::atomic<unsigned>* seq;
+        unsigned expected;
+
+        template<typename Record>
+        bool valid(uint64_t offset) const
+        {
+            return offset != 0 && offset % 8 == 0 && offset <= size - sizeof(Record);
+        }
+        bool moved() const
+        {
+            return seq->load(std::memory_order_acquire) != expected;
+        }
+        const SharedHeader* header() const
+        {
+            return (const SharedHeader*)base;
+        }
+    };
+
+    template<typename T>
+    T load(const T& field)
+    {
+        return __atomic_load_n(&field, __ATOMIC_RELAXED);
+    }
+
+    const ShmLinks* linksIn(const SegmentView& view, uint64_t node, size_t links_at)
+    {
+        return (const ShmLinks*)(view.base + node + links_at);
+    }
+
+    /*the walks below return false on a link that can't be right - the query was torn*/
+    template<typename Record>
+    bool leftmost(const SegmentView& view, size_t links_at, uint64_t& node)
+    {
+        for (int steps = 0; node; steps++)
+        {
+            if(steps > MAX_TREE_HEIGHT || !view.valid<Record>(node))
+                return false;
+            uint64_t left = load(linksIn(view, node, links_at)->left);
+            if(!left)
+                return true;
+            node = left;
+        }
+        return true;
+    }
+
+    template<typename Record>
+    bool rightmost(const SegmentView& view, size_t links_at, uint64_t& node)
+    {
+        for (int steps = 0; node; steps++)
+        {
+            if(steps > MAX_TREE_HEIGHT || !view.valid<Record>(node))
+                return false;
+            uint64_t right = load(linksIn(view, node, links_at)->right);
+            if(!right)
+                return true;
+            node = right;
+        }
+        return true;
+    }
+
+    /*node is a valid record, 0 after the last one*/
+    template<typename Record>
+    bool successor(const SegmentView& view, size_t links_at, uint64_t& node)
+    {
+        uint64_t right = load(linksIn(view, node, links_at)->right);
+        if(right)
+        {
+            node = right;
+            return leftmost<Record>(view, links_at, node);
+        }
+        for (int steps = 0; steps <= MAX_TREE_HEIGHT; steps++)
+        {
+            uint64_t parent = load(linksIn(view, node, links_at)->parent);
+            if(!parent)
+            {
+                node = 0;
+                return true;
+            }
+            if(!view.valid<Record>(parent))
+                return false;
+            bool from_left = load(linksIn(view, parent, links_at)->left) == node;
+            node = parent;
+            if(from_left)
+                return true;
+        }
+        return false;
+    }
+
+    /*appends the models of a score tree in order, until there are numOfModels*/
+    bool fillFromTree(const SegmentView& view, uint64_t root, int numOfModels, int& index,
+                      int* types, int* models)
+    {
+        const size_t links_at = offsetof(SharedModel, score_links);
+        uint64_t node = root;
+        if(!leftmost<SharedModel>(view, links_at, node))
+            return false;
+        while(node && index < numOfModels)
+        {
+            const SharedModel* model = modelIn(view.base, node);
+            types[index] = load(model->type);
+            models[index] = load(model->model);
+            index++;
+            /*a writer may have made a cycle of links since*/
+            if(index % 64 == 0 && view.moved())
+                return false;
+            if(!successor<SharedModel>(view, links_at, node))
+                return false;
+        }
+        return true;
+    }
+
+    bool worstModels(const SegmentView& view, int numOfModels, int* types, int* models, StatusType& status)
+    {
+        const SharedHeader* header = view.header();
+        if(numOfModels <= 0)
+        {
+            status = INVALID_INPUT;
+            return true;
+        }
+        if(numOfModels > load(header->models_num))
+        {
+            status = FAILURE;
+            return true;
+        }
+        int index = 0;
+        if(!fillFromTree(view, load(header->neg_root), numOfModels, index, types, models))
+            return false;
+        /*zero score models, by type then model*/
+        const size_t links_at = offsetof(SharedType, links);
+        uint64_t type = load(header->types_root);
+        if(!leftmost<SharedType>(view, links_at, type))
+            return false;
+        while(type && index < numOfModels)
+        {
+            if(!fillFromTree(view, load(typeIn(view.base, type)->zero_root), numOfModels, index, types, models))
+                return false;
+            if(view.moved() || !successor<SharedType>(view, links_at, type))
+                return false;
+        }
+        if(!fillFromTree(view, load(header->pos_root), numOfModels, index, types, models))
+            return false;
+        status = SUCCESS;
+        return index == numOfModels;
+    }
+
+    bool bestSeller(const SegmentView& view, int typeId, int* modelId, StatusType& status)
+    {
+        const SharedHeader* header = view.header();
+        if(typeId < 0)
+        {
+            status = INVALID_INPUT;
+            return true;
+        }
+        if(load(header->types_num) == 0)
+        {
+            status = FAILURE;
+            return true;
+        }
+        status = SUCCESS;
+        if(typeId == 0)
+        {
+            uint64_t best = load(header->sales_root);
+            if(!rightmost<SharedModel>(view, offsetof(SharedModel, sales_links), best))
+                return false;
+            //all models have zero sales
+            *modelId = best ? load(modelIn(view.base, best)->model) : 0;
+            return true;
+        }
+        uint64_t type = load(header->types_root);
+        for (int steps = 0; type; steps++)
+        {
+            if(steps > MAX_TREE_HEIGHT || !view.valid<SharedType>(type))
+                return false;
+            const SharedType* car_type = typeIn(view.base, type);
+            int id = load(car_type->typeId);
+            if(id == typeId)
+            {
+                uint64_t best = load(car_type->best_seller);
+                if(!view.valid<SharedModel>(best))
+                    return false;
+                *modelId = load(modelIn(view.base, best)->model);
+                return true;
+            }
+            type = typeId < id ? load(car_type->links.left) : load(car_type->links.right);
+        }
+        status = FAILURE;
+        return true;
+    }
+}
+
+/*************SharedCarDealershipManager application***************************/
+
+SharedCarDealershipManager::SharedCarDealershipManager() : base(nullptr), size(0), name(nullptr) {}
+
+SharedCarDealershipManager::~SharedCarDealershipManager()
+{
+    close();
+}
+
+void SharedCarDealershipManager::close()
+{
+    if(!base)
+        return;
+    munmap(base, size);
+    shm_unlink(name);
+    delete[] name;
+    base = nullptr;
+    name = nullptr;
+}
+
+bool SharedCarDealershipManager::create(const char* name, size_t size)
+{
+    close();
+    if(size < FIRST_RECORD)
+        return false;
+    /*readers of an old segment keep it, they don't see this one*/
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if(fd < 0)
+        return false;
+    void* mapped = MAP_FAILED;
+    if(ftruncate(fd, size) == 0)
+        mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(mapped == MAP_FAILED)
+    {
+        shm_unlink(name);
+        return false;
+    }
+    base = (char*)mapped;
+    this->size = size;
+    this->name = new char[strlen(name) + 1];
+    strcpy(this->name, name);
+    SharedHeader* shared = new (base) SharedHeader;
+    shared->size = size;
+    shared->seq.store(0, std::memory_order_relaxed);
+    shared->types_num = 0;
+    shared->models_num = 0;
+    shared->types_root = shared->sales_root = shared->neg_root = shared->pos_root = 0;
+    shared->top = FIRST_RECORD;
+    shared->free_runs = 0;
+    __atomic_store_n(&shared->magic, SHARED_MAGIC, __ATOMIC_RELEASE);
+    return true;
+}
+
+SharedHeader* SharedCarDealershipManager::header()
+{
+    return (SharedHeader*)base;
+}
+
+SharedType* SharedCarDealershipManager::typeAt(uint64_t offset)
+{
+    return (SharedType*)(base + offset);
+}
+
+SharedModel* SharedCarDealershipManager::modelAt(uint64_t offset)
+{
+    return (SharedModel*)(base + offset);
+}
+
+uint64_t SharedCarDealershipManager::allocate(uint64_t bytes)
+{
+    bytes = (bytes + 7) / 8 * 8;
+    uint64_t* link = &header()->free_runs;
+    while(*link)
+    {
+        FreeRun* run = (FreeRun*)(base + *link);
+        if(run->size >= bytes)
+        {
+            /*the tail of a bigger run, the run stays in the list*/
+            if(run->size - bytes >= SPLIT_MIN)
+            {
+                run->size -= bytes;
+                return *link + run->size;
+            }
+            uint64_t offset = *link;
+            *link = run->next;
+            return offset;
+        }
+        link = &run->next;
+    }
+    if(bytes > size - header()->top)
+        return 0;
+    uint64_t offset = header()->top;
+    header()->top += bytes;
+    return offset;
+}
+
+/**
+ * readers may still be walking a released run - they see the change of
+ * sequence that unlinked it and retry
+ */
+void SharedCarDealershipManager::release(uint64_t offset, uint64_t bytes)
+{
+    bytes = (bytes + 7) / 8 * 8;
+    if(offset + bytes == header()->top)
+    {
+        header()->top = offset;
+        return;
+    }
+    FreeRun* run = (FreeRun*)(base + offset);
+    run->size = bytes;
+    run->next = header()->free_runs;
+    header()->free_runs = offset;
+}
+
+void SharedCarDealershipManager::beginWrite()
+{
+    unsigned seq = header()->seq.load(std::memory_order_relaxed);
+    header()->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void SharedCarDealershipManager::endWrite()
+{
+    unsigned seq = header()->seq.load(std::memory_order_relaxed);
+    header()->seq.store(seq + 1, std::memory_order_release);
+}
+
+/*0 if there is no such type*/
+uint64_t SharedCarDealershipManager::findType(int typeId)
+{
+    ShmTree<SharedTypeOrder> types(base, &header()->types_root, offsetof(SharedType, links), { base });
+    return types.find([this, typeId](uint64_t type) {
+        int id = typeAt(type)->typeId;
+        return typeId < id ? -1 : typeId > id;
+    });
+}
+
+StatusType SharedCarDealershipManager::AddCarType(int typeId, int numOfModels)
+{
+    if(!base || typeId <= 0 || numOfModels <= 0)
+        return INVALID_INPUT;
+    if(findType(typeId))
+        return FAILURE; //already exist
+    uint64_t type = allocate(sizeof(SharedType));
+    if(!type)
+        return ALLOCATION_ERROR;
+    uint64_t models = allocate((uint64_t)numOfModels * sizeof(SharedModel));
+    if(!models)
+    {
+        release(type, sizeof(SharedType));
+        return ALLOCATION_ERROR;
+    }
+    /*readers can't reach the type before it is linked - build it first*/
+    SharedType* car_type = typeAt(type);
+    car_type->typeId = typeId;
+    car_type->models_num = numOfModels;
+    car_type->models = models;
+    car_type->best_seller = models; //model 0
+    car_type->zero_root = 0;
+    for (int i = 0; i < numOfModels; i++)
+    {
+        SharedModel* model = modelAt(models + (uint64_t)i * sizeof(SharedModel));
+        model->type = typeId;
+        model->model = i;
+        model->sales = 0;
+        model->score = 0;
+    }
+    ShmTree<SharedModelNumOrder> zero_models(base, &car_type->zero_root, offsetof(SharedModel, score_links), { base });
+    zero_models.build([models](int i) { return models + (uint64_t)i * sizeof(SharedModel); }, numOfModels);
+    beginWrite();
+    ShmTree<SharedTypeOrder> types(base, &header()->types_root, offsetof(SharedType, links), { base });
+    types.insert(type);
+    header()->types_num++;
+    header()->models_num += numOfModels;
+    endWrite();
+    return SUCCESS;
+}
+
+StatusType SharedCarDealershipManager::RemoveCarType(int typeId)
+{
+    if(!base || typeId <= 0)
+        return INVALID_INPUT;
+    uint64_t type = findType(typeId);
+    if(!type)
+        return FAILURE;
+    SharedType* car_type = typeAt(type);
+    ShmTree<SharedSalesOrder> sales(base, &header()->sales_root, offsetof(SharedModel, sales_links), { base });
+    ShmTree<SharedScoreOrder> negative(base, &header()->neg_root, offsetof(SharedModel, score_links), { base });
+    ShmTree<SharedScoreOrder> positive(base, &header()->pos_root, offsetof(SharedModel, score_links), { base });
+    ShmTree<SharedTypeOrder> types(base, &header()->types_root, offsetof(SharedType, links), { base });
+    beginWrite();
+    for (int i = 0; i < car_type->models_num; i++)
+    {
+        uint64_t model = car_type->models + (uint64_t)i * sizeof(SharedModel);
+        if(modelAt(model)->sales > 0)
+            sales.remove(model);
+        if(modelAt(model)->score > 0)
+            positive.remove(model);
+        else if(modelAt(model)->score < 0)
+            negative.remove(model);
+    }
+    types.remove(type);
+    header()->types_num--;
+    header()->models_num -= car_type->models_num;
+    endWrite();
+    release(car_type->models, (uint64_t)car_type->models_num * sizeof(SharedModel));
+    release(type, sizeof(SharedType));
+    return SUCCESS;
+}
+
+/*0 if there is no such type or model*/
+uint64_t SharedCarDealershipManager::findModel(int typeId, int modelId)
+{
+    uint64_t type = findType(typeId);
+    if(!type || modelId >= typeAt(type)->models_num)
+        return 0;
+    return typeAt(type)->models + (uint64_t)modelId * sizeof(SharedModel);
+}
+
+StatusType SharedCarDealershipManager::SellCar(int typeId, int modelId)
+{
+    if(!base || typeId <= 0 || modelId < 0)
+        return INVALID_INPUT;
+    uint64_t model = findModel(typeId, modelId);
+    if(!model)
+        return FAILURE;
+    uint64_t type = findType(typeId);
+    ShmTree<SharedSalesOrder> sales(base, &header()->sales_root, offsetof(SharedModel, sales_links), { base });
+    beginWrite();
+    if(modelAt(model)->sales > 0)
+        sales.remove(model);
+    removeFromScoreTier(type, model);
+    modelAt(model)->sales++;
+    modelAt(model)->score += SAIL_POINTS;
+    //update this type best seller
+    SharedSalesOrder compSales = { base };
+    if(compSales(typeAt(type)->best_seller, model))
+        typeAt(type)->best_seller = model;
+    sales.insert(model);
+    addToScoreTier(type, model);
+    endWrite();
+    return SUCCESS;
+}
+
+StatusType SharedCarDealershipManager::MakeComplaint(int typeId, int modelId, int t)
+{
+    if(!base || typeId <= 0 || modelId < 0 || t <= 0)
+        return INVALID_INPUT;
+    uint64_t model = findModel(typeId, modelId);
+    if(!model)
+        return FAILURE;
+    uint64_t type = findType(typeId);
+    beginWrite();
+    removeFromScoreTier(type, model);
+    modelAt(model)->score -= (100 / t);
+    addToScoreTier(type, model);
+    endWrite();
+    return SUCCESS;
+}
+
+void SharedCarDealershipManager::removeFromScoreTier(uint64_t type, uint64_t model)
+{
+    int score = modelAt(model)->score;
+    uint64_t* root = score == 0 ? &typeAt(type)->zero_root : score > 0 ? &header()->pos_root : &header()->neg_root;
+    if(score == 0)
+        ShmTree<SharedModelNumOrder>(base, root, offsetof(SharedModel, score_links), { base }).remove(model);
+    else
+        ShmTree<SharedScoreOrder>(base, root, offsetof(SharedModel, score_links), { base }).remove(model);
+}
+
+void SharedCarDealershipManager::addToScoreTier(uint64_t type, uint64_t model)
+{
+    int score = modelAt(model)->score;
+    uint64_t* root = score == 0 ? &typeAt(type)->zero_root : score > 0 ? &header()->pos_root : &header()->neg_root;
+    if(score == 0)
+        ShmTree<SharedModelNumOrder>(base, root, offsetof(SharedModel, score_links), { base }).insert(model);
+    else
+        ShmTree<SharedScoreOrder>(base, root, offsetof(SharedModel, score_links), { base }).insert(model);
+}
+
+StatusType SharedCarDealershipManager::GetBestSellerModelByType(int typeId, int* modelId)
+{
+    if(!base)
+        return INVALID_INPUT;
+    SegmentView view = { base, size, &header()->seq, header()->seq.load(std::memory_order_relaxed) };
+    StatusType status = FAILURE;
+    bestSeller(view, typeId, modelId, status);
+    return status;
+}
+
+StatusType SharedCarDealershipManager::GetWorstModels(int numOfModels, int* types, int* models)
+{
+    if(!base)
+        return INVALID_INPUT;
+    SegmentView view = { base, size, &header()->seq, header()->seq.load(std::memory_order_relaxed) };
+    StatusType status = FAILURE;
+    worstModels(view, numOfModels, types, models, status);
+    return status;
+}
+
+/*************SharedDealershipReader application*******************************/
+
+SharedDealershipReader::SharedDealershipReader() : base(nullptr), size(0), retries(0) {}
+
+SharedDealershipReader::~SharedDealershipReader()
+{
+    if(base)
+        munmap((void*)base, size);
+}
+
+bool SharedDealershipReader::open(const char* name)
+{
+    if(base)
+        munmap((void*)base, size);
+    base = nullptr;
+    int fd = shm_open(name, O_RDONLY, 0);
+    if(fd < 0)
+        return false;
+    struct stat st;
+    void* mapped = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && (size_t)st.st_size >= FIRST_RECORD)
+        mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(mapped == MAP_FAILED)
+        return false;
+    const SharedHeader* shared = (const SharedHeader*)mapped;
+    if(__atomic_load_n(&shared->magic, __ATOMIC_ACQUIRE) != SHARED_MAGIC || shared->size != (uint64_t)st.st_size)
+    {
+        munmap(mapped, st.st_size);
+        return false;
+    }
+    base = (const char*)mapped;
+    size = st.st_size;
+    return true;
+}
+
+template<typename Query>
+StatusType SharedDealershipReader::read(Query query)
+{
+    if(!base)
+        return INVALID_INPUT;
+    const std::atomic<unsigned>& seq = ((const SharedHeader*)base)->seq;
+    while(true)
+    {
+        unsigned before = seq.load(std::memory_order_acquire);
+        if(before & 1)
+        {
+            /*a change is being made, let the writer finish it*/
+            std::this_thread::yield();
+            continue;
+        }
+        SegmentView view = { base, size, &seq, before };
+        StatusType status = FAILURE;
+        if(query(view, status))
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(seq.load(std::memory_order_relaxed) == before)
+                return status;
+        }
+        retries++;
+    }
+}
+
+StatusType SharedDealershipReader::GetBestSellerModelByType(int typeId, int* modelId)
+{
+    return read([typeId, modelId](const SegmentView& view, StatusType& status) {
+        return bestSeller(view, typeId, modelId, status);
+    });
+}
+
+StatusType SharedDealershipReader::GetWorstModels(int numOfModels, int* types, int* models)
+{
+    return read([numOfModels, types, models](const SegmentView& view, StatusType& status) {
+        return worstModels(view, numOfModels, types, models, status);
+    });
+}
+
+long long SharedDealershipReader::getRetries()
+{
+    return retries;
+}
@@ -0,0 +1,126 @@
+#ifndef SHARED_CAR_DEALER
+#define SHARED_CAR_DEALER
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "library.h"
+#include "ShmTree.h"
+
+namespace wet1
+{
+    /**
+     * Layout of a shared dealership segment. Everything - the header, types,
+     * models and their tree links - lives in one POSIX shared memory
+     * object and refers to the rest by offsets from its start, so each
+     * process may map it anywhere. The trees are the ones of
+     * CarDealershipManager: types by id, models by sales, the negative and
+     * positive score trees and a zero score tree per type.
+     */
+    struct SharedModel
+    {
+        int type, model, sales, score;
+        ShmLinks sales_links; //in the sales tree once sold
+        ShmLinks score_links; //in the negative, positive or its type's zero tree
+    };
+
+    struct SharedType
+    {
+        int typeId, models_num;
+        uint64_t models; //models_num SharedModels, by model number
+        uint64_t best_seller;
+        uint64_t zero_root;
+        ShmLinks links;
+    };
+
+    struct SharedHeader
+    {
+        uint64_t magic; //set last, once the segment is ready
+        uint64_t size;
+        /*odd while the writer changes what readers can reach*/
+        std::atomic<unsigned> seq;
+        int types_num, models_num;
+        uint64_t types_root, sales_root, neg_root, pos_root;
+        /*writer only - the end of the used space and a first fit list of freed runs*/
+        uint64_t top;
+        uint64_t free_runs;
+    };
+
+    /**
+     * The writer of a shared dealership - same operations and results as
+     * CarDealershipManager, with its state in a shared memory segment of a
+     * fixed size that SharedDealershipReaders map. Each change is made under
+     * the segment's sequence lock; new types are built before they are
+     * linked, so readers only wait for the tree updates themselves.
+     * ALLOCATION_ERROR once the segment is full.
+     */
+    class SharedCarDealershipManager
+    {
+        char* base;
+        size_t size;
+        char* name;
+
+        SharedHeader* header();
+        SharedType* typeAt(uint64_t offset);
+        SharedModel* modelAt(uint64_t offset);
+        /*0 if the segment is full*/
+        uint64_t allocate(uint64_t bytes);
+        void release(uint64_t offset, uint64_t bytes);
+        uint64_t findType(int typeId);
+        uint64_t findModel(int typeId, int modelId);
+        void beginWrite();
+        void endWrite();
+        void removeFromScoreTier(uint64_t type, uint64_t model);
+        void addToScoreTier(uint64_t type, uint64_t model);
+        void close();
+
+        public:
+            SharedCarDealershipManager();
+            ~SharedCarDealershipManager();
+            SharedCarDealershipManager(const SharedCarDealershipManager&) = delete;
+            SharedCarDealershipManager& operator=(const SharedCarDealershipManager&) = delete;
+            /**
+             * makes the shared memory object name ("/something") of size bytes,
+             * replacing an old one. The destructor unlinks it - readers that
+             * have it mapped keep it.
+             */
+            bool create(const char* name, size_t size);
+            StatusType AddCarType (int typeId, int numOfModels);
+            StatusType RemoveCarType (int typeId);
+            StatusType SellCar (int typeId, int modelId);
+            StatusType MakeComplaint (int typeId, int modelId, int t);
+            StatusType GetBestSellerModelByType (int typeId, int* modelId);
+            StatusType GetWorstModels (int numOfModels, int* types, int* models);
+    };
+
+    /**
+     * A read only mapping of a SharedCarDealershipManager's segment in any
+     * process. Queries run on the segment itself - no copy and no message to
+     * the writer. They retry while the writer is changing the trees or if it
+     * changed them under the query; every offset is checked before use, so a
+     * torn read is only ever a retry.
+     */
+    class SharedDealershipReader
+    {
+        const char* base;
+        size_t size;
+        long long retries;
+
+        /*runs query until it saw one version of the segment*/
+        template<typename Query>
+        StatusType read(Query query);
+
+        public:
+            SharedDealershipReader();
+            ~SharedDealershipReader();
+            SharedDealershipReader(const SharedDealershipReader&) = delete;
+            SharedDealershipReader& operator=(const SharedDealershipReader&) = delete;
+            /*false if there is no such segment or it is not ready yet*/
+            bool open(const char* name);
+            StatusType GetBestSellerModelByType (int typeId, int* modelId);
+            StatusType GetWorstModels (int numOfModels, int* types, int* models);
+            /*retries so far, for monitoring*/
+            long long getRetries();
+    };
+}
+#endif
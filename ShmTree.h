@@ -0,0 +1,212 @@
+#ifndef SHM_TREE_H
+#define SHM_TREE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace wet1
+{
+    /*tree links inside a record, as offsets from the start of the mapping - 0 is null*/
+    struct ShmLinks
+    {
+        uint64_t left, right, parent;
+        int height; //1 for a leaf
+        int unused;
+    };
+
+    /**
+     * AVL tree of records in one shared mapping. Nodes are linked by offsets
+     * instead of pointers, so processes that map the segment at different
+     * addresses all see the same tree. links_at is where the record keeps
+     * this tree's ShmLinks, so one record can be in several trees. Comp
+     * compares two record offsets. Writer side only - readers walk the links
+     * themselves, checking every offset.
+     */
+    template<typename Comp>
+    class ShmTree
+    {
+        char* base;
+        uint64_t* root; //in the segment
+        size_t links_at;
+        Comp comp;
+
+        ShmLinks& links(uint64_t node) {
+            return *(ShmLinks*)(base + node + links_at);
+        }
+
+        int height(uint64_t node) {
+            return node ? links(node).height : 0;
+        }
+
+        void updateHeight(uint64_t node) {
+            int left = height(links(node).left), right = height(links(node).right);
+            links(node).height = (left > right ? left : right) + 1;
+        }
+
+        /*puts child where node was under parent*/
+        void replaceChild(uint64_t parent, uint64_t node, uint64_t child) {
+            if (!parent)
+                *root = child;
+            else if (links(parent).left == node)
+                links(parent).left = child;
+            else
+                links(parent).right = child;
+        }
+
+        uint64_t rotateLeft(uint64_t node) {
+            uint64_t pivot = links(node).right;
+            uint64_t middle = links(pivot).left;
+            links(node).right = middle;
+            if (middle)
+                links(middle).parent = node;
+            links(pivot).parent = links(node).parent;
+            replaceChild(links(node).parent, node, pivot);
+            links(pivot).left = node;
+            links(node).parent = pivot;
+            updateHeight(node);
+            updateHeight(pivot);
+            return pivot;
+        }
+
+        uint64_t rotateRight(uint64_t node) {
+            uint64_t pivot = links(node).left;
+            uint64_t middle = links(pivot).right;
+            links(node).left = middle;
+            if (middle)
+                links(middle).parent = node;
+            links(pivot).parent = links(node).parent;
+            replaceChild(links(node).parent, node, pivot);
+            links(pivot).right = node;
+            links(node).parent = pivot;
+            updateHeight(node);
+            updateHeight(pivot);
+            return pivot;
+        }
+
+        /*fixes heights and balance from node up to the root*/
+        void retrace(uint64_t node) {
+            while (node) {
+                updateHeight(node);
+                int balance = height(links(node).left) - height(links(node).right);
+                if (balance > 1) {
+                    uint64_t left = links(node).left;
+                    if (height(links(left).left) < height(links(left).right))
+                        rotateLeft(left);
+                    node = rotateRight(node);
+                }
+                else if (balance < -1) {
+                    uint64_t right = links(node).right;
+                    if (height(links(right).right) < height(links(right).left))
+                        rotateRight(right);
+                    node = rotateLeft(node);
+                }
+                node = links(node).parent;
+            }
+        }
+
+        /*node has two children - trade places with its successor, which has no left child*/
+        void swapWithSuccessor(uint64_t node) {
+            uint64_t successor = links(node).right;
+            while (links(successor).left)
+                successor = links(successor).left;
+            ShmLinks old_node = links(node);
+            ShmLinks old_successor = links(successor);
+            links(successor).parent = old_node.parent;
+            replaceChild(old_node.parent, node, successor);
+            links(successor).left = old_node.left;
+            links(old_node.left).parent = successor;
+            links(successor).height = old_node.height;
+            if (old_node.right == successor) {
+                links(successor).right = node;
+                links(node).parent = successor;
+            }
+            else {
+                links(successor).right = old_node.right;
+                links(old_node.right).parent = successor;
+                links(node).parent = old_successor.parent;
+                links(old_successor.parent).left = node;
+            }
+            links(node).left = 0;
+            links(node).right = old_successor.right;
+            if (old_successor.right)
+                links(old_successor.right).parent = node;
+            links(node).height = old_successor.height;
+        }
+
+        template<typename NodeAt>
+        uint64_t build(NodeAt& node_at, int first, int last, uint64_t parent) {
+            if (first > last)
+                return 0;
+            int middle = first + (last - first) / 2;
+            uint64_t node = node_at(middle);
+            links(node).parent = parent;
+            links(node).left = build(node_at, first, middle - 1, node);
+            links(node).right = build(node_at, middle + 1, last, node);
+            updateHeight(node);
+            return node;
+        }
+
+    public:
+        ShmTree(char* base, uint64_t* root, size_t links_at, Comp comp = Comp()) : base(base), root(root),
+         links_at(links_at), comp(comp) {}
+
+        /*links a record that is in no tree*/
+        void insert(uint64_t node) {
+            uint64_t parent = 0;
+            uint64_t current = *root;
+            bool left = false;
+            while (current) {
+                parent = current;
+                left = comp(node, current);
+                current = left ? links(current).left : links(current).right;
+            }
+            links(node).parent = parent;
+            links(node).left = 0;
+            links(node).right = 0;
+            links(node).height = 1;
+            if (!parent)
+                *root = node;
+            else if (left)
+                links(parent).left = node;
+            else
+                links(parent).right = node;
+            retrace(parent);
+        }
+
+        /*unlinks a record of this tree*/
+        void remove(uint64_t node) {
+            if (links(node).left && links(node).right)
+                swapWithSuccessor(node);
+            uint64_t child = links(node).left ? links(node).left : links(node).right;
+            uint64_t parent = links(node).parent;
+            if (child)
+                links(child).parent = parent;
+            replaceChild(parent, node, child);
+            retrace(parent);
+        }
+
+        /**
+         * links count records, sorted by comp, into a perfectly balanced tree
+         * in O(count) - node_at(i) is the offset of the i-th. The tree must be
+         * empty.
+         */
+        template<typename NodeAt>
+        void build(NodeAt node_at, int count) {
+            *root = build(node_at, 0, count - 1, 0);
+        }
+
+        /*three way search, cmp(node) < 0 if the key is before node*/
+        template<typename Cmp>
+        uint64_t find(Cmp cmp) {
+            uint64_t node = *root;
+            while (node) {
+                int order = cmp(node);
+                if (order == 0)
+                    return node;
+                node = order < 0 ? links(node).left : links(node).right;
+            }
+            return 0;
+        }
+    };
+}
+#endif
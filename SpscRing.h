@@ -0,0 +1,59 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <stddef.h>
+
+namespace wet1
+{
+    /**
+     * Bounded single producer single consumer ring of CAPACITY (a power of
+     * two) items. Each side keeps a cached copy of the other side's index and
+     * only reloads it when the ring looks full / empty.
+     */
+    template<typename T, size_t CAPACITY>
+    class SpscRing {
+        static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+        alignas(64) std::atomic<size_t> head; //next item to pop
+        size_t cached_tail;
+        alignas(64) std::atomic<size_t> tail; //next free slot
+        size_t cached_head;
+        alignas(64) T* items;
+
+    public:
+        SpscRing() : head(0), cached_tail(0), tail(0), cached_head(0), items(new T[CAPACITY]) {}
+        ~SpscRing() {
+            delete[] items;
+        }
+        SpscRing(const SpscRing&) = delete;
+        SpscRing& operator=(const SpscRing&) = delete;
+
+        /*producer only, false if the ring is full*/
+        bool tryPush(const T& item) {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if (t - cached_head == CAPACITY) {
+                cached_head = head.load(std::memory_order_acquire);
+                if (t - cached_head == CAPACITY)
+                    return false;
+            }
+            items[t & (CAPACITY - 1)] = item;
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        /*consumer only, false if the ring is empty*/
+        bool tryPop(T& item) {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h == cached_tail) {
+                cached_tail = tail.load(std::memory_order_acquire);
+                if (h == cached_tail)
+                    return false;
+            }
+            item = items[h & (CAPACITY - 1)];
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+    };
+}
+#endif //SPSC_RING_H
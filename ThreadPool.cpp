@@ -0,0 +1,72 @@
+#include "ThreadPool.h"
+
+using namespace wet1;
+
+ThreadPool::ThreadPool(int threadsNum) : workers(), task(nullptr), tasks_num(0), next_task(0),
+ running(0), generation(0), stopping(false)
+{
+    for (int i = 1; i < threadsNum; i++)
+    {
+        workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+        work_ready.notify_all();
+    }
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+}
+
+int ThreadPool::getThreadsNum()
+{
+    return (int)workers.size() + 1;
+}
+
+void ThreadPool::drain(std::unique_lock<std::mutex>& guard)
+{
+    while(next_task < tasks_num)
+    {
+        int index = next_task++;
+        running++;
+        guard.unlock();
+        (*task)(index);
+        guard.lock();
+        running--;
+    }
+    if(running == 0)
+        work_done.notify_all();
+}
+
+void ThreadPool::workerLoop()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    unsigned long seen = generation;
+    while(true)
+    {
+        work_ready.wait(guard, [&] { return stopping || generation != seen; });
+        if(stopping)
+            return;
+        seen = generation;
+        drain(guard);
+    }
+}
+
+void ThreadPool::run(int tasksNum, const std::function<void(int)>& new_task)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    task = &new_task;
+    tasks_num = tasksNum;
+    next_task = 0;
+    generation++;
+    work_ready.notify_all();
+    drain(guard);
+    work_done.wait(guard, [&] { return next_task >= tasks_num && running == 0; });
+    task = nullptr;
+}
@@ -0,0 +1,43 @@
+#ifndef THREAD_POOL
+#define THREAD_POOL
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace wet1
+{
+    /**
+     * Fork join pool for splitting one call's work. run(n, task) calls
+     * task(0)..task(n - 1) on the workers and the calling thread and returns
+     * once all of them finished. Only one run at a time.
+     */
+    class ThreadPool
+    {
+        private:
+            std::vector<std::thread> workers;
+            std::mutex lock;
+            std::condition_variable work_ready;
+            std::condition_variable work_done;
+            const std::function<void(int)>* task;
+            int tasks_num, next_task, running;
+            unsigned long generation;
+            bool stopping;
+
+            void workerLoop();
+            /*runs tasks of the current generation until none is left, lock held*/
+            void drain(std::unique_lock<std::mutex>& guard);
+
+        public:
+            /*threadsNum includes the calling thread*/
+            explicit ThreadPool(int threadsNum);
+            ~ThreadPool();
+            ThreadPool(const ThreadPool&) = delete;
+            ThreadPool& operator=(const ThreadPool&) = delete;
+            int getThreadsNum();
+            void run(int tasksNum, const std::function<void(int)>& task);
+    };
+}
+#endif
@@ -0,0 +1,56 @@
+#include "Trace.h"
+#include <stdio.h>
+
+using namespace wet1;
+
+thread_local TraceBuffer* wet1::tree_trace = nullptr;
+std::atomic<int> wet1::tree_traces(0);
+
+int wet1::traceThreadId()
+{
+    static std::atomic<int> threads_num(0);
+    static thread_local int id = ++threads_num;
+    return id;
+}
+
+TraceBuffer::TraceBuffer(int capacity, bool trees) : events(nullptr), mask(0), next(0),
+ origin(readTicks()), trees(trees)
+{
+    uint64_t size = 1;
+    while(size < (uint64_t)capacity)
+        size <<= 1;
+    events = new TraceEvent[size];
+    mask = size - 1;
+    if(trees)
+        tree_traces++;
+}
+
+TraceBuffer::~TraceBuffer()
+{
+    if(trees)
+        tree_traces--;
+    delete[] events;
+}
+
+bool TraceBuffer::dump(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if(!file)
+        return false;
+    double ticks_per_us = ticksPerNanosecond() * 1000;
+    uint64_t end = next.load(std::memory_order_acquire);
+    uint64_t first = end > mask + 1 ? end - (mask + 1) : 0;
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"dealership\"}}");
+    for (uint64_t i = first; i < end; i++)
+    {
+        const TraceEvent& event = events[i & mask];
+        /*spans of operations that began before the buffer did*/
+        if(event.start < origin)
+            continue;
+        fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+            event.name, event.thread, (event.start - origin) / ticks_per_us, event.duration / ticks_per_us);
+    }
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
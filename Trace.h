@@ -0,0 +1,118 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <stdint.h>
+#include "OperationStats.h"
+
+namespace wet1
+{
+    struct TraceEvent
+    {
+        const char* name; //a string literal
+        uint64_t start;
+        uint64_t duration;
+        int thread;
+    };
+
+    /*small id of the calling thread, for the trace's tracks*/
+    int traceThreadId();
+
+    /**
+     * Fixed ring of the last spans, the oldest are overwritten. Recording
+     * takes a slot with one fetch_add, so pool workers record alongside the
+     * manager's thread without a lock. dump() writes the spans as Chrome
+     * trace JSON (Perfetto, chrome://tracing) - call it while no operation
+     * is running.
+     */
+    class TraceBuffer
+    {
+        TraceEvent* events;
+        uint64_t mask;
+        std::atomic<uint64_t> next;
+        uint64_t origin; //ticks at creation, the trace's time 0
+        bool trees;
+
+        public:
+            /*capacity is rounded up to a power of two, throws bad_alloc*/
+            TraceBuffer(int capacity, bool trees);
+            ~TraceBuffer();
+            TraceBuffer(const TraceBuffer&) = delete;
+            TraceBuffer& operator=(const TraceBuffer&) = delete;
+            /*true if tree rebalances and rebuilds get their own spans*/
+            bool tracesTrees() const
+            {
+                return trees;
+            }
+            void record(const char* name, uint64_t start, uint64_t end)
+            {
+                TraceEvent& event = events[next.fetch_add(1, std::memory_order_relaxed) & mask];
+                event.name = name;
+                event.start = start;
+                event.duration = end - start;
+                event.thread = traceThreadId();
+            }
+            /*false if the file can't be written*/
+            bool dump(const char* path);
+    };
+
+    /*the buffer AvlTree records into on this thread, nullptr when off*/
+    extern thread_local TraceBuffer* tree_trace;
+    /*buffers that trace trees - the TLS access is skipped while there are none*/
+    extern std::atomic<int> tree_traces;
+
+    inline TraceBuffer* treeTrace()
+    {
+        return tree_traces.load(std::memory_order_relaxed) ? tree_trace : nullptr;
+    }
+
+    /*records a span from construction to destruction, nothing for a nullptr buffer*/
+    class TraceSpan
+    {
+        TraceBuffer* buffer;
+        const char* name;
+        uint64_t start;
+
+        public:
+            TraceSpan(TraceBuffer* buffer, const char* name) : buffer(buffer), name(name),
+             start(buffer ? readTicks() : 0) {}
+            ~TraceSpan()
+            {
+                if(buffer)
+                    buffer->record(name, start, readTicks());
+            }
+            TraceSpan(const TraceSpan&) = delete;
+            TraceSpan& operator=(const TraceSpan&) = delete;
+    };
+
+    /**
+     * A span for a whole operation, or a task of one on a pool thread. Also
+     * points this thread's tree_trace at the buffer for its duration if it
+     * traces trees.
+     */
+    class TraceScope
+    {
+        TraceSpan span;
+        bool trees;
+        TraceBuffer* saved;
+
+        public:
+            TraceScope(TraceBuffer* buffer, const char* name) : span(buffer, name),
+             trees(buffer && buffer->tracesTrees()), saved(nullptr)
+            {
+                if(trees)
+                {
+                    saved = tree_trace;
+                    tree_trace = buffer;
+                }
+            }
+            ~TraceScope()
+            {
+                if(trees)
+                    tree_trace = saved;
+            }
+            TraceScope(const TraceScope&) = delete;
+            TraceScope& operator=(const TraceScope&) = delete;
+    };
+}
+#endif
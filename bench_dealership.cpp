@@ -0,0 +1,559 @@
+/*
+ * bench_dealership - drives the library.h API with a synthetic trace and
+ * reports throughput and p50/p99/p999 latency per operation.
+ *
+ *   bench_dealership [--ops N] [--types N] [--models N] [--zipf S]
+ *                    [--complaint-rate R] [--remove-rate R]
+ *                    [--best-rate R] [--worst-rate R] [--worst-n N]
+ *                    [--seed N] [--emit <commands.txt>]
+ *                    [--backend library|sharded|concurrent|async|shared]
+ *                    [--threads N[,N...]] [--shards N] [--coalesce 0|1]
+ *
+ * Sold and complained models are picked with a Zipf(S) distribution over all
+ * models. A removed type is added back right away so the population stays the
+ * same. The rates are fractions of --ops, the rest are SellCar. --emit writes
+ * the generated trace in the shell's format instead of running it.
+ *
+ * --backend picks what the trace runs on: the library.h API (the default,
+ * one thread only) or one of the thread safe front ends. With --threads the
+ * --ops are split between that many threads, each with its own trace
+ * (seed + thread). A list of thread counts runs the trace once per count on
+ * a fresh backend and prints the throughput of each - reads are
+ * GetBestSellerModelByType and GetWorstModels. For the lock free reads of
+ * the concurrent backend, e.g.
+ *
+ *   bench_dealership --backend concurrent --best-rate 0.9 --threads 1,2,4,8
+ *
+ * The async backend only enqueues the mutations, the run ends once they
+ * were all applied. --coalesce 0 applies them one by one, for the gain of
+ * coalescing.
+ *
+ * The shared backend keeps the dealership in a shared memory segment. The
+ * mutations go to its single writer one thread at a time, and each thread
+ * reads through its own SharedDealershipReader mapping, as a separate
+ * reader process would.
+ */
+#include "library.h"
+#include "AsyncCarDealershipManager.h"
+#include "ConcurrentCarDealershipManager.h"
+#include "ShardedCarDealershipManager.h"
+#include "SharedCarDealershipManager.h"
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace wet1;
+
+namespace
+{
+    enum Op {
+        OP_ADD, OP_REMOVE, OP_SELL, OP_COMPLAIN, OP_BEST, OP_WORST, OPS_NUM
+    };
+    const char* op_names[OPS_NUM] = {
+        "AddCarType", "RemoveCarType", "SellCar", "MakeComplaint",
+        "GetBestSellerModelByType", "GetWorstModels"
+    };
+
+    struct Options
+    {
+        long ops = 1000000;
+        int types = 1000;
+        int models = 100;
+        double zipf = 0.99;
+        double complaint_rate = 0.2;
+        double remove_rate = 0.001;
+        double best_rate = 0.1;
+        double worst_rate = 0.001;
+        int worst_n = 100;
+        unsigned seed = 1;
+        const char* emit = nullptr;
+        const char* backend = "library";
+        std::vector<int> threads;
+        int shards = 16;
+        bool coalesce = true;
+    };
+
+    struct TraceOp
+    {
+        Op op;
+        int type, model, arg;
+    };
+
+    bool parseOptions(int argc, const char** argv, Options& options)
+    {
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            const char* name = argv[i];
+            const char* value = argv[i + 1];
+            if(strcmp(name, "--ops") == 0) options.ops = atol(value);
+            else if(strcmp(name, "--types") == 0) options.types = atoi(value);
+            else if(strcmp(name, "--models") == 0) options.models = atoi(value);
+            else if(strcmp(name, "--zipf") == 0) options.zipf = atof(value);
+            else if(strcmp(name, "--complaint-rate") == 0) options.complaint_rate = atof(value);
+            else if(strcmp(name, "--remove-rate") == 0) options.remove_rate = atof(value);
+            else if(strcmp(name, "--best-rate") == 0) options.best_rate = atof(value);
+            else if(strcmp(name, "--worst-rate") == 0) options.worst_rate = atof(value);
+            else if(strcmp(name, "--worst-n") == 0) options.worst_n = atoi(value);
+            else if(strcmp(name, "--seed") == 0) options.seed = (unsigned)atol(value);
+            else if(strcmp(name, "--emit") == 0) options.emit = value;
+            else if(strcmp(name, "--backend") == 0) options.backend = value;
+            else if(strcmp(name, "--shards") == 0) options.shards = atoi(value);
+            else if(strcmp(name, "--coalesce") == 0) options.coalesce = atoi(value) != 0;
+            else if(strcmp(name, "--threads") == 0)
+            {
+                for (const char* count = value; count; count = strchr(count, ','))
+                {
+                    if(*count == ',')
+                        count++;
+                    options.threads.push_back(atoi(count));
+                }
+            }
+            else return false;
+        }
+        if(options.threads.empty())
+            options.threads.push_back(1);
+        for (int threads : options.threads)
+        {
+            if(threads <= 0)
+                return false;
+        }
+        return argc % 2 == 1 && options.ops > 0 && options.types > 0 &&
+            options.models > 0 && options.worst_n > 0 && options.shards > 0;
+    }
+
+    /*rank r of the Zipf distribution is model r / types of type r % types,
+     * so the hot models are spread over all the types*/
+    class ZipfPicker
+    {
+        std::vector<double> cdf;
+
+        public:
+            ZipfPicker(long n, double s) : cdf(n)
+            {
+                double sum = 0;
+                for (long i = 0; i < n; i++)
+                {
+                    sum += 1.0 / pow((double)(i + 1), s);
+                    cdf[i] = sum;
+                }
+                for (long i = 0; i < n; i++)
+                {
+                    cdf[i] /= sum;
+                }
+            }
+            template<typename Rng>
+            long pick(Rng& rng)
+            {
+                double u = std::uniform_real_distribution<double>(0, 1)(rng);
+                long rank = std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+                return rank < (long)cdf.size() ? rank : (long)cdf.size() - 1;
+            }
+    };
+
+    std::vector<TraceOp> generate(const Options& options)
+    {
+        std::mt19937_64 rng(options.seed);
+        ZipfPicker zipf((long)options.types * options.models, options.zipf);
+        std::uniform_real_distribution<double> coin(0, 1);
+        std::uniform_int_distribution<int> any_type(1, options.types);
+        std::uniform_int_distribution<int> complaint_months(1, 12);
+        std::vector<TraceOp> trace;
+        trace.reserve(options.ops);
+        for (long i = 0; i < options.ops; i++)
+        {
+            double u = coin(rng);
+            TraceOp op = { OP_SELL, 0, 0, 0 };
+            if((u -= options.remove_rate) < 0)
+            {
+                op.op = OP_REMOVE;
+                op.type = any_type(rng);
+                trace.push_back(op);
+                op.op = OP_ADD;
+                op.arg = options.models;
+            }
+            else if((u -= options.worst_rate) < 0)
+            {
+                op.op = OP_WORST;
+                op.arg = options.worst_n;
+            }
+            else if((u -= options.best_rate) < 0)
+            {
+                op.op = OP_BEST;
+                op.type = coin(rng) < 0.05 ? 0 : any_type(rng);
+            }
+            else
+            {
+                op.op = (u -= options.complaint_rate) < 0 ? OP_COMPLAIN : OP_SELL;
+                long rank = zipf.pick(rng);
+                op.type = (int)(rank % options.types) + 1;
+                op.model = (int)(rank / options.types);
+                op.arg = complaint_months(rng);
+            }
+            trace.push_back(op);
+        }
+        return trace;
+    }
+
+    void emit(const Options& options, const std::vector<TraceOp>& trace)
+    {
+        FILE* out = fopen(options.emit, "w");
+        if(!out)
+        {
+            fprintf(stderr, "can't write %s\n", options.emit);
+            return;
+        }
+        fprintf(out, "Init\n");
+        for (int type = 1; type <= options.types; type++)
+        {
+            fprintf(out, "AddCarType %d %d\n", type, options.models);
+        }
+        for (const TraceOp& op : trace)
+        {
+            switch(op.op)
+            {
+                case OP_ADD: fprintf(out, "AddCarType %d %d\n", op.type, op.arg); break;
+                case OP_REMOVE: fprintf(out, "RemoveCarType %d\n", op.type); break;
+                case OP_SELL: fprintf(out, "SellCar %d %d\n", op.type, op.model); break;
+                case OP_COMPLAIN:
+                    fprintf(out, "MakeComplaint %d %d %d\n", op.type, op.model, op.arg);
+                    break;
+                case OP_BEST: fprintf(out, "GetBestSellerModelByType %d\n", op.type); break;
+                case OP_WORST: fprintf(out, "GetWorstModels %d\n", op.arg); break;
+                default: break;
+            }
+        }
+        fprintf(out, "Quit\n");
+        fclose(out);
+    }
+
+    long percentile(std::vector<long>& latencies, double p)
+    {
+        if(latencies.empty())
+            return 0;
+        size_t index = (size_t)(p * (latencies.size() - 1));
+        return latencies[index];
+    }
+
+    /*what a trace runs on - thread is the index of the calling bench thread*/
+    class Backend
+    {
+        public:
+            virtual ~Backend() {}
+            /*false if it can only be called from one thread*/
+            virtual bool threadSafe() = 0;
+            virtual StatusType add(int thread, int type, int models) = 0;
+            virtual StatusType remove(int thread, int type) = 0;
+            virtual StatusType sell(int thread, int type, int model) = 0;
+            virtual StatusType complain(int thread, int type, int model, int t) = 0;
+            virtual StatusType best(int thread, int type, int* model) = 0;
+            virtual StatusType worst(int thread, int n, int* types, int* models) = 0;
+            /*waits for work the backend took but did not finish yet*/
+            virtual void finish() {}
+    };
+
+    class LibraryBackend : public Backend
+    {
+        void* DS;
+
+        public:
+            LibraryBackend() : DS(Init()) {}
+            ~LibraryBackend() { Quit(&DS); }
+            bool threadSafe() { return false; }
+            StatusType add(int, int type, int models) { return AddCarType(DS, type, models); }
+            StatusType remove(int, int type) { return RemoveCarType(DS, type); }
+            StatusType sell(int, int type, int model) { return SellCar(DS, type, model); }
+            StatusType complain(int, int type, int model, int t) { return MakeComplaint(DS, type, model, t); }
+            StatusType best(int, int type, int* model) { return GetBestSellerModelByType(DS, type, model); }
+            StatusType worst(int, int n, int* types, int* models) { return GetWorstModels(DS, n, types, models); }
+    };
+
+    class ShardedBackend : public Backend
+    {
+        ShardedCarDealershipManager manager;
+
+        public:
+            explicit ShardedBackend(int shards) : manager(shards) {}
+            bool threadSafe() { return true; }
+            StatusType add(int, int type, int models) { return manager.AddCarType(type, models); }
+            StatusType remove(int, int type) { return manager.RemoveCarType(type); }
+            StatusType sell(int, int type, int model) { return manager.SellCar(type, model); }
+            StatusType complain(int, int type, int model, int t) { return manager.MakeComplaint(type, model, t); }
+            StatusType best(int, int type, int* model) { return manager.GetBestSellerModelByType(type, model); }
+            StatusType worst(int, int n, int* types, int* models) { return manager.GetWorstModels(n, types, models); }
+    };
+
+    class ConcurrentBackend : public Backend
+    {
+        ConcurrentCarDealershipManager manager;
+
+        public:
+            /*the reclaimer's slots are cache line aligned - plain new only is since C++17*/
+            static void* operator new(size_t size)
+            {
+                void* memory = nullptr;
+                if(posix_memalign(&memory, alignof(ConcurrentBackend), size) != 0)
+                    throw std::bad_alloc();
+                return memory;
+            }
+            static void operator delete(void* memory) { free(memory); }
+            bool threadSafe() { return true; }
+            StatusType add(int, int type, int models) { return manager.AddCarType(type, models); }
+            StatusType remove(int, int type) { return manager.RemoveCarType(type); }
+            StatusType sell(int, int type, int model) { return manager.SellCar(type, model); }
+            StatusType complain(int, int type, int model, int t) { return manager.MakeComplaint(type, model, t); }
+            StatusType best(int, int type, int* model) { return manager.GetBestSellerModelByType(type, model); }
+            StatusType worst(int, int n, int* types, int* models) { return manager.GetWorstModels(n, types, models); }
+    };
+
+    class AsyncBackend : public Backend
+    {
+        AsyncCarDealershipManager manager;
+
+        public:
+            explicit AsyncBackend(bool coalesce) : manager(coalesce) {}
+            bool threadSafe() { return true; }
+            StatusType add(int, int type, int models) { return manager.AddCarType(type, models, nullptr); }
+            StatusType remove(int, int type) { return manager.RemoveCarType(type, nullptr); }
+            StatusType sell(int, int type, int model) { return manager.SellCar(type, model, nullptr); }
+            StatusType complain(int, int type, int model, int t)
+            {
+                return manager.MakeComplaint(type, model, t, nullptr);
+            }
+            StatusType best(int, int type, int* model) { return manager.GetBestSellerModelByType(type, model); }
+            StatusType worst(int, int n, int* types, int* models) { return manager.GetWorstModels(n, types, models); }
+            void finish() { manager.sync(); }
+    };
+
+    class SharedBackend : public Backend
+    {
+        SharedCarDealershipManager writer;
+        std::mutex write_lock;
+        std::vector<std::unique_ptr<SharedDealershipReader> > readers;
+
+        public:
+            /*false if the segment could not be made or mapped*/
+            bool open(const Options& options, int threads)
+            {
+                char name[64];
+                snprintf(name, sizeof(name), "/bench_dealership_%d", (int)getpid());
+                /*twice the full population, for the free list's leftovers, and the header*/
+                size_t type_size = sizeof(SharedType) + (size_t)options.models * sizeof(SharedModel);
+                if(!writer.create(name, 2 * (size_t)options.types * type_size + (1 << 20)))
+                    return false;
+                for (int thread = 0; thread < threads; thread++)
+                {
+                    readers.emplace_back(new SharedDealershipReader());
+                    if(!readers.back()->open(name))
+                        return false;
+                }
+                return true;
+            }
+            bool threadSafe() { return true; }
+            StatusType add(int, int type, int models)
+            {
+                std::lock_guard<std::mutex> guard(write_lock);
+                return writer.AddCarType(type, models);
+            }
+            StatusType remove(int, int type)
+            {
+                std::lock_guard<std::mutex> guard(write_lock);
+                return writer.RemoveCarType(type);
+            }
+            StatusType sell(int, int type, int model)
+            {
+                std::lock_guard<std::mutex> guard(write_lock);
+                return writer.SellCar(type, model);
+            }
+            StatusType complain(int, int type, int model, int t)
+            {
+                std::lock_guard<std::mutex> guard(write_lock);
+                return writer.MakeComplaint(type, model, t);
+            }
+            StatusType best(int thread, int type, int* model)
+            {
+                return readers[thread]->GetBestSellerModelByType(type, model);
+            }
+            StatusType worst(int thread, int n, int* types, int* models)
+            {
+                return readers[thread]->GetWorstModels(n, types, models);
+            }
+    };
+
+    /*nullptr, after saying why, if there is no such backend or it can't start*/
+    Backend* newBackend(const Options& options, int threads)
+    {
+        if(strcmp(options.backend, "library") == 0)
+            return new LibraryBackend();
+        if(strcmp(options.backend, "sharded") == 0)
+            return new ShardedBackend(options.shards);
+        if(strcmp(options.backend, "concurrent") == 0)
+            return new ConcurrentBackend();
+        if(strcmp(options.backend, "async") == 0)
+            return new AsyncBackend(options.coalesce);
+        if(strcmp(options.backend, "shared") == 0)
+        {
+            std::unique_ptr<SharedBackend> backend(new SharedBackend());
+            if(!backend->open(options, threads))
+            {
+                fprintf(stderr, "no shared memory segment for the shared backend\n");
+                return nullptr;
+            }
+            return backend.release();
+        }
+        fprintf(stderr, "unknown backend %s\n", options.backend);
+        return nullptr;
+    }
+
+    struct ThreadResult
+    {
+        std::vector<long> latencies[OPS_NUM];
+        long failures[OPS_NUM];
+    };
+
+    void runTrace(Backend& backend, int thread, const std::vector<TraceOp>& trace, int worst_n,
+         ThreadResult& result)
+    {
+        typedef std::chrono::steady_clock Clock;
+        std::vector<int> types(worst_n), models(worst_n);
+        std::fill(result.failures, result.failures + OPS_NUM, 0);
+        for (const TraceOp& op : trace)
+        {
+            Clock::time_point start = Clock::now();
+            StatusType status = SUCCESS;
+            int model;
+            switch(op.op)
+            {
+                case OP_ADD: status = backend.add(thread, op.type, op.arg); break;
+                case OP_REMOVE: status = backend.remove(thread, op.type); break;
+                case OP_SELL: status = backend.sell(thread, op.type, op.model); break;
+                case OP_COMPLAIN: status = backend.complain(thread, op.type, op.model, op.arg); break;
+                case OP_BEST: status = backend.best(thread, op.type, &model); break;
+                case OP_WORST: status = backend.worst(thread, op.arg, types.data(), models.data()); break;
+                default: break;
+            }
+            long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+            result.latencies[op.op].push_back(ns);
+            if(status != SUCCESS)
+                result.failures[op.op]++;
+        }
+    }
+
+    /*one run on a fresh backend with threads threads, false if the backend can't*/
+    bool run(const Options& options, int threads, bool print_ops)
+    {
+        typedef std::chrono::steady_clock Clock;
+        std::unique_ptr<Backend> backend(newBackend(options, threads));
+        if(!backend)
+            return false;
+        if(threads > 1 && !backend->threadSafe())
+        {
+            fprintf(stderr, "backend %s runs on one thread only\n", options.backend);
+            return false;
+        }
+        std::vector<std::vector<TraceOp> > traces(threads);
+        for (int thread = 0; thread < threads; thread++)
+        {
+            Options thread_options = options;
+            thread_options.seed = options.seed + thread;
+            thread_options.ops = options.ops / threads + (thread < options.ops % threads);
+            traces[thread] = generate(thread_options);
+        }
+        Clock::time_point setup_start = Clock::now();
+        for (int type = 1; type <= options.types; type++)
+        {
+            backend->add(0, type, options.models);
+        }
+        backend->finish();
+        double setup_sec = std::chrono::duration<double>(Clock::now() - setup_start).count();
+
+        std::vector<ThreadResult> results(threads);
+        Clock::time_point run_start = Clock::now();
+        if(threads == 1)
+            runTrace(*backend, 0, traces[0], options.worst_n, results[0]);
+        else
+        {
+            std::vector<std::thread> workers;
+            for (int thread = 0; thread < threads; thread++)
+            {
+                workers.emplace_back(runTrace, std::ref(*backend), thread, std::cref(traces[thread]),
+                    options.worst_n, std::ref(results[thread]));
+            }
+            for (std::thread& worker : workers)
+            {
+                worker.join();
+            }
+        }
+        backend->finish();
+        double run_sec = std::chrono::duration<double>(Clock::now() - run_start).count();
+
+        std::vector<long> latencies[OPS_NUM];
+        long failures[OPS_NUM] = { 0 };
+        size_t ops = 0, reads = 0;
+        for (ThreadResult& result : results)
+        {
+            for (int i = 0; i < OPS_NUM; i++)
+            {
+                latencies[i].insert(latencies[i].end(), result.latencies[i].begin(), result.latencies[i].end());
+                failures[i] += result.failures[i];
+                ops += result.latencies[i].size();
+            }
+            reads += result.latencies[OP_BEST].size() + result.latencies[OP_WORST].size();
+        }
+        if(!print_ops)
+        {
+            printf("%-8d %12.3f %12.3f %12.3f\n", threads, ops / run_sec / 1e6, reads / run_sec / 1e6,
+                (ops - reads) / run_sec / 1e6);
+            return true;
+        }
+        printf("setup: %d types x %d models in %.3f s\n", options.types, options.models, setup_sec);
+        printf("run: %zu ops on %d thread%s in %.3f s, %.3f Mops/s\n", ops, threads,
+            threads == 1 ? "" : "s", run_sec, ops / run_sec / 1e6);
+        printf("%-26s %10s %8s %10s %10s %10s\n", "op", "count", "failed", "p50 ns", "p99 ns", "p999 ns");
+        for (int i = 0; i < OPS_NUM; i++)
+        {
+            std::vector<long>& op_latencies = latencies[i];
+            if(op_latencies.empty())
+                continue;
+            std::sort(op_latencies.begin(), op_latencies.end());
+            printf("%-26s %10zu %8ld %10ld %10ld %10ld\n", op_names[i], op_latencies.size(),
+                failures[i], percentile(op_latencies, 0.5), percentile(op_latencies, 0.99),
+                percentile(op_latencies, 0.999));
+        }
+        return true;
+    }
+}
+
+int main(int argc, const char** argv)
+{
+    Options options;
+    if(!parseOptions(argc, argv, options))
+    {
+        fprintf(stderr, "usage: see the comment at the top of bench_dealership.cpp\n");
+        return 1;
+    }
+    if(options.emit)
+    {
+        emit(options, generate(options));
+        return 0;
+    }
+    if(options.threads.size() == 1)
+        return run(options, options.threads[0], true) ? 0 : 1;
+    printf("backend %s\n", options.backend);
+    printf("%-8s %12s %12s %12s\n", "threads", "Mops/s", "read Mops/s", "write Mops/s");
+    for (int threads : options.threads)
+    {
+        if(!run(options, threads, false))
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * bench_lookup - GetBestSellerModelByType one call at a time against
+ * GetBestSellerModelByTypeBatch, on many types so the lookups miss the cache.
+ *
+ *   bench_lookup [--types N] [--queries N] [--batch N] [--seed N]
+ *
+ * Both runs answer the same random type ids and their answers are compared.
+ */
+#include "library.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        int types = 4000000;
+        int queries = 4000000;
+        int batch = 256;
+        unsigned seed = 1;
+    };
+
+    bool parseOptions(int argc, const char** argv, Options& options)
+    {
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            const char* name = argv[i];
+            const char* value = argv[i + 1];
+            if(strcmp(name, "--types") == 0) options.types = atoi(value);
+            else if(strcmp(name, "--queries") == 0) options.queries = atoi(value);
+            else if(strcmp(name, "--batch") == 0) options.batch = atoi(value);
+            else if(strcmp(name, "--seed") == 0) options.seed = (unsigned)atol(value);
+            else return false;
+        }
+        return argc % 2 == 1 && options.types > 0 && options.queries > 0 && options.batch > 0;
+    }
+
+    double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int main(int argc, const char** argv)
+{
+    Options options;
+    if(!parseOptions(argc, argv, options))
+    {
+        fprintf(stderr, "usage: bench_lookup [--types N] [--queries N] [--batch N] [--seed N]\n");
+        return 1;
+    }
+    void* ds = Init();
+    /*shuffled ids so neighbouring types are not neighbours in memory*/
+    std::mt19937 rng(options.seed);
+    std::vector<int> ids(options.types);
+    for (int i = 0; i < options.types; i++)
+    {
+        ids[i] = i + 1;
+    }
+    std::shuffle(ids.begin(), ids.end(), rng);
+    for (int i = 0; i < options.types; i++)
+    {
+        AddCarType(ds, ids[i], 1 + ids[i] % 3);
+        SellCar(ds, ids[i], ids[i] % 3 == 2 ? 1 : 0);
+    }
+    /*a few missing ids as well*/
+    std::vector<int> queries(options.queries);
+    for (int i = 0; i < options.queries; i++)
+    {
+        queries[i] = 1 + (int)(rng() % (unsigned)(options.types + options.types / 16));
+    }
+
+    std::vector<int> single_models(options.queries);
+    std::vector<StatusType> single_results(options.queries);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.queries; i++)
+    {
+        single_results[i] = GetBestSellerModelByType(ds, queries[i], &single_models[i]);
+    }
+    double single_seconds = secondsSince(start);
+
+    std::vector<int> batch_models(options.queries);
+    std::vector<StatusType> batch_results(options.queries);
+    start = std::chrono::steady_clock::now();
+    for (int first = 0; first < options.queries; first += options.batch)
+    {
+        int count = options.queries - first < options.batch ? options.queries - first : options.batch;
+        GetBestSellerModelByTypeBatch(ds, count, &queries[first], &batch_models[first], &batch_results[first]);
+    }
+    double batch_seconds = secondsSince(start);
+
+    for (int i = 0; i < options.queries; i++)
+    {
+        if(single_results[i] != batch_results[i] ||
+           (single_results[i] == SUCCESS && single_models[i] != batch_models[i]))
+        {
+            fprintf(stderr, "mismatch at query %d (type %d)\n", i, queries[i]);
+            return 1;
+        }
+    }
+    printf("types %d, queries %d, batch %d\n", options.types, options.queries, options.batch);
+    printf("one at a time  %8.1f ns/lookup\n", single_seconds * 1e9 / options.queries);
+    printf("batched        %8.1f ns/lookup  (%.2fx)\n", batch_seconds * 1e9 / options.queries,
+           single_seconds / batch_seconds);
+    Quit(&ds);
+    return 0;
+}
@@ -1,56 +1,159 @@
 #include"library.h"
 #include"CarDealershipManager.h"
+#include<stdlib.h>
+
+/*spans kept when WET1_TRACE turns tracing on*/
+#define TRACE_DEFAULT_CAPACITY (1 << 20)
 
 using namespace wet1;
 
 void *Init()
 {
     CarDealershipManager *DS = new CarDealershipManager ();
+    const char* trace_path = getenv("WET1_TRACE");
+    if(trace_path && *trace_path)
+        DS->EnableTracing(TRACE_DEFAULT_CAPACITY, getenv("WET1_TRACE_TREES") != NULL, trace_path);
     return (void*)DS;
 }
 
 StatusType AddCarType(void *DS, int typeID, int numOfModels) {
     if(DS == NULL)
         return INVALID_INPUT;
-    return ((CarDealershipManager *)DS)-> AddCarType(typeID, numOfModels);
+    CarDealershipManager* manager = (CarDealershipManager *)DS;
+    OperationTimer timer(manager->getOperationStats(), STATS_ADD_CAR_TYPE);
+    return manager->AddCarType(typeID, numOfModels);
 }
 
 StatusType RemoveCarType(void *DS, int typeID)
 {
     if(DS == NULL)
         return INVALID_INPUT;
-    return ((CarDealershipManager *)DS)-> RemoveCarType(typeID);
+    CarDealershipManager* manager = (CarDealershipManager *)DS;
+    OperationTimer timer(manager->getOperationStats(), STATS_REMOVE_CAR_TYPE);
+    return manager->RemoveCarType(typeID);
 }
 
 StatusType SellCar(void *DS, int typeID, int modelID)
 {
     if(DS == NULL)
         return INVALID_INPUT;
-    return ((CarDealershipManager *)DS)-> SellCar(typeID, modelID);
+    CarDealershipManager* manager = (CarDealershipManager *)DS;
+    OperationTimer timer(manager->getOperationStats(), STATS_SELL_CAR);
+    return manager->SellCar(typeID, modelID);
 }
 
 StatusType MakeComplaint(void *DS, int typeID, int modelID, int t)
 {
     if(DS == NULL)
         return INVALID_INPUT;
-    return ((CarDealershipManager *)DS)-> MakeComplaint(typeID, modelID, t);
+    CarDealershipManager* manager = (CarDealershipManager *)DS;
+    OperationTimer timer(manager->getOperationStats(), STATS_MAKE_COMPLAINT);
+    return manager->MakeComplaint(typeID, modelID, t);
 }
 
 StatusType GetBestSellerModelByType(void *DS, int typeID, int * modelID)
 {
     if(DS == NULL)
         return INVALID_INPUT;
-    return ((CarDealershipManager *)DS)-> GetBestSellerModelByType(typeID, modelID);
+    CarDealershipManager* manager = (CarDealershipManager *)DS;
+    OperationTimer timer(manager->getOperationStats(), STATS_GET_BEST_SELLER_MODEL_BY_TYPE);
+    return manager->GetBestSellerModelByType(typeID, modelID);
 }
 
 StatusType GetWorstModels(void *DS, int numOfModels, int *types, int *models)
 {
     if(DS == NULL)
         return INVALID_INPUT;
-    return ((CarDealershipManager *)DS)-> GetWorstModels(numOfModels, types, models);
+    CarDealershipManager* manager = (CarDealershipManager *)DS;
+    OperationTimer timer(manager->getOperationStats(), STATS_GET_WORST_MODELS);
+    return manager->GetWorstModels(numOfModels, types, models);
+}
+
+StatusType GetWorstModelsByType(void *DS, int typeID, int numOfModels, int *models)
+{
+    if(DS == NULL)
+        return INVALID_INPUT;
+    return ((CarDealershipManager *)DS)-> GetWorstModelsByType(typeID, numOfModels, models);
+}
+
+StatusType GetBestSellerModelByTypeBatch(void *DS, int n, const int *typeIDs, int *modelIDs,
+                                         StatusType *results)
+{
+    if(DS == NULL)
+        return INVALID_INPUT;
+    return ((CarDealershipManager *)DS)-> GetBestSellerModelByTypeBatch(n, typeIDs, modelIDs, results);
+}
+
+StatusType CountModelsInScoreRange(void *DS, int lo, int hi, int *count)
+{
+    if(DS == NULL)
+        return INVALID_INPUT;
+    return ((CarDealershipManager *)DS)-> CountModelsInScoreRange(lo, hi, count);
+}
+
+StatusType EnumerateModelsInScoreRange(void *DS, int lo, int hi, ModelVisitor visitor, void *context)
+{
+    if(DS == NULL)
+        return INVALID_INPUT;
+    return ((CarDealershipManager *)DS)-> EnumerateModelsInScoreRange(lo, hi, visitor, context);
+}
+
+StatusType CompactStep(void *DS, int budget, int *done)
+{
+    if(DS == NULL || done == NULL)
+        return INVALID_INPUT;
+    bool laid_out = false;
+    StatusType status = ((CarDealershipManager *)DS)-> CompactStep(budget, &laid_out);
+    *done = laid_out ? 1 : 0;
+    return status;
+}
+
+StatusType SetWorstModelsCacheSize(void *DS, int cacheSize)
+{
+    if(DS == NULL)
+        return INVALID_INPUT;
+    return ((CarDealershipManager *)DS)-> SetWorstModelsCacheSize(cacheSize);
+}
+
+StatusType SetModelMemoryBudget(void *DS, long long bytes)
+{
+    if(DS == NULL)
+        return INVALID_INPUT;
+    return ((CarDealershipManager *)DS)-> SetModelMemoryBudget(bytes);
+}
+
+StatusType SetWorkThreads(void *DS, int threads)
+{
+    if(DS == NULL)
+        return INVALID_INPUT;
+    return ((CarDealershipManager *)DS)-> SetWorkThreads(threads);
+}
+
+StatusType GetStats(void *DS, DealershipStats *stats)
+{
+    if(DS == NULL)
+        return INVALID_INPUT;
+    return ((CarDealershipManager *)DS)-> GetStats(stats);
+}
+
+StatusType EnableTracing(void *DS, int capacity, TraceDetail detail, const char *quitPath)
+{
+    if(DS == NULL)
+        return INVALID_INPUT;
+    return ((CarDealershipManager *)DS)-> EnableTracing(capacity, detail == TRACE_TREES, quitPath);
+}
+
+StatusType DumpTrace(void *DS, const char *path)
+{
+    if(DS == NULL || path == NULL)
+        return INVALID_INPUT;
+    return ((CarDealershipManager *)DS)-> DumpTrace(path);
 }
 
 void Quit(void** DS)
 {
+    if(*DS != NULL)
+        ((CarDealershipManager *)(*DS))-> DumpTrace(NULL);
     delete (CarDealershipManager *)(*DS);
+    *DS = NULL;
 }
\ No newline at end of file
@@ -27,6 +27,40 @@ typedef enum {
     INVALID_INPUT = -3
 } StatusType;
 
+/* Stats
+ * -----------------------------------
+ * Latencies are kept per API call in log-linear (HDR style) histograms of
+ * timestamp counter ticks: each power of two is split into
+ * STATS_SUB_BUCKETS linear buckets, see StatsBucketLowerBound(). Ticks
+ * are converted to nanoseconds with ticks_per_ns. */
+typedef enum {
+    STATS_ADD_CAR_TYPE = 0,
+    STATS_REMOVE_CAR_TYPE = 1,
+    STATS_SELL_CAR = 2,
+    STATS_MAKE_COMPLAINT = 3,
+    STATS_GET_BEST_SELLER_MODEL_BY_TYPE = 4,
+    STATS_GET_WORST_MODELS = 5,
+    STATS_OPS_NUM = 6
+} StatsOperation;
+
+#define STATS_SUB_BUCKETS (4)
+#define STATS_HISTOGRAM_BUCKETS (128)
+#define STATS_HEIGHT_UNTRACKED (-2)
+
+typedef struct {
+    long long calls[STATS_OPS_NUM];
+    long long histogram[STATS_OPS_NUM][STATS_HISTOGRAM_BUCKETS];
+    double ticks_per_ns;
+    int types_num, num_of_models;
+    int negative_models, zero_models, positive_models;
+    /* -1 for an empty tree, STATS_HEIGHT_UNTRACKED where the trees keep no
+     * heights (red-black and splay builds) */
+    int types_height, sales_height, negative_height, positive_height;
+} DealershipStats;
+
+/* smallest tick count that falls in the given histogram bucket */
+long long StatsBucketLowerBound(int bucket);
+
 
 void *Init();
 
@@ -42,6 +76,71 @@ StatusType GetBestSellerModelByType(void *DS, int typeID, int * modelID);
 
 StatusType GetWorstModels(void *DS, int numOfModels, int *types, int *models);
 
+/* The numOfModels worst models of one type, by the same order as
+ * GetWorstModels. FAILURE if the type has fewer models. */
+StatusType GetWorstModelsByType(void *DS, int typeID, int numOfModels, int *models);
+
+/* n GetBestSellerModelByType calls at once - the type lookups are
+ * interleaved so their cache misses overlap. results[i] gets the status of
+ * the i-th call and modelIDs[i] its answer on SUCCESS. */
+StatusType GetBestSellerModelByTypeBatch(void *DS, int n, const int *typeIDs, int *modelIDs,
+                                         StatusType *results);
+
+/* The number of models with lo <= score <= hi, in O(log n). */
+StatusType CountModelsInScoreRange(void *DS, int lo, int hi, int *count);
+
+/* Called by EnumerateModelsInScoreRange for each model, returning nonzero
+ * stops the enumeration. */
+typedef int (*ModelVisitor)(void *context, int typeID, int modelID, int score);
+
+/* Visits the models with lo <= score <= hi in GetWorstModels order. */
+StatusType EnumerateModelsInScoreRange(void *DS, int lo, int hi, ModelVisitor visitor, void *context);
+
+/* Moves up to budget tree nodes into a cache friendly layout, for idle
+ * periods. *done is 1 once everything is laid out; changes undo it.
+ * ALLOCATION_ERROR with *done 0 if there was no memory for the layout. */
+StatusType CompactStep(void *DS, int budget, int *done);
+
+/* Keeps the cacheSize worst models cached for repeated GetWorstModels
+ * calls with numOfModels <= cacheSize. 0 disables the cache. */
+StatusType SetWorstModelsCacheSize(void *DS, int cacheSize);
+
+/* Keeps the model arrays of types in memory within bytes, 0 for no limit.
+ * Types that were not used lately go cold: only their models with sales
+ * or a score stay, the rest are made again on the next use. Operations
+ * that then need memory and can't get it return ALLOCATION_ERROR. */
+StatusType SetModelMemoryBudget(void *DS, long long bytes);
+
+/* Big GetWorstModels results and big types are split between threads,
+ * one per hardware thread by default (0). 1 keeps every call on the
+ * calling thread. */
+StatusType SetWorkThreads(void *DS, int threads);
+
+/* Fills stats with the call counts and latency histograms so far and the
+ * current size of the data structure. */
+StatusType GetStats(void *DS, DealershipStats *stats);
+
+/* Tracing
+ * -----------------------------------
+ * Records a span for each operation and its phases (type lookup, tree
+ * inserts and deletes, inorder walks) in a ring that keeps the last
+ * capacity spans. TRACE_TREES adds a span per tree rebalance. Init starts
+ * tracing by itself if the WET1_TRACE environment variable names a file,
+ * with TRACE_TREES if WET1_TRACE_TREES is set, and Quit writes it there. */
+typedef enum {
+    TRACE_OPERATIONS = 0,
+    TRACE_TREES = 1
+} TraceDetail;
+
+/* Drops the spans so far and starts over - capacity 0 stops tracing. Quit
+ * writes the trace to quitPath unless it is NULL. */
+StatusType EnableTracing(void *DS, int capacity, TraceDetail detail, const char *quitPath);
+
+/* Writes the recorded spans as Chrome trace JSON (Perfetto,
+ * chrome://tracing). FAILURE if tracing is off or the file can't be
+ * written. */
+StatusType DumpTrace(void *DS, const char *path);
+
 void Quit(void** DS);
 
 #ifdef __cplusplus
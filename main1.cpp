@@ -18,6 +18,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include "library.h"
+#include "FastDriver.h"
+#include "BinaryProtocol.h"
+#include "DealershipServer.h"
+#include "PipelinedDriver.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -34,10 +38,11 @@ typedef enum {
 	MAKECOMPLAINT_CMD = 4,
 	GETBESTSELLERMODELBYTYPE_CMD = 5,
 	GETWORSTMODELS_CMD = 6,
-    QUIT_CMD = 7
+    QUIT_CMD = 7,
+    STATS_CMD = 8
 } commandType;
 
-static const int numActions = 10;
+static const int numActions = 9;
 static const char *commandStr[] = {
         "Init",
         "AddCarType",
@@ -46,7 +51,8 @@ static const char *commandStr[] = {
 		"MakeComplaint",
         "GetBestSellerModelByType",
         "GetWorstModels",
-        "Quit" };
+        "Quit",
+        "Stats" };
 
 static const char* ReturnValToStr(int val) {
     switch (val) {
@@ -87,6 +93,23 @@ int main(int argc, const char**argv) {
 
     char buffer[MAX_STRING_INPUT_SIZE];
 
+    /* main1 --fast <commands file>: replay a whole trace through the
+     * memory mapped driver, same output as the shell below */
+    if (argc == 3 && strcmp(argv[1], "--fast") == 0)
+        return wet1::runFastDriver(argv[2], 1);
+    /* main1 --pipelined <commands file>: the same with parsing, execution
+     * and formatting on their own threads */
+    if (argc == 3 && strcmp(argv[1], "--pipelined") == 0)
+        return wet1::runPipelinedDriver(argv[2], 1);
+    /* main1 --binary <commands.bin>: same, with BinaryProtocol.h records
+     * in and out */
+    if (argc == 3 && strcmp(argv[1], "--binary") == 0)
+        return wet1::runBinaryDriver(argv[2], 1);
+    /* main1 --server <socket path>: one shared data structure for all the
+     * clients of a Unix-domain socket, see DealershipServer.h */
+    if (argc == 3 && strcmp(argv[1], "--server") == 0)
+        return wet1::runServer(argv[2]);
+
     // Reading commands
     while (fgets(buffer, MAX_STRING_INPUT_SIZE, stdin) != NULL) {
         fflush(stdout);
@@ -130,6 +153,7 @@ static errorType OnMakeComplaint(void* DS, const char* const command);
 static errorType OnGetBestSellerModelByType(void* DS, const char* const command);
 static errorType OnGetWorstModels(void* DS, const char* const command);
 static errorType OnQuit(void** DS, const char* const command);
+static errorType OnStats(void* DS, const char* const command);
 
 /***************************************************************************/
 /* Parser                                                                  */
@@ -168,6 +192,9 @@ static errorType parser(const char* const command) {
         case (QUIT_CMD):
             rtn_val = OnQuit(&DS, command_args);
             break;
+        case (STATS_CMD):
+            rtn_val = OnStats(DS, command_args);
+            break;
 
         case (COMMENT_CMD):
             rtn_val = error_free;
@@ -326,6 +353,25 @@ static errorType OnQuit(void** DS, const char* const command) {
     return error_free;
 }
 
+static errorType OnStats(void* DS, const char* const command) {
+    DealershipStats stats;
+    StatusType res = GetStats(DS, &stats);
+
+    if (res != SUCCESS) {
+        printf("%s: %s\n", commandStr[STATS_CMD], ReturnValToStr(res));
+        return error_free;
+    }
+
+    /* the report is shared with the fast driver */
+    fflush(stdout);
+    {
+        wet1::OutputBuffer out(1);
+        wet1::formatStats(stats, out);
+    }
+    printf("%s: %s\n", commandStr[STATS_CMD], ReturnValToStr(res));
+    return error_free;
+}
+
 #ifdef __cplusplus
 }
 #endif
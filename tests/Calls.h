@@ -0,0 +1,157 @@
+#ifndef WET1_TEST_CALLS_H
+#define WET1_TEST_CALLS_H
+
+/*
+ * The calls the tests run on the front ends and replay on a
+ * CarDealershipManager, and the random traces of them. Manager is any class
+ * with the CarDealershipManager methods - queries only need the query ones.
+ */
+#include "library.h"
+#include <random>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+enum CallOp { ADD, REMOVE, SELL, COMPLAIN, BEST, WORST };
+
+/*ADD adds arg models, COMPLAIN complains with t = arg, WORST asks for arg models*/
+struct Call
+{
+    CallOp op;
+    int type, model, arg;
+};
+
+struct CallResult
+{
+    StatusType status;
+    int model; //BEST
+    std::vector<int> types, models; //WORST
+
+    CallResult() : status(SUCCESS), model(-1) {}
+
+    /*the outputs only count on SUCCESS*/
+    bool operator==(const CallResult& other) const
+    {
+        if(status != other.status)
+            return false;
+        return status != SUCCESS || (model == other.model && types == other.types && models == other.models);
+    }
+    bool operator!=(const CallResult& other) const { return !(*this == other); }
+};
+
+/*a call and what it returned on the front end under test*/
+struct LoggedCall
+{
+    Call call;
+    CallResult result;
+};
+
+template<typename Manager>
+CallResult queryCall(Manager& manager, const Call& call)
+{
+    CallResult result;
+    if(call.op == BEST)
+    {
+        result.status = manager.GetBestSellerModelByType(call.type, &result.model);
+        return result;
+    }
+    std::vector<int> types(call.arg > 0 ? call.arg : 0), models(types.size());
+    result.status = manager.GetWorstModels(call.arg, types.data(), models.data());
+    if(result.status == SUCCESS)
+    {
+        result.types.swap(types);
+        result.models.swap(models);
+    }
+    return result;
+}
+
+template<typename Manager>
+CallResult applyCall(Manager& manager, const Call& call)
+{
+    CallResult result;
+    switch(call.op)
+    {
+        case ADD: result.status = manager.AddCarType(call.type, call.arg); break;
+        case REMOVE: result.status = manager.RemoveCarType(call.type); break;
+        case SELL: result.status = manager.SellCar(call.type, call.model); break;
+        case COMPLAIN: result.status = manager.MakeComplaint(call.type, call.model, call.arg); break;
+        default: return queryCall(manager, call);
+    }
+    return result;
+}
+
+/*the call as a line of the shell's input*/
+inline std::string callLine(const Call& call)
+{
+    char line[96];
+    switch(call.op)
+    {
+        case ADD: snprintf(line, sizeof(line), "AddCarType %d %d\n", call.type, call.arg); break;
+        case REMOVE: snprintf(line, sizeof(line), "RemoveCarType %d\n", call.type); break;
+        case SELL: snprintf(line, sizeof(line), "SellCar %d %d\n", call.type, call.model); break;
+        case COMPLAIN:
+            snprintf(line, sizeof(line), "MakeComplaint %d %d %d\n", call.type, call.model, call.arg);
+            break;
+        case BEST: snprintf(line, sizeof(line), "GetBestSellerModelByType %d\n", call.type); break;
+        default: snprintf(line, sizeof(line), "GetWorstModels %d\n", call.arg); break;
+    }
+    return line;
+}
+
+/*percent of the calls of each kind - the rest are COMPLAIN*/
+struct CallMix
+{
+    int add, remove, sell, best, worst;
+};
+
+/**
+ * Random calls on types 1..types (or the ones of an owner) and models
+ * 0..models-1 - ids past a type's models fail on purpose. args are 1..args.
+ */
+class CallGenerator
+{
+    std::mt19937 rng;
+    CallMix mix;
+    int types, models, args;
+    int owner, owners;
+    bool hot;
+
+    public:
+        CallGenerator(unsigned seed, CallMix mix, int types, int models, int args) :
+            rng(seed), mix(mix), types(types), models(models), args(args), owner(0), owners(1), hot(false) {}
+
+        /*only types owner + 1, owner + 1 + owners, ... out of the types*/
+        void ownTypes(int owner, int owners)
+        {
+            this->owner = owner;
+            this->owners = owners;
+        }
+
+        /*three in four calls go to models 0-2, so there are repeats to coalesce*/
+        void hotModels() { hot = true; }
+
+        Call next()
+        {
+            Call call;
+            int u = rng() % 100;
+            int bound = mix.add;
+            call.op = u < bound ? ADD : u < (bound += mix.remove) ? REMOVE : u < (bound += mix.sell) ? SELL :
+                u < (bound += mix.best) ? BEST : u < (bound += mix.worst) ? WORST : COMPLAIN;
+            call.type = (int)(rng() % (types / owners)) * owners + owner + 1;
+            call.model = hot && rng() % 4 ? rng() % 3 : rng() % models;
+            call.arg = rng() % args + 1;
+            return call;
+        }
+
+        std::vector<Call> trace(int calls)
+        {
+            std::vector<Call> result;
+            for (int i = 0; i < calls; i++)
+            {
+                result.push_back(next());
+            }
+            return result;
+        }
+};
+
+#endif
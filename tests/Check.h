@@ -0,0 +1,20 @@
+#ifndef WET1_TEST_CHECK_H
+#define WET1_TEST_CHECK_H
+
+#include <stdio.h>
+
+/*counts failed checks - a test's main returns checkFailures() != 0*/
+inline int& checkFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(cond) do { \
+        if(!(cond)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            checkFailures()++; \
+        } \
+    } while(0)
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef WET1_TEST_PROCESS_H
+#define WET1_TEST_PROCESS_H
+
+/*
+ * Running the shell (hw1_wet) and its driver modes from the tests - ctest
+ * passes the binary's path as the test's first argument.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+/*a file the test removes when done, under TMPDIR*/
+class TempFile
+{
+    std::string name;
+
+    public:
+        explicit TempFile(const std::string& contents)
+        {
+            const char* dir = getenv("TMPDIR");
+            std::string pattern = std::string(dir ? dir : "/tmp") + "/wet1_test_XXXXXX";
+            std::vector<char> path(pattern.begin(), pattern.end());
+            path.push_back('\0');
+            int fd = mkstemp(path.data());
+            name = path.data();
+            if(fd < 0)
+                return;
+            size_t written = 0;
+            while(written < contents.size())
+            {
+                ssize_t res = write(fd, contents.data() + written, contents.size() - written);
+                if(res <= 0)
+                    break;
+                written += res;
+            }
+            close(fd);
+        }
+        ~TempFile() { unlink(name.c_str()); }
+        TempFile(const TempFile&) = delete;
+        TempFile& operator=(const TempFile&) = delete;
+        const char* path() const { return name.c_str(); }
+};
+
+/*starts program with args, its stdin from input_path (or inherited if null), stdout to stdout_fd if >= 0*/
+inline pid_t startProgram(const std::vector<std::string>& args, const char* input_path, int stdout_fd)
+{
+    pid_t pid = fork();
+    if(pid != 0)
+        return pid;
+    if(input_path)
+    {
+        int fd = open(input_path, O_RDONLY);
+        if(fd < 0 || dup2(fd, 0) < 0)
+            _exit(127);
+        close(fd);
+    }
+    if(stdout_fd >= 0 && dup2(stdout_fd, 1) < 0)
+        _exit(127);
+    std::vector<char*> argv;
+    for (const std::string& arg : args)
+    {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    execv(argv[0], argv.data());
+    _exit(127);
+}
+
+/*runs program to its end and returns its stdout, exit_code gets its exit status (-1 if killed)*/
+inline std::string runProgram(const std::vector<std::string>& args, const char* input_path, int* exit_code)
+{
+    std::string output;
+    int pipe_fds[2];
+    *exit_code = -1;
+    if(pipe(pipe_fds) < 0)
+        return output;
+    pid_t pid = startProgram(args, input_path, pipe_fds[1]);
+    close(pipe_fds[1]);
+    char buffer[1 << 16];
+    ssize_t res;
+    while((res = read(pipe_fds[0], buffer, sizeof(buffer))) > 0 || (res < 0 && errno == EINTR))
+    {
+        if(res > 0)
+            output.append(buffer, res);
+    }
+    close(pipe_fds[0]);
+    int status = 0;
+    if(pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status))
+        *exit_code = WEXITSTATUS(status);
+    return output;
+}
+
+/*where got first differs from expected, for the log*/
+inline void reportMismatch(const char* what, const std::string& got, const std::string& expected)
+{
+    if(got == expected)
+        return;
+    size_t at = 0;
+    while(at < got.size() && at < expected.size() && got[at] == expected[at])
+        at++;
+    fprintf(stderr, "%s: %zu bytes, expected %zu, first difference at %zu\n", what, got.size(),
+        expected.size(), at);
+}
+
+#endif
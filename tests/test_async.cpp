@@ -0,0 +1,122 @@
+/*
+ * Producers on disjoint types push events to an AsyncCarDealershipManager
+ * and mirror them on their own synchronous CarDealershipManager. Now and
+ * then a producer waits for its last event (read your writes) and compares
+ * its types' best sellers. At the end every producer's log is replayed on
+ * one CarDealershipManager, and the global state and the failed event
+ * count must match it. Runs with and without coalescing.
+ */
+#include "AsyncCarDealershipManager.h"
+#include "Calls.h"
+#include "Check.h"
+#include <thread>
+#include <vector>
+
+using namespace wet1;
+
+namespace
+{
+    const int PRODUCERS = 3;
+    const int TYPES = 60;
+    const int OPS = 30000;
+    const int CHECK_EVERY = 64;
+
+    StatusType applyAsync(AsyncCarDealershipManager& manager, const Call& call, unsigned long* seq)
+    {
+        switch(call.op)
+        {
+            case ADD: return manager.AddCarType(call.type, call.arg, seq);
+            case REMOVE: return manager.RemoveCarType(call.type, seq);
+            case SELL: return manager.SellCar(call.type, call.model, seq);
+            default: return manager.MakeComplaint(call.type, call.model, call.arg, seq);
+        }
+    }
+
+    /*the types of producer are producer + 1, producer + 1 + PRODUCERS, ...*/
+    void producer(AsyncCarDealershipManager& manager, int thread, std::vector<Call>& log, long& failures)
+    {
+        CallMix mix = { 4, 2, 64, 0, 0 };
+        CallGenerator calls(thread + 11, mix, TYPES, 30, 30);
+        calls.ownTypes(thread, PRODUCERS);
+        calls.hotModels();
+        CarDealershipManager shadow;
+        failures = 0;
+        unsigned long last_seq = 0;
+        for (int i = 0; i < OPS; i++)
+        {
+            Call call = calls.next();
+            StatusType status = applyCall(shadow, call).status;
+            CHECK(status == SUCCESS || status == FAILURE);
+            if(status == FAILURE)
+                failures++;
+            CHECK(applyAsync(manager, call, &last_seq) == SUCCESS);
+            log.push_back(call);
+            if(i % CHECK_EVERY != CHECK_EVERY - 1)
+                continue;
+            manager.waitApplied(last_seq);
+            for (int type = thread + 1; type <= TYPES; type += PRODUCERS)
+            {
+                int model = -1, shadow_model = -1;
+                StatusType async_status = manager.GetBestSellerModelByType(type, &model);
+                CHECK(async_status == shadow.GetBestSellerModelByType(type, &shadow_model));
+                CHECK(model == shadow_model);
+            }
+        }
+        /*invalid input is rejected when enqueued, nothing is applied*/
+        CHECK(manager.SellCar(thread + 1, -1, nullptr) == INVALID_INPUT);
+        CHECK(manager.MakeComplaint(thread + 1, 0, 0, nullptr) == INVALID_INPUT);
+    }
+
+    void run(bool coalesce)
+    {
+        AsyncCarDealershipManager manager(coalesce);
+        std::vector<std::vector<Call> > logs(PRODUCERS);
+        std::vector<long> failures(PRODUCERS);
+        std::vector<std::thread> producers;
+        for (int thread = 0; thread < PRODUCERS; thread++)
+        {
+            producers.emplace_back(producer, std::ref(manager), thread, std::ref(logs[thread]),
+                std::ref(failures[thread]));
+        }
+        for (std::thread& thread : producers)
+        {
+            thread.join();
+        }
+        manager.sync();
+
+        CarDealershipManager single;
+        long single_failures = 0;
+        long producer_failures = 0;
+        for (int thread = 0; thread < PRODUCERS; thread++)
+        {
+            for (const Call& call : logs[thread])
+            {
+                if(applyCall(single, call).status != SUCCESS)
+                    single_failures++;
+            }
+            producer_failures += failures[thread];
+        }
+        CHECK(single_failures == producer_failures);
+        CHECK((long)manager.getFailedEvents() == single_failures);
+        int models_num = single.getModelsNum();
+        std::vector<int> types(models_num), models(models_num);
+        std::vector<int> single_types(models_num), single_models(models_num);
+        if(models_num > 0)
+        {
+            CHECK(manager.GetWorstModels(models_num, types.data(), models.data()) == SUCCESS);
+            CHECK(single.GetWorstModels(models_num, single_types.data(), single_models.data()) == SUCCESS);
+            CHECK(types == single_types && models == single_models);
+        }
+        int best = -1, single_best = -1;
+        CHECK(manager.GetBestSellerModelByType(0, &best) == single.GetBestSellerModelByType(0, &single_best));
+        CHECK(best == single_best);
+        printf("%s: %ld events failed as expected\n", coalesce ? "coalescing" : "one by one", single_failures);
+    }
+}
+
+int main()
+{
+    run(true);
+    run(false);
+    return checkFailures() != 0;
+}
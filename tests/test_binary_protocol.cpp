@@ -0,0 +1,226 @@
+/*
+ * BinaryProtocol.h records: commands and results decode back to what was
+ * encoded, every truncated prefix of a stream stops at the last whole record,
+ * and records whose lengths point past the input - up to INT_MAX - are
+ * rejected without reading it. Inputs are copied to buffers of their exact
+ * size, so a sanitized build (WET1_SANITIZE=address) catches any overread.
+ */
+#include "BinaryProtocol.h"
+#include "Check.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace wet1;
+
+namespace
+{
+    /*a heap copy of exactly len bytes*/
+    class Input
+    {
+        char* data;
+        size_t len;
+
+        public:
+            Input(const char* bytes, size_t len) : data((char*)malloc(len ? len : 1)), len(len)
+            {
+                memcpy(data, bytes, len);
+            }
+            ~Input() { free(data); }
+            Input(const Input&) = delete;
+            Input& operator=(const Input&) = delete;
+            const char* begin() { return data; }
+            const char* end() { return data + len; }
+    };
+
+    Command makeCommand(CommandKind kind, bool valid, int a0, int a1, int a2, const char* text)
+    {
+        Command command = { kind, valid, { a0, a1, a2 }, text, text ? (int)strlen(text) : 0 };
+        return command;
+    }
+
+    std::vector<Command> sampleCommands()
+    {
+        std::vector<Command> commands;
+        commands.push_back(makeCommand(CMD_INIT, true, 0, 0, 0, nullptr));
+        commands.push_back(makeCommand(CMD_ADD_CAR_TYPE, true, 7, 30, 0, nullptr));
+        commands.push_back(makeCommand(CMD_COMMENT, true, 0, 0, 0, "# a comment\n"));
+        commands.push_back(makeCommand(CMD_SELL_CAR, true, 7, 3, 0, nullptr));
+        commands.push_back(makeCommand(CMD_MAKE_COMPLAINT, true, -7, INT_MAX, INT_MIN, nullptr));
+        commands.push_back(makeCommand(CMD_NONE, true, 0, 0, 0, "exactly sixteen\n"));
+        commands.push_back(makeCommand(CMD_NONE, true, 0, 0, 0, ""));
+        commands.push_back(makeCommand(CMD_GET_WORST_MODELS, false, 0, 0, 0, nullptr));
+        commands.push_back(makeCommand(CMD_GET_BEST_SELLER_MODEL_BY_TYPE, true, 0, 0, 0, nullptr));
+        commands.push_back(makeCommand(CMD_QUIT, true, 0, 0, 0, nullptr));
+        return commands;
+    }
+
+    bool sameCommand(const Command& a, const Command& b)
+    {
+        if(a.kind != b.kind || a.valid != b.valid || a.text_len != b.text_len)
+            return false;
+        if(a.kind == CMD_COMMENT || a.kind == CMD_NONE)
+            return memcmp(a.text, b.text, a.text_len) == 0;
+        for (int i = 0; a.valid && i < commandArgsNum(a.kind); i++)
+        {
+            if(a.args[i] != b.args[i])
+                return false;
+        }
+        return true;
+    }
+
+    void commandsRoundTrip()
+    {
+        std::vector<Command> commands = sampleCommands();
+        OutputBuffer out(-1);
+        std::vector<size_t> ends;
+        for (const Command& command : commands)
+        {
+            encodeCommand(command, out);
+            CHECK(out.length() % RECORD_SIZE == 0);
+            ends.push_back(out.length());
+        }
+        /*every prefix decodes the records that are whole in it, and stops at the next*/
+        for (size_t len = 0; len <= out.length(); len++)
+        {
+            Input input(out.data(), len);
+            const char* cursor = input.begin();
+            Command command;
+            size_t decoded = 0;
+            while(decodeCommand(cursor, input.end(), command))
+            {
+                CHECK(decoded < commands.size() && sameCommand(command, commands[decoded]));
+                CHECK(cursor == input.begin() + ends[decoded]);
+                decoded++;
+            }
+            size_t whole = 0;
+            while(whole < ends.size() && ends[whole] <= len)
+                whole++;
+            CHECK(decoded == whole);
+            CHECK(cursor == input.begin() + (whole ? ends[whole - 1] : 0));
+            if(input.end() - cursor >= RECORD_SIZE)
+                CHECK(commandRecordSize(cursor) > input.end() - cursor);
+        }
+    }
+
+    /*a text record of the given kind claiming len bytes of text, and nothing after it*/
+    void oversizedText(unsigned char kind, int len)
+    {
+        unsigned char record[RECORD_SIZE] = { 0 };
+        record[0] = kind;
+        memcpy(record + 4, &len, 4); //little endian hosts only, like the test data
+        Input input((const char*)record, RECORD_SIZE);
+        const char* cursor = input.begin();
+        Command command;
+        CHECK(!decodeCommand(cursor, input.end(), command));
+        CHECK(cursor == input.begin());
+        int64_t size = commandRecordSize(input.begin());
+        CHECK(size == (len < 0 ? RECORD_SIZE : RECORD_SIZE + ((int64_t)len + RECORD_SIZE - 1) / RECORD_SIZE * RECORD_SIZE));
+        CommandResult result;
+        int* types = nullptr;
+        int* models = nullptr;
+        int capacity = 0;
+        cursor = input.begin();
+        CHECK(!decodeResult(cursor, input.end(), command, result, types, models, capacity));
+        CHECK(cursor == input.begin());
+        free(types);
+        free(models);
+    }
+
+    void oversizedRecords()
+    {
+        int lens[] = { INT_MAX, INT_MAX - 6, INT_MAX - 15, 1 << 30, 17, 1, -1, INT_MIN };
+        for (int len : lens)
+        {
+            oversizedText(RECORD_NONE, len);
+            oversizedText(RECORD_COMMENT, len);
+        }
+        /*unknown kinds are not commands*/
+        unsigned char record[RECORD_SIZE] = { 0 };
+        record[0] = CMD_STATS + 1;
+        Input input((const char*)record, RECORD_SIZE);
+        const char* cursor = input.begin();
+        Command command;
+        CHECK(!decodeCommand(cursor, input.end(), command));
+        CHECK(cursor == input.begin());
+    }
+
+    void resultsRoundTrip()
+    {
+        int types[] = { 1, 1, 2 }, models[] = { 0, 5, 9 };
+        Command worst = makeCommand(CMD_GET_WORST_MODELS, true, 3, 0, 0, nullptr);
+        CommandResult rows = { SUCCESS, 0, types, models, 3, false, nullptr };
+        Command best = makeCommand(CMD_GET_BEST_SELLER_MODEL_BY_TYPE, true, 1, 0, 0, nullptr);
+        CommandResult model = { FAILURE, 4, nullptr, nullptr, 0, false, nullptr };
+        Command comment = makeCommand(CMD_COMMENT, true, 0, 0, 0, "# rows\n");
+        CommandResult none = { SUCCESS, 0, nullptr, nullptr, 0, false, nullptr };
+        OutputBuffer out(-1);
+        encodeResult(worst, rows, out);
+        size_t first_end = out.length();
+        encodeResult(best, model, out);
+        encodeResult(comment, none, out);
+        CHECK(out.length() % RECORD_SIZE == 0);
+
+        for (size_t len = 0; len <= out.length(); len++)
+        {
+            Input input(out.data(), len);
+            const char* cursor = input.begin();
+            Command command;
+            CommandResult result;
+            int* decoded_types = nullptr;
+            int* decoded_models = nullptr;
+            int capacity = 0;
+            int decoded = 0;
+            while(decodeResult(cursor, input.end(), command, result, decoded_types, decoded_models, capacity))
+            {
+                if(decoded == 0)
+                {
+                    CHECK(command.kind == CMD_GET_WORST_MODELS && result.count == 3);
+                    CHECK(memcmp(result.types, types, sizeof(types)) == 0);
+                    CHECK(memcmp(result.models, models, sizeof(models)) == 0);
+                    CHECK(cursor == input.begin() + first_end);
+                }
+                else if(decoded == 1)
+                    CHECK(command.kind == best.kind && result.status == FAILURE && result.value == 4);
+                else
+                    CHECK(sameCommand(command, comment));
+                decoded++;
+            }
+            CHECK(len < out.length() || (decoded == 3 && cursor == input.end()));
+            free(decoded_types);
+            free(decoded_models);
+        }
+
+        /*row counts past the input*/
+        int counts[] = { INT_MAX, INT_MAX / 8 + 1, 1 << 28, 2, -1 };
+        for (int count : counts)
+        {
+            unsigned char record[2 * RECORD_SIZE] = { 0 };
+            record[0] = CMD_GET_WORST_MODELS;
+            memcpy(record + 8, &count, 4);
+            Input input((const char*)record, sizeof(record));
+            const char* cursor = input.begin();
+            Command command;
+            CommandResult result;
+            int* decoded_types = nullptr;
+            int* decoded_models = nullptr;
+            int capacity = 0;
+            bool ok = decodeResult(cursor, input.end(), command, result, decoded_types, decoded_models, capacity);
+            /*two rows fit in the padding record, nothing else does*/
+            CHECK(ok == (count == 2));
+            CHECK(cursor == (ok ? input.end() : input.begin()));
+            CHECK(capacity <= 2);
+            free(decoded_types);
+            free(decoded_models);
+        }
+    }
+}
+
+int main()
+{
+    commandsRoundTrip();
+    oversizedRecords();
+    resultsRoundTrip();
+    return checkFailures() != 0;
+}
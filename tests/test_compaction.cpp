@@ -0,0 +1,159 @@
+/*
+ * CompactStep in slices between random calls, next to a manager that is
+ * never compacted: every call must give the same result. done turns true
+ * within about types / slice steps of the last change to the types and
+ * stays true until the next one. Each nothrow allocation of a pass (its
+ * node block and its task stack, first and grown) is made to fail in turn -
+ * CompactStep then returns ALLOCATION_ERROR without done, and the next pass
+ * finishes the layout.
+ */
+#include "CarDealershipManager.h"
+#include "Calls.h"
+#include "Check.h"
+#include <new>
+#include <stdio.h>
+
+using namespace wet1;
+
+namespace
+{
+    const int TYPES = 3000;
+    const int MODELS = 6;
+    const int OPS = 30000;
+
+    /*nothrow allocations that still succeed, -1 for all*/
+    int nothrow_new_left = -1;
+
+    bool nothrowNewFails()
+    {
+        if(nothrow_new_left == 0)
+            return true;
+        if(nothrow_new_left > 0)
+            nothrow_new_left--;
+        return false;
+    }
+}
+
+/*the passes allocate with nothrow new only*/
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    if(nothrowNewFails())
+        return nullptr;
+    try{
+        return ::operator new(size);
+    }
+    catch(std::bad_alloc&){
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    if(nothrowNewFails())
+        return nullptr;
+    try{
+        return ::operator new[](size);
+    }
+    catch(std::bad_alloc&){
+        return nullptr;
+    }
+}
+
+namespace
+{
+    /*compacts in slices of slice until done, returns the steps taken (-1 on an error)*/
+    int compactAll(CarDealershipManager& manager, int slice)
+    {
+        bool done = false;
+        for (int steps = 1; steps <= 2 * TYPES + 2; steps++)
+        {
+            if(manager.CompactStep(slice, &done) != SUCCESS)
+                return -1;
+            if(done)
+                return steps;
+        }
+        return -1;
+    }
+
+    void compareState(CarDealershipManager& compacted, CarDealershipManager& plain)
+    {
+        Call worst = { WORST, 0, 0, plain.getModelsNum() };
+        CHECK(applyCall(compacted, worst) == applyCall(plain, worst));
+        for (int type = 0; type <= TYPES; type += 97)
+        {
+            Call best = { BEST, type, 0, 0 };
+            CHECK(applyCall(compacted, best) == applyCall(plain, best));
+        }
+    }
+
+    void slicesBetweenCalls()
+    {
+        CarDealershipManager compacted, plain;
+        for (int type = 1; type <= TYPES; type++)
+        {
+            Call add = { ADD, type, 0, MODELS };
+            CHECK(applyCall(compacted, add) == applyCall(plain, add));
+        }
+        bool done = true;
+        CHECK(compacted.CompactStep(0, &done) == INVALID_INPUT);
+        CHECK(compacted.CompactStep(1, nullptr) == INVALID_INPUT);
+        /*a whole pass: about one step per slice of nodes, then done until a change*/
+        int steps = compactAll(compacted, 100);
+        CHECK(steps >= TYPES / 100 && steps <= TYPES / 100 + 2);
+        CHECK(compacted.CompactStep(1, &done) == SUCCESS && done);
+        compareState(compacted, plain);
+
+        CallMix mix = { 3, 3, 40, 20, 4 };
+        CallGenerator calls(3, mix, TYPES, MODELS + 1, 20);
+        int slices[] = { 1, 7, 64, 1000 };
+        for (int i = 0; i < OPS; i++)
+        {
+            Call call = calls.next();
+            CallResult result = applyCall(compacted, call);
+            CHECK(result == applyCall(plain, call));
+            /*adding or removing a type changes the types tree and drops the layout*/
+            bool changed = (call.op == ADD || call.op == REMOVE) && result.status == SUCCESS;
+            if(i % 3 == 0 || changed)
+            {
+                StatusType status = compacted.CompactStep(slices[i % 4], &done);
+                CHECK(status == SUCCESS);
+                if(changed)
+                    CHECK(!done);
+            }
+            if(i % 5000 == 0)
+                compareState(compacted, plain);
+        }
+        CHECK(compactAll(compacted, 1000) > 0);
+        compareState(compacted, plain);
+    }
+
+    void outOfMemory()
+    {
+        CarDealershipManager compacted, plain;
+        for (int type = 1; type <= TYPES; type++)
+        {
+            Call add = { ADD, type, 0, MODELS };
+            CHECK(applyCall(compacted, add) == applyCall(plain, add));
+        }
+        /*the block header, its nodes, the task stack, and the stack growing in the first slice*/
+        for (int allowed = 0; allowed < 4; allowed++)
+        {
+            bool done = true;
+            nothrow_new_left = allowed;
+            CHECK(compacted.CompactStep(100, &done) == ALLOCATION_ERROR);
+            CHECK(!done);
+            nothrow_new_left = -1;
+            compareState(compacted, plain);
+        }
+        /*the next pass has its memory again*/
+        CHECK(compactAll(compacted, 500) > 0);
+        compareState(compacted, plain);
+    }
+}
+
+int main()
+{
+    slicesBetweenCalls();
+    outOfMemory();
+    return checkFailures() != 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * A writer runs random operations on a ConcurrentCarDealershipManager while
+ * readers call GetBestSellerModelByType without the writer lock. The type
+ * ids go well past the initial best seller table, so it grows (and old
+ * tables are retired) under the readers. The writer's log is then replayed
+ * on a CarDealershipManager: each call must give the same result, and every
+ * value a reader saw must be one that was published at some point.
+ */
+#include "Calls.h"
+#include "Check.h"
+#include "ConcurrentCarDealershipManager.h"
+#include <atomic>
+#include <random>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace wet1;
+
+namespace
+{
+    const int READERS = 6;
+    const int TYPES = 2000;
+    const int OPS = 60000;
+    /*a failed read is recorded as this model*/
+    const int NO_MODEL = -1;
+
+    typedef std::vector<std::pair<int, int> > Samples; //(type, model)
+
+    void writer(ConcurrentCarDealershipManager& manager, std::vector<LoggedCall>& log)
+    {
+        CallMix mix = { 10, 3, 57, 0, 1 };
+        CallGenerator calls(7, mix, TYPES, 20, 20);
+        for (int i = 0; i < OPS; i++)
+        {
+            LoggedCall logged;
+            logged.call = calls.next();
+            /*types are added in id order at first, so the table keeps growing*/
+            if(i < TYPES)
+            {
+                logged.call.op = ADD;
+                logged.call.type = i + 1;
+            }
+            logged.result = applyCall(manager, logged.call);
+            log.push_back(logged);
+        }
+    }
+
+    void reader(ConcurrentCarDealershipManager& manager, int thread, std::atomic<bool>& done, Samples& samples)
+    {
+        std::mt19937 rng(thread + 100);
+        while(!done.load(std::memory_order_relaxed))
+        {
+            int type = rng() % 8 == 0 ? 0 : (int)(rng() % TYPES) + 1;
+            int model = NO_MODEL;
+            StatusType status = manager.GetBestSellerModelByType(type, &model);
+            CHECK(status == SUCCESS || status == FAILURE);
+            samples.push_back(std::make_pair(type, status == SUCCESS ? model : NO_MODEL));
+        }
+    }
+
+    /*the best seller of type (0 - overall) in single, NO_MODEL if there is none*/
+    int bestSeller(CarDealershipManager& single, int type)
+    {
+        int model = NO_MODEL;
+        return single.GetBestSellerModelByType(type, &model) == SUCCESS ? model : NO_MODEL;
+    }
+}
+
+int main()
+{
+    ConcurrentCarDealershipManager manager;
+    std::vector<LoggedCall> log;
+    std::vector<Samples> samples(READERS);
+    std::atomic<bool> done(false);
+    std::vector<std::thread> readers;
+    for (int thread = 0; thread < READERS; thread++)
+    {
+        readers.emplace_back(reader, std::ref(manager), thread, std::ref(done), std::ref(samples[thread]));
+    }
+    writer(manager, log);
+    done = true;
+    for (std::thread& thread : readers)
+    {
+        thread.join();
+    }
+
+    /*every value each type's best seller (and the overall one) ever had*/
+    CarDealershipManager single;
+    std::vector<std::set<int> > published(TYPES + 1);
+    for (int type = 0; type <= TYPES; type++)
+    {
+        published[type].insert(NO_MODEL);
+    }
+    for (LoggedCall& logged : log)
+    {
+        CHECK(applyCall(single, logged.call) == logged.result);
+        published[logged.call.type].insert(bestSeller(single, logged.call.type));
+        published[0].insert(bestSeller(single, 0));
+    }
+    long reads = 0;
+    for (Samples& reader_samples : samples)
+    {
+        for (std::pair<int, int>& sample : reader_samples)
+        {
+            CHECK(published[sample.first].count(sample.second) == 1);
+        }
+        reads += reader_samples.size();
+    }
+    /*once the writer is done the readers see exactly the final state*/
+    for (int type = 0; type <= TYPES; type++)
+    {
+        int model = NO_MODEL;
+        StatusType status = manager.GetBestSellerModelByType(type, &model);
+        CHECK((status == SUCCESS ? model : NO_MODEL) == bestSeller(single, type));
+    }
+    printf("%zu writes, %ld lock free reads\n", log.size(), reads);
+    return checkFailures() != 0;
+}
@@ -0,0 +1,53 @@
+/*
+ * Built with the red-black and the splay tree policies. Sequential type ids,
+ * sales and complaints make the splay trees long chains; every walk over
+ * them (stats, worst models, Quit) has to go without recursion.
+ */
+#include "Check.h"
+#include "library.h"
+#include <vector>
+
+namespace
+{
+    const int TYPES = 300000;
+}
+
+int main()
+{
+    void* DS = Init();
+    CHECK(DS != NULL);
+    for (int type = 1; type <= TYPES; type++)
+    {
+        CHECK(AddCarType(DS, type, 2) == SUCCESS);
+    }
+    /*model 0 of each type sold, model 1 complained about - every tree in id order*/
+    for (int type = 1; type <= TYPES; type++)
+    {
+        CHECK(SellCar(DS, type, 0) == SUCCESS);
+        CHECK(MakeComplaint(DS, type, 1, 1) == SUCCESS);
+    }
+    DealershipStats stats;
+    CHECK(GetStats(DS, &stats) == SUCCESS);
+    CHECK(stats.num_of_models == 2 * TYPES);
+    CHECK(stats.negative_models == TYPES && stats.positive_models == TYPES);
+
+    std::vector<int> types(2 * TYPES), models(2 * TYPES);
+    CHECK(GetWorstModels(DS, 2 * TYPES, types.data(), models.data()) == SUCCESS);
+    /*the complained about models (-100), then the sold ones (+10), by type*/
+    for (int i = 0; i < TYPES; i++)
+    {
+        CHECK(types[i] == i + 1 && models[i] == 1);
+        CHECK(types[TYPES + i] == i + 1 && models[TYPES + i] == 0);
+    }
+    int model = -1;
+    CHECK(GetBestSellerModelByType(DS, 0, &model) == SUCCESS && model == 0);
+    for (int type = 1; type <= TYPES; type += 2)
+    {
+        CHECK(RemoveCarType(DS, type) == SUCCESS);
+    }
+    CHECK(GetWorstModels(DS, TYPES, types.data(), models.data()) == SUCCESS);
+    CHECK(types[0] == 2 && models[0] == 1);
+    Quit(&DS);
+    CHECK(DS == NULL);
+    return checkFailures() != 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * hw1_wet --fast, --pipelined and --binary against the shell: for each trace
+ * their output must be byte for byte what the shell prints - the binary
+ * driver's results as trace_convert results2text prints them. The traces
+ * are a long random one and short ones at the edges of the shell's parser:
+ * calls before Init, Quit and Init again, a bad argument or an empty line
+ * stopping the shell, no last newline, lines longer than the shell reads.
+ * trace_convert bin2text must give back a trace the shell runs the same,
+ * the very same text for lines in the shell's own format.
+ *
+ *   test_drivers <hw1_wet> <trace_convert>
+ */
+#include "Calls.h"
+#include "Check.h"
+#include "Process.h"
+
+namespace
+{
+    const int TYPES = 60;
+    const int MODELS = 50;
+
+    /*the program's stdout, which must exit with 0*/
+    std::string output(const std::vector<std::string>& args, const char* input_path)
+    {
+        int exit_code = -1;
+        std::string result = runProgram(args, input_path, &exit_code);
+        CHECK(exit_code == 0);
+        return result;
+    }
+
+    std::string randomTrace(unsigned seed, int calls)
+    {
+        std::string text = "Init\n# types\n";
+        for (int type = 1; type <= TYPES; type++)
+        {
+            Call add = { ADD, type, 0, MODELS };
+            text += callLine(add);
+        }
+        text += "# random calls\n";
+        CallMix mix = { 3, 2, 45, 15, 10 };
+        CallGenerator generator(seed, mix, TYPES + 5, MODELS + 2, 20);
+        for (int i = 0; i < calls; i++)
+        {
+            Call call = generator.next();
+            /*up to 400 rows, some more than there are models*/
+            if(call.op == WORST)
+                call.arg *= 20;
+            text += callLine(call);
+        }
+        return text + "Quit\n";
+    }
+
+    std::vector<std::string> edgeTraces()
+    {
+        std::vector<std::string> traces;
+        traces.push_back("SellCar 1 1\nGetWorstModels 1\nInit\nAddCarType 1 3\nGetWorstModels 2\n");
+        traces.push_back("Init\nAddCarType 1 3\nQuit\nInit\nGetWorstModels 1\nQuit\nGetWorstModels 1\n");
+        traces.push_back("Init\nAddCarType 1 5\nSellCar 3\nSellCar 1 1\n");
+        traces.push_back("Init\nAddCarType 1 3\n\nGetWorstModels 2\n");
+        traces.push_back("Init\nAddCarType 1 5\nMakeComplaint 1 2 3\nGetWorstModels 3");
+        traces.push_back("Init\nAddCarType  1   3\nGetWorstModels 1 extra\nBogus 1\nGetWorstModels 2\n");
+        traces.push_back("Init\nAddCarType 1 -3\nAddCarType 0 3\nGetBestSellerModelByType -1\nGetWorstModels 0\n");
+        /*a comment cut at the shell's line length, its rest stops the shell*/
+        traces.push_back("Init\n# " + std::string(600, 'x') + "\nAddCarType 1 3\n");
+        traces.push_back("Init\n# " + std::string(252, 'x') + "\nAddCarType 1 3\n");
+        traces.push_back("Init\n# " + std::string(251, 'x') + "\nAddCarType 1 3\nGetWorstModels 2\n");
+        return traces;
+    }
+
+    void compareDrivers(const std::string& shell, const std::string& convert, const std::string& trace,
+        bool canonical)
+    {
+        TempFile text(trace);
+        std::string expected = output({ shell }, text.path());
+        std::string fast = output({ shell, "--fast", text.path() }, nullptr);
+        reportMismatch("--fast", fast, expected);
+        CHECK(fast == expected);
+        std::string pipelined = output({ shell, "--pipelined", text.path() }, nullptr);
+        reportMismatch("--pipelined", pipelined, expected);
+        CHECK(pipelined == expected);
+
+        TempFile binary(output({ convert, "text2bin", text.path(), "-" }, nullptr));
+        TempFile results(output({ shell, "--binary", binary.path() }, nullptr));
+        std::string printed = output({ convert, "results2text", results.path(), "-" }, nullptr);
+        reportMismatch("--binary", printed, expected);
+        CHECK(printed == expected);
+
+        std::string round_trip = output({ convert, "bin2text", binary.path(), "-" }, nullptr);
+        if(canonical)
+            CHECK(round_trip == trace);
+        TempFile again(round_trip);
+        CHECK(output({ shell }, again.path()) == expected);
+    }
+}
+
+int main(int argc, const char** argv)
+{
+    if(argc != 3)
+    {
+        fprintf(stderr, "usage: %s <hw1_wet> <trace_convert>\n", argv[0]);
+        return 1;
+    }
+    compareDrivers(argv[1], argv[2], randomTrace(1, 20000), true);
+    compareDrivers(argv[1], argv[2], randomTrace(2, 3000) + randomTrace(3, 3000), true);
+    for (const std::string& trace : edgeTraces())
+    {
+        compareDrivers(argv[1], argv[2], trace, false);
+    }
+    return checkFailures() != 0;
+}
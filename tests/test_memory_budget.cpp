@@ -0,0 +1,167 @@
+/*
+ * Random traces on a CarDealershipManager with a model memory budget, next
+ * to one without. Every call must give the same result on both, and so must
+ * the score range queries, whose zero scores span the cold types.
+ * EnumerateModelsInScoreRange must not page cold types in: with every
+ * allocation failing it still visits the whole range and succeeds.
+ */
+#include "CarDealershipManager.h"
+#include "Calls.h"
+#include "Check.h"
+#include <new>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+using namespace wet1;
+
+namespace
+{
+    const int TYPES = 300;
+    const int MODELS = 200;
+    const int OPS = 40000;
+
+    bool new_fails = false;
+}
+
+/*every form of new and delete, so none of them mixes with the library's*/
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return new_fails ? nullptr : malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& nothrow) noexcept
+{
+    return operator new(size, nothrow);
+}
+
+void* operator new(std::size_t size)
+{
+    void* memory = operator new(size, std::nothrow);
+    if(!memory)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+    free(memory);
+}
+
+namespace
+{
+    struct Row
+    {
+        int type, model, score;
+        bool operator==(const Row& other) const
+        {
+            return type == other.type && model == other.model && score == other.score;
+        }
+    };
+
+    /*collects up to limit rows (0 - all), then stops the enumeration*/
+    struct Visited
+    {
+        std::vector<Row> rows;
+        size_t limit;
+    };
+
+    int collect(void* context, int type, int model, int score)
+    {
+        Visited* visited = static_cast<Visited*>(context);
+        Row row = { type, model, score };
+        visited->rows.push_back(row);
+        return visited->limit && visited->rows.size() >= visited->limit;
+    }
+
+    StatusType enumerate(CarDealershipManager& manager, int lo, int hi, size_t limit, Visited& visited)
+    {
+        visited.rows.clear();
+        visited.rows.reserve(manager.getModelsNum() + 1);
+        visited.limit = limit;
+        return manager.EnumerateModelsInScoreRange(lo, hi, collect, &visited);
+    }
+
+    void compareRanges(CarDealershipManager& budgeted, CarDealershipManager& plain, std::mt19937& rng)
+    {
+        int lo = (int)(rng() % 401) - 300;
+        int hi = lo + (int)(rng() % 400);
+        size_t limit = rng() % 2 ? 0 : rng() % 500 + 1;
+        Visited expected, got;
+        CHECK(enumerate(plain, lo, hi, limit, expected) == SUCCESS);
+        CHECK(enumerate(budgeted, lo, hi, limit, got) == SUCCESS);
+        CHECK(got.rows == expected.rows);
+        int expected_count = -1, count = -2;
+        CHECK(plain.CountModelsInScoreRange(lo, hi, &expected_count) == SUCCESS);
+        CHECK(budgeted.CountModelsInScoreRange(lo, hi, &count) == SUCCESS);
+        CHECK(count == expected_count);
+        if(!limit)
+            CHECK((int)expected.rows.size() == expected_count);
+    }
+
+    /*the zero scores of every type, cold or not, with no memory to page one in*/
+    void enumerateWithoutMemory(CarDealershipManager& budgeted, CarDealershipManager& plain)
+    {
+        Visited expected, got;
+        CHECK(enumerate(plain, -100, 100, 0, expected) == SUCCESS);
+        got.rows.reserve(budgeted.getModelsNum() + 1);
+        got.limit = 0;
+        new_fails = true;
+        StatusType status = budgeted.EnumerateModelsInScoreRange(-100, 100, collect, &got);
+        new_fails = false;
+        CHECK(status == SUCCESS);
+        CHECK(got.rows == expected.rows);
+    }
+
+    void run(long long budget, unsigned seed)
+    {
+        CarDealershipManager budgeted, plain;
+        CHECK(budgeted.SetModelMemoryBudget(budget) == SUCCESS);
+        CallMix mix = { 4, 2, 30, 10, 4 };
+        CallGenerator calls(seed, mix, TYPES, MODELS + 1, MODELS);
+        std::mt19937 rng(seed);
+        for (int i = 0; i < OPS; i++)
+        {
+            Call call = calls.next();
+            CHECK(applyCall(budgeted, call) == applyCall(plain, call));
+            if(i % 20 == 0)
+                compareRanges(budgeted, plain, rng);
+            if(i % 2000 == 0)
+                enumerateWithoutMemory(budgeted, plain);
+        }
+        Call all = { WORST, 0, 0, plain.getModelsNum() };
+        CHECK(applyCall(budgeted, all) == applyCall(plain, all));
+    }
+}
+
+int main()
+{
+    /*everything that can go cold does, then only a few blocks fit*/
+    long long budgets[] = { 1, 20 * MODELS * (long long)sizeof(CarModel) };
+    for (int i = 0; i < 2; i++)
+    {
+        run(budgets[i], 50 + i);
+    }
+    return checkFailures() != 0;
+}
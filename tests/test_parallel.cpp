@@ -0,0 +1,131 @@
+/*
+ * A CarDealershipManager splitting its big calls between 4 threads, next to
+ * one that does them all on the calling thread - SetWorkThreads makes the
+ * pool even on a single CPU. Types past PARALLEL_BUILD_MIN models are built
+ * and removed on the pool, GetWorstModels past PARALLEL_WORST_MIN rows is
+ * filled on it, and every call must give the same result on both.
+ * Removing a type that holds most of a tree rebuilds the tree instead of
+ * removing its models one by one: the worst models list must then be the
+ * one from before without that type's rows.
+ */
+#include "CarDealershipManager.h"
+#include "Calls.h"
+#include "Check.h"
+#include <random>
+
+using namespace wet1;
+
+namespace
+{
+    /*past the parallel thresholds of CarDealershipManager.cpp, 1 << 16*/
+    const int BIG = 70000;
+    const int SMALL = 40;
+    const int TYPES = 12;
+    const int OPS = 20000;
+
+    CallResult allWorst(CarDealershipManager& manager)
+    {
+        Call all = { WORST, 0, 0, manager.getModelsNum() };
+        return applyCall(manager, all);
+    }
+
+    void compare(CarDealershipManager& pooled, CarDealershipManager& serial, const Call& call)
+    {
+        CHECK(applyCall(pooled, call) == applyCall(serial, call));
+    }
+
+    void randomCalls(unsigned seed)
+    {
+        CarDealershipManager pooled, serial;
+        CHECK(pooled.SetWorkThreads(4) == SUCCESS);
+        CHECK(serial.SetWorkThreads(1) == SUCCESS);
+        CHECK(serial.SetWorkThreads(-1) == INVALID_INPUT);
+        std::mt19937 rng(seed);
+        for (int type = 1; type <= TYPES; type++)
+        {
+            Call add = { ADD, type, 0, type % 3 == 0 ? BIG : SMALL };
+            compare(pooled, serial, add);
+        }
+        CallMix mix = { 1, 1, 40, 5, 2 };
+        CallGenerator calls(seed, mix, TYPES, SMALL, 10);
+        for (int i = 0; i < OPS; i++)
+        {
+            Call call = calls.next();
+            if(call.op == ADD)
+                call.arg = rng() % 2 ? BIG : SMALL;
+            /*the big types' models, spread over all of them*/
+            if((call.op == SELL || call.op == COMPLAIN) && call.type % 3 == 0)
+                call.model = rng() % BIG;
+            /*around the fill threshold, and up to every model*/
+            if(call.op == WORST && rng() % 4 == 0)
+            {
+                int sizes[] = { (1 << 16) - 1, 1 << 16, (1 << 16) + 13, serial.getModelsNum() };
+                call.arg = sizes[rng() % 4];
+            }
+            compare(pooled, serial, call);
+        }
+        CHECK(allWorst(pooled) == allWorst(serial));
+    }
+
+    /*the list before, without the type's rows*/
+    CallResult withoutType(const CallResult& before, int type)
+    {
+        CallResult result;
+        for (size_t i = 0; i < before.types.size(); i++)
+        {
+            if(before.types[i] == type)
+                continue;
+            result.types.push_back(before.types[i]);
+            result.models.push_back(before.models[i]);
+        }
+        return result;
+    }
+
+    void removeAndCompare(CarDealershipManager& pooled, CarDealershipManager& serial, int type)
+    {
+        CallResult before = allWorst(serial);
+        Call remove = { REMOVE, type, 0, 0 };
+        compare(pooled, serial, remove);
+        CallResult expected = withoutType(before, type);
+        CHECK(allWorst(serial) == expected);
+        CHECK(allWorst(pooled) == expected);
+        Call best = { BEST, 0, 0, 0 };
+        compare(pooled, serial, best);
+    }
+
+    void rebuildOnRemove()
+    {
+        CarDealershipManager pooled, serial;
+        CHECK(pooled.SetWorkThreads(4) == SUCCESS);
+        CHECK(serial.SetWorkThreads(1) == SUCCESS);
+        for (int type = 1; type <= 4; type++)
+        {
+            Call add = { ADD, type, 0, type == 1 ? BIG : SMALL };
+            compare(pooled, serial, add);
+        }
+        /*type 1 holds all but one of the sold, positive and negative models*/
+        for (int model = 0; model < 2000; model++)
+        {
+            Call call = { model % 2 ? SELL : COMPLAIN, 1, model, model % 7 + 1 };
+            compare(pooled, serial, call);
+        }
+        Call others[] = { { SELL, 2, 3, 0 }, { COMPLAIN, 3, 5, 2 }, { SELL, 4, 1, 0 }, { COMPLAIN, 4, 2, 1 } };
+        for (const Call& call : others)
+        {
+            compare(pooled, serial, call);
+        }
+        /*type 4 is a small part of every tree, type 1 is most of them*/
+        removeAndCompare(pooled, serial, 4);
+        removeAndCompare(pooled, serial, 1);
+        Call add = { ADD, 1, 0, BIG };
+        compare(pooled, serial, add);
+        CHECK(allWorst(pooled) == allWorst(serial));
+    }
+}
+
+int main()
+{
+    randomCalls(1);
+    rebuildOnRemove();
+    return checkFailures() != 0;
+}
@@ -0,0 +1,175 @@
+/*
+ * The batched and ranged queries against the plain calls on the same
+ * CarDealershipManager, along a random trace. GetBestSellerModelByTypeBatch
+ * must give what GetBestSellerModelByType gives for each id, and
+ * GetWorstModelsByType, CountModelsInScoreRange and
+ * EnumerateModelsInScoreRange what filtering the whole GetWorstModels list
+ * by type or score gives.
+ */
+#include "CarDealershipManager.h"
+#include "Calls.h"
+#include "Check.h"
+#include <algorithm>
+#include <map>
+#include <random>
+
+using namespace wet1;
+
+namespace
+{
+    const int TYPES = 80;
+    const int MODELS = 30;
+    const int OPS = 30000;
+
+    struct Row
+    {
+        int type, model, score;
+        bool operator==(const Row& other) const
+        {
+            return type == other.type && model == other.model && score == other.score;
+        }
+    };
+
+    std::vector<Row> worstRows(CarDealershipManager& manager)
+    {
+        int models_num = manager.getModelsNum();
+        std::vector<int> types(models_num), models(models_num), scores(models_num);
+        std::vector<Row> rows;
+        if(models_num == 0)
+            return rows;
+        CHECK(manager.GetWorstModelsWithScores(models_num, types.data(), models.data(), scores.data()) == SUCCESS);
+        for (int i = 0; i < models_num; i++)
+        {
+            Row row = { types[i], models[i], scores[i] };
+            rows.push_back(row);
+        }
+        return rows;
+    }
+
+    void checkBatch(CarDealershipManager& manager, std::mt19937& rng)
+    {
+        /*past one batch of lookups, with repeats, unknown ids and the overall best seller*/
+        int n = rng() % 600;
+        std::vector<int> ids(n), models(n, -1);
+        std::vector<StatusType> results(n);
+        for (int i = 0; i < n; i++)
+        {
+            ids[i] = (int)(rng() % (TYPES + 8)) - 2;
+        }
+        CHECK(manager.GetBestSellerModelByTypeBatch(n, ids.data(), models.data(), results.data()) == SUCCESS);
+        for (int i = 0; i < n; i++)
+        {
+            int model = -1;
+            StatusType status = manager.GetBestSellerModelByType(ids[i], &model);
+            CHECK(results[i] == status);
+            CHECK(status != SUCCESS || models[i] == model);
+        }
+        CHECK(manager.GetBestSellerModelByTypeBatch(-1, ids.data(), models.data(), results.data()) == INVALID_INPUT);
+        CHECK(manager.GetBestSellerModelByTypeBatch(1, nullptr, models.data(), results.data()) == INVALID_INPUT);
+    }
+
+    void checkWorstByType(CarDealershipManager& manager, const std::vector<Row>& rows, std::mt19937& rng)
+    {
+        std::map<int, std::vector<int> > by_type;
+        for (const Row& row : rows)
+        {
+            by_type[row.type].push_back(row.model);
+        }
+        for (int i = 0; i < 5; i++)
+        {
+            int type = rng() % (TYPES + 5) + 1;
+            const std::vector<int>& expected = by_type[type];
+            int k = rng() % (MODELS + 2) + 1;
+            std::vector<int> models(k, -1);
+            StatusType status = manager.GetWorstModelsByType(type, k, models.data());
+            if(k > (int)expected.size())
+            {
+                CHECK(status == FAILURE);
+                continue;
+            }
+            CHECK(status == SUCCESS);
+            CHECK(std::equal(models.begin(), models.end(), expected.begin()));
+        }
+        int model;
+        CHECK(manager.GetWorstModelsByType(0, 1, &model) == INVALID_INPUT);
+        CHECK(manager.GetWorstModelsByType(1, 0, &model) == INVALID_INPUT);
+        CHECK(manager.GetWorstModelsByType(1, 1, nullptr) == INVALID_INPUT);
+    }
+
+    /*collects up to limit rows (0 - all), then stops the enumeration*/
+    struct Visited
+    {
+        std::vector<Row> rows;
+        size_t limit;
+    };
+
+    int collect(void* context, int type, int model, int score)
+    {
+        Visited* visited = static_cast<Visited*>(context);
+        Row row = { type, model, score };
+        visited->rows.push_back(row);
+        return visited->limit && visited->rows.size() >= visited->limit;
+    }
+
+    void checkRanges(CarDealershipManager& manager, const std::vector<Row>& rows, std::mt19937& rng)
+    {
+        for (int i = 0; i < 5; i++)
+        {
+            /*mostly around 0, where the zero scores of all the types are*/
+            int lo = (int)(rng() % 301) - 250;
+            int hi = i == 0 ? lo : lo + (int)(rng() % 300);
+            std::vector<Row> expected;
+            for (const Row& row : rows)
+            {
+                if(row.score >= lo && row.score <= hi)
+                    expected.push_back(row);
+            }
+            int count = -1;
+            CHECK(manager.CountModelsInScoreRange(lo, hi, &count) == SUCCESS);
+            CHECK(count == (int)expected.size());
+
+            Visited visited;
+            visited.limit = rng() % 2 ? 0 : rng() % 100 + 1;
+            CHECK(manager.EnumerateModelsInScoreRange(lo, hi, collect, &visited) == SUCCESS);
+            if(visited.limit && visited.limit < expected.size())
+                expected.resize(visited.limit);
+            CHECK(visited.rows == expected);
+        }
+        int count;
+        CHECK(manager.CountModelsInScoreRange(1, 0, &count) == INVALID_INPUT);
+        CHECK(manager.CountModelsInScoreRange(0, 1, nullptr) == INVALID_INPUT);
+        Visited visited;
+        visited.limit = 0;
+        CHECK(manager.EnumerateModelsInScoreRange(1, 0, collect, &visited) == INVALID_INPUT);
+        CHECK(manager.EnumerateModelsInScoreRange(0, 1, nullptr, &visited) == INVALID_INPUT);
+    }
+
+    void run(unsigned seed)
+    {
+        CarDealershipManager manager;
+        CallMix mix = { 4, 2, 40, 0, 0 };
+        CallGenerator calls(seed, mix, TYPES, MODELS + 1, 10);
+        std::mt19937 rng(seed);
+        for (int i = 0; i < OPS; i++)
+        {
+            Call call = calls.next();
+            if(call.op == ADD)
+                call.arg = rng() % MODELS + 1;
+            applyCall(manager, call);
+            if(i % 50 == 0)
+            {
+                std::vector<Row> rows = worstRows(manager);
+                checkBatch(manager, rng);
+                checkWorstByType(manager, rows, rng);
+                checkRanges(manager, rows, rng);
+            }
+        }
+    }
+}
+
+int main()
+{
+    run(1);
+    run(2);
+    return checkFailures() != 0;
+}
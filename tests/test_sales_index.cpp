@@ -0,0 +1,118 @@
+/*
+ * The overall best seller against a brute force reference, built with the
+ * sales tree and with WET1_SALES_FREQ_LIST. Removing a type frees its
+ * models; a type added right after tends to get the same memory, so its
+ * models must not be taken for the removed ones.
+ */
+#include "CarDealershipManager.h"
+#include "Check.h"
+#include <map>
+#include <random>
+#include <utility>
+
+using namespace wet1;
+
+namespace
+{
+    /*(type, model) -> sales of the sold models*/
+    typedef std::map<std::pair<int, int>, int> Sales;
+
+    /*most sales, then the lowest type and model - 0 if nothing was sold*/
+    int expectedBest(const Sales& sales)
+    {
+        int best_sales = 0, best_model = 0;
+        for (Sales::const_iterator it = sales.begin(); it != sales.end(); ++it)
+        {
+            if(it->second > best_sales)
+            {
+                best_sales = it->second;
+                best_model = it->first.second;
+            }
+        }
+        return best_model;
+    }
+
+    void removeType(Sales& sales, int type)
+    {
+        Sales::iterator it = sales.lower_bound(std::make_pair(type, 0));
+        while(it != sales.end() && it->first.first == type)
+        {
+            sales.erase(it++);
+        }
+    }
+
+    /*a removed type's sold model and the next type's model at its address*/
+    void removeAddSell()
+    {
+        CarDealershipManager manager;
+        CHECK(manager.AddCarType(1, 100) == SUCCESS);
+        for (int model = 0; model < 100; model++)
+        {
+            CHECK(manager.SellCar(1, model) == SUCCESS);
+        }
+        /*few of the sold models, so it is removed model by model*/
+        CHECK(manager.AddCarType(2, 2) == SUCCESS);
+        CHECK(manager.SellCar(2, 1) == SUCCESS);
+        CHECK(manager.RemoveCarType(2) == SUCCESS);
+        CHECK(manager.AddCarType(3, 2) == SUCCESS);
+        CHECK(manager.SellCar(3, 1) == SUCCESS);
+        /*one sale each - type 1 wins the tie*/
+        int sales = 0, type = 0, model = -1;
+        CHECK(manager.GetTopSeller(&sales, &type, &model) == SUCCESS);
+        CHECK(sales == 1 && type == 1 && model == 0);
+        CHECK(manager.GetBestSellerModelByType(0, &model) == SUCCESS && model == 0);
+        /*and type 3's model moves on from the right bucket*/
+        CHECK(manager.SellCar(3, 1) == SUCCESS);
+        CHECK(manager.GetTopSeller(&sales, &type, &model) == SUCCESS);
+        CHECK(sales == 2 && type == 3 && model == 1);
+    }
+
+    void randomOperations()
+    {
+        const int TYPES = 40;
+        std::mt19937 rng(5);
+        CarDealershipManager manager;
+        Sales sales;
+        int models_of[TYPES + 1] = { 0 };
+        for (int i = 0; i < 200000; i++)
+        {
+            int type = rng() % TYPES + 1;
+            int u = rng() % 100;
+            if(u < 5)
+            {
+                int models = rng() % 8 + 1;
+                StatusType status = manager.AddCarType(type, models);
+                CHECK(status == (models_of[type] ? FAILURE : SUCCESS));
+                if(status == SUCCESS)
+                    models_of[type] = models;
+            }
+            else if(u < 10)
+            {
+                CHECK(manager.RemoveCarType(type) == (models_of[type] ? SUCCESS : FAILURE));
+                models_of[type] = 0;
+                removeType(sales, type);
+            }
+            else
+            {
+                int model = rng() % 8;
+                int sold = u < 80 ? 1 : (int)(rng() % 3);
+                StatusType status = sold == 1 ? manager.SellCar(type, model) :
+                    manager.ApplyModelDelta(type, model, sold, -(int)(rng() % 30));
+                bool exists = model < models_of[type];
+                CHECK(status == (exists ? SUCCESS : FAILURE));
+                if(exists && sold > 0)
+                    sales[std::make_pair(type, model)] += sold;
+            }
+            int best = -1;
+            if(manager.GetBestSellerModelByType(0, &best) == SUCCESS)
+                CHECK(best == expectedBest(sales));
+        }
+    }
+}
+
+int main()
+{
+    removeAddSell();
+    randomOperations();
+    return checkFailures() != 0;
+}
@@ -0,0 +1,215 @@
+/*
+ * hw1_wet --server against the shell. A text client and a binary client run
+ * random traces one after the other, and their replies must be exactly what
+ * the shell prints for Init and the same traces (but for the Init line - the
+ * server runs Init itself). The clients send everything before reading, and
+ * the traces ask for megabytes of GetWorstModels rows, so the server has to
+ * stop at its output high water mark and go on once the client reads.
+ * Clients sending a line or a record too long to buffer are dropped, and
+ * the server still serves the next one.
+ *
+ *   test_server <hw1_wet>
+ */
+#include "BinaryProtocol.h"
+#include "Calls.h"
+#include "Check.h"
+#include "Process.h"
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+
+using namespace wet1;
+
+namespace
+{
+    const int TYPES = 40;
+    const int MODELS = 100;
+    /*well past what the server buffers for a connection*/
+    const size_t TOO_LONG = 32 << 20;
+    const int REPLY_TIMEOUT_MS = 60000;
+    /*the server's output high water mark*/
+    const size_t HIGH_WATER = 4 << 20;
+
+    int connectTo(const std::string& path)
+    {
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+        /*the server may still be starting*/
+        for (int attempt = 0; attempt < 500; attempt++)
+        {
+            int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if(fd < 0)
+                return -1;
+            if(connect(fd, (sockaddr*)&address, sizeof(address)) == 0)
+                return fd;
+            close(fd);
+            usleep(10000);
+        }
+        return -1;
+    }
+
+    /*sends request (then closes the sending side unless keep_open) while
+     * reading the replies until the server closes - after read_delay_ms*/
+    std::string exchange(const std::string& path, const std::string& request, bool keep_open,
+        int read_delay_ms, bool* sent_all)
+    {
+        std::string reply;
+        int fd = connectTo(path);
+        CHECK(fd >= 0);
+        if(fd < 0)
+            return reply;
+        bool all = false;
+        std::thread sender([&]()
+        {
+            size_t sent = 0;
+            while(sent < request.size())
+            {
+                ssize_t res = send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+                if(res < 0 && errno == EINTR)
+                    continue;
+                if(res <= 0)
+                    break;
+                sent += res;
+            }
+            all = sent == request.size();
+            if(!keep_open)
+                shutdown(fd, SHUT_WR);
+        });
+        usleep(read_delay_ms * 1000);
+        char buffer[1 << 16];
+        while(true)
+        {
+            pollfd readable = { fd, POLLIN, 0 };
+            int ready = poll(&readable, 1, REPLY_TIMEOUT_MS);
+            CHECK(ready == 1);
+            if(ready != 1)
+                break;
+            ssize_t res = recv(fd, buffer, sizeof(buffer), 0);
+            if(res < 0 && errno == EINTR)
+                continue;
+            if(res <= 0)
+                break;
+            reply.append(buffer, res);
+        }
+        /*a dropped client's sends fail once the server is gone*/
+        shutdown(fd, SHUT_RDWR);
+        sender.join();
+        close(fd);
+        if(sent_all)
+            *sent_all = all;
+        return reply;
+    }
+
+    /*the shell's input for a random trace with some large GetWorstModels*/
+    std::string makeTrace(unsigned seed, int calls)
+    {
+        std::string text = "# a comment line\n";
+        for (int type = 1; type <= TYPES; type++)
+        {
+            Call add = { ADD, type, 0, MODELS };
+            text += callLine(add);
+        }
+        CallMix mix = { 2, 1, 50, 10, 15 };
+        CallGenerator generator(seed, mix, TYPES + 5, MODELS + 2, 20);
+        for (int i = 0; i < calls; i++)
+        {
+            Call call = generator.next();
+            if(call.op == ADD)
+                call.arg *= 5;
+            /*up to 1200 rows, some more than there are models*/
+            if(call.op == WORST)
+                call.arg *= 60;
+            text += callLine(call);
+        }
+        return text;
+    }
+
+    /*the replies to the binary records of text's commands, as the shell would print them*/
+    std::string binaryExchange(const std::string& path, const std::string& text, int read_delay_ms,
+        size_t* reply_size)
+    {
+        OutputBuffer request(-1);
+        const char* cursor = text.data();
+        Command command;
+        while(parseCommand(cursor, text.data() + text.size(), command))
+        {
+            encodeCommand(command, request);
+        }
+        std::string records(request.data(), request.length());
+        std::string reply = exchange(path, records, false, read_delay_ms, nullptr);
+        *reply_size = reply.size();
+        OutputBuffer replies(-1);
+        CommandResult result;
+        int* types = nullptr;
+        int* models = nullptr;
+        int capacity = 0;
+        cursor = reply.data();
+        while(decodeResult(cursor, reply.data() + reply.size(), command, result, types, models, capacity))
+        {
+            formatResult(command, result, replies);
+        }
+        CHECK(cursor == reply.data() + reply.size());
+        free(types);
+        free(models);
+        return std::string(replies.data(), replies.length());
+    }
+
+    /*the shell's output for Init and input, without the Init line*/
+    std::string shellOutput(const std::string& shell, const std::string& input)
+    {
+        TempFile file("Init\n" + input);
+        int exit_code = -1;
+        std::string output = runProgram({ shell }, file.path(), &exit_code);
+        CHECK(exit_code == 0);
+        size_t first_line = output.find('\n');
+        return first_line == std::string::npos ? "" : output.substr(first_line + 1);
+    }
+}
+
+int main(int argc, const char** argv)
+{
+    if(argc != 2)
+    {
+        fprintf(stderr, "usage: %s <hw1_wet>\n", argv[0]);
+        return 1;
+    }
+    std::string shell = argv[1];
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/wet1_test_server_%d.sock", (int)getpid());
+    pid_t server = startProgram({ shell, "--server", path }, nullptr, -1);
+    CHECK(server > 0);
+
+    std::string text_trace = makeTrace(1, 16000);
+    std::string binary_trace = makeTrace(2, 16000);
+    std::string replies = exchange(path, text_trace, false, 300, nullptr);
+    size_t binary_size = 0;
+    CHECK(replies.size() > 2 * HIGH_WATER);
+    replies += binaryExchange(path, binary_trace, 300, &binary_size);
+    CHECK(binary_size > 2 * HIGH_WATER);
+
+    /*dropped: a line that never ends, and a comment record claiming INT_MAX bytes*/
+    bool sent_all = true;
+    CHECK(exchange(path, std::string(TOO_LONG, 'x'), true, 0, &sent_all).empty());
+    CHECK(!sent_all);
+    const char crafted[RECORD_SIZE] = { (char)RECORD_NONE, 0, 0, 0, (char)0xf9, (char)0xff, (char)0xff, 0x7f };
+    CHECK(exchange(path, std::string(crafted, RECORD_SIZE), true, 0, nullptr).empty());
+
+    /*the state is the same after them*/
+    std::string last_trace = "GetWorstModels 50\nGetBestSellerModelByType 0\nSellCar 1 1\n";
+    replies += exchange(path, last_trace, false, 0, nullptr);
+
+    std::string expected = shellOutput(shell, text_trace + binary_trace + last_trace);
+    reportMismatch("server replies", replies, expected);
+    CHECK(replies == expected);
+
+    int status = -1;
+    CHECK(kill(server, SIGTERM) == 0);
+    CHECK(waitpid(server, &status, 0) == server);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    return checkFailures() != 0;
+}
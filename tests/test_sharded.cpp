@@ -0,0 +1,102 @@
+/*
+ * Threads that each own a set of type ids run random operations on a
+ * ShardedCarDealershipManager at once, while another thread runs the global
+ * queries. Since the owners' types are disjoint, replaying every thread's
+ * log one after the other on a single CarDealershipManager must give the
+ * same result for each call, and the same global state at the end.
+ */
+#include "Calls.h"
+#include "Check.h"
+#include "ShardedCarDealershipManager.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace wet1;
+
+namespace
+{
+    const int THREADS = 4;
+    const int SHARDS = 8;
+    const int TYPES = 200;
+    const int OPS = 20000;
+
+    void owner(ShardedCarDealershipManager& sharded, int thread, std::vector<LoggedCall>& log)
+    {
+        CallMix mix = { 5, 2, 53, 15, 0 };
+        CallGenerator calls(thread + 1, mix, TYPES, 40, 40);
+        calls.ownTypes(thread, THREADS);
+        for (int i = 0; i < OPS; i++)
+        {
+            LoggedCall logged;
+            logged.call = calls.next();
+            logged.result = applyCall(sharded, logged.call);
+            log.push_back(logged);
+        }
+    }
+
+    void globalReader(ShardedCarDealershipManager& sharded, std::atomic<bool>& done)
+    {
+        std::vector<int> types(500), models(500);
+        while(!done.load())
+        {
+            int model;
+            StatusType status = sharded.GetBestSellerModelByType(0, &model);
+            CHECK(status == SUCCESS || status == FAILURE);
+            status = sharded.GetWorstModels(500, types.data(), models.data());
+            CHECK(status == SUCCESS || status == FAILURE);
+            for (int i = 0; status == SUCCESS && i < 500; i++)
+            {
+                CHECK(types[i] > 0 && types[i] <= TYPES && models[i] >= 0);
+            }
+        }
+    }
+}
+
+int main()
+{
+    ShardedCarDealershipManager sharded(SHARDS);
+    std::vector<std::vector<LoggedCall> > logs(THREADS);
+    std::atomic<bool> done(false);
+    std::thread reader(globalReader, std::ref(sharded), std::ref(done));
+    std::vector<std::thread> owners;
+    for (int thread = 0; thread < THREADS; thread++)
+    {
+        owners.emplace_back(owner, std::ref(sharded), thread, std::ref(logs[thread]));
+    }
+    for (std::thread& thread : owners)
+    {
+        thread.join();
+    }
+    done = true;
+    reader.join();
+
+    CarDealershipManager single;
+    for (std::vector<LoggedCall>& log : logs)
+    {
+        for (LoggedCall& logged : log)
+        {
+            CHECK(applyCall(single, logged.call) == logged.result);
+        }
+    }
+    int models_num = single.getModelsNum();
+    std::vector<int> types(models_num + 1), models(models_num + 1);
+    std::vector<int> single_types(models_num + 1), single_models(models_num + 1);
+    CHECK(sharded.GetWorstModels(models_num + 1, types.data(), models.data()) == FAILURE);
+    /*small requests merge a share of each shard, bigger ones fetch more of the shards they drain*/
+    int sizes[] = { 1, 2, SHARDS, 3 * SHARDS + 1, 500, models_num / 3, models_num };
+    for (int size : sizes)
+    {
+        if(size <= 0)
+            continue;
+        CHECK(sharded.GetWorstModels(size, types.data(), models.data()) == SUCCESS);
+        CHECK(single.GetWorstModels(size, single_types.data(), single_models.data()) == SUCCESS);
+        CHECK(std::equal(types.begin(), types.begin() + size, single_types.begin()));
+        CHECK(std::equal(models.begin(), models.begin() + size, single_models.begin()));
+    }
+    int best = -1, single_best = -1;
+    CHECK(sharded.GetBestSellerModelByType(0, &best) == single.GetBestSellerModelByType(0, &single_best));
+    CHECK(best == single_best);
+    return checkFailures() != 0;
+}
@@ -0,0 +1,153 @@
+/*
+ * A writer runs a random trace on a SharedCarDealershipManager and on a
+ * CarDealershipManager, and every result must match. Forked reader
+ * processes query the segment meanwhile. The writer publishes how many
+ * operations it finished, and each reader replays the same trace on its
+ * own CarDealershipManager. An answer must then be the one of some state
+ * from the count before the query to one past the count after it, no
+ * earlier than the state of the reader's last answer.
+ */
+#include "CarDealershipManager.h"
+#include "Calls.h"
+#include "Check.h"
+#include "SharedCarDealershipManager.h"
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <random>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace wet1;
+
+namespace
+{
+    const int READERS = 3;
+    const int TYPES = 30;
+    const int OPS = 30000;
+    const int WORST_N = 8;
+    const size_t SEGMENT_SIZE = 16 << 20;
+
+    /*in anonymous shared memory, mapped before the readers are forked*/
+    struct Control
+    {
+        std::atomic<int> done_ops;
+        std::atomic<bool> finished;
+        std::atomic<long> answers[READERS];
+    };
+
+    std::vector<Call> makeTrace()
+    {
+        std::vector<Call> trace;
+        for (int type = 1; type <= TYPES; type++)
+        {
+            Call call = { ADD, type, 0, 10 };
+            trace.push_back(call);
+        }
+        CallMix mix = { 3, 3, 64, 0, 0 };
+        std::vector<Call> calls = CallGenerator(11, mix, TYPES, 12, 12).trace(OPS - TYPES);
+        trace.insert(trace.end(), calls.begin(), calls.end());
+        return trace;
+    }
+
+    /*type 0 asks GetWorstModels, any other GetBestSellerModelByType*/
+    template<typename Manager>
+    CallResult query(Manager& manager, int type)
+    {
+        Call call = { type ? BEST : WORST, type, 0, WORST_N };
+        return queryCall(manager, call);
+    }
+
+    int reader(const char* name, const std::vector<Call>& trace, Control& control, int index)
+    {
+        SharedDealershipReader shared;
+        CHECK(shared.open(name));
+        CarDealershipManager replica;
+        int replayed = 0;
+        std::mt19937 rng(100 + index);
+        while(!control.finished.load())
+        {
+            int type = rng() % (TYPES + 1);
+            int before = control.done_ops.load();
+            CallResult answer = query(shared, type);
+            int after = std::min(control.done_ops.load() + 1, (int)trace.size());
+            for (; replayed < before; replayed++)
+            {
+                applyCall(replica, trace[replayed]);
+            }
+            /*the first state from the reader's last one that gives the answer*/
+            bool seen = query(replica, type) == answer;
+            for (; !seen && replayed < after; replayed++)
+            {
+                applyCall(replica, trace[replayed]);
+                seen = query(replica, type) == answer;
+            }
+            CHECK(seen);
+            if(!seen)
+                break;
+            control.answers[index]++;
+        }
+        return checkFailures() != 0;
+    }
+}
+
+int main()
+{
+    std::vector<Call> trace = makeTrace();
+    char name[64];
+    snprintf(name, sizeof(name), "/wet1_test_shared_%d", (int)getpid());
+    SharedCarDealershipManager shared;
+    CHECK(shared.create(name, SEGMENT_SIZE));
+    void* memory = mmap(nullptr, sizeof(Control), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    CHECK(memory != MAP_FAILED);
+    if(checkFailures())
+        return 1;
+    Control& control = *new (memory) Control();
+
+    std::vector<pid_t> readers;
+    for (int i = 0; i < READERS; i++)
+    {
+        pid_t pid = fork();
+        if(pid == 0)
+        {
+            int status = reader(name, trace, control, i);
+            fflush(stderr);
+            _exit(status);
+        }
+        CHECK(pid > 0);
+        readers.push_back(pid);
+    }
+
+    CarDealershipManager single;
+    for (int i = 0; i < (int)trace.size(); i++)
+    {
+        CHECK(applyCall(shared, trace[i]) == applyCall(single, trace[i]));
+        control.done_ops.store(i + 1);
+        if(i % 64 == 0)
+        {
+            int type = i / 64 % (TYPES + 1);
+            CHECK(query(shared, type) == query(single, type));
+            /*let the readers run on a single core too*/
+            std::this_thread::yield();
+        }
+    }
+    for (int type = 0; type <= TYPES; type++)
+    {
+        CHECK(query(shared, type) == query(single, type));
+    }
+    control.finished.store(true);
+
+    for (int i = 0; i < READERS; i++)
+    {
+        int status = -1;
+        CHECK(waitpid(readers[i], &status, 0) == readers[i]);
+        CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        CHECK(control.answers[i].load() > 0);
+    }
+    munmap(memory, sizeof(Control));
+    return checkFailures() != 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * Random traces on a CarDealershipManager with the worst models cache on,
+ * next to one with it off. Every call, and GetWorstModels above all, must
+ * give the same result on both - a missed invalidation shows up as a stale
+ * list. Small caches and small requests keep models crossing the bound.
+ */
+#include "CarDealershipManager.h"
+#include "Calls.h"
+#include "Check.h"
+#include <stdio.h>
+
+using namespace wet1;
+
+namespace
+{
+    const int TYPES = 40;
+    const int MODELS = 10;
+    const int OPS = 40000;
+
+    /*returns how many GetWorstModels calls were compared*/
+    long run(int cache_size, unsigned seed)
+    {
+        CarDealershipManager cached, plain;
+        CHECK(cached.SetWorstModelsCacheSize(cache_size) == SUCCESS);
+        CallMix mix = { 6, 3, 40, 2, 25 };
+        /*requests up to twice the cache, so both paths run*/
+        CallGenerator calls(seed, mix, TYPES, MODELS, 2 * cache_size);
+        long worst = 0;
+        for (int i = 0; i < OPS; i++)
+        {
+            Call call = calls.next();
+            CHECK(applyCall(cached, call) == applyCall(plain, call));
+            worst += call.op == WORST;
+            /*one request at exactly the bound after every mutation*/
+            if(call.op < BEST)
+            {
+                Call bound = { WORST, 0, 0, cache_size };
+                CHECK(applyCall(cached, bound) == applyCall(plain, bound));
+                worst++;
+            }
+        }
+        /*resizing drops the cache, and 0 turns it off*/
+        Call all = { WORST, 0, 0, plain.getModelsNum() };
+        CHECK(cached.SetWorstModelsCacheSize(cache_size + 1) == SUCCESS);
+        CHECK(applyCall(cached, all) == applyCall(plain, all));
+        CHECK(cached.SetWorstModelsCacheSize(0) == SUCCESS);
+        CHECK(applyCall(cached, all) == applyCall(plain, all));
+        CHECK(cached.SetWorstModelsCacheSize(-1) == INVALID_INPUT);
+        return worst;
+    }
+}
+
+int main()
+{
+    int sizes[] = { 1, 3, 16, 100 };
+    for (int i = 0; i < 4; i++)
+    {
+        long compared = run(sizes[i], 20 + i);
+        printf("cache of %d: %ld GetWorstModels compared\n", sizes[i], compared);
+    }
+    return checkFailures() != 0;
+}
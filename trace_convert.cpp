@@ -0,0 +1,110 @@
+/*
+ * trace_convert - converts between the shell's text traces and the binary
+ * record format of BinaryProtocol.h.
+ *
+ *   trace_convert text2bin <commands.txt> <commands.bin>
+ *   trace_convert bin2text <commands.bin> <commands.txt>
+ *   trace_convert results2text <results.bin> <out.txt>
+ *
+ * results2text prints exactly what the text shell prints for the same trace,
+ * so binary runs can be diffed against the expected out.txt files.
+ */
+#include "BinaryProtocol.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace wet1;
+
+static int openOutput(const char* path)
+{
+    if(strcmp(path, "-") == 0)
+        return 1;
+    return open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+static void writeCommandText(const Command& command, OutputBuffer& out)
+{
+    if(command.kind == CMD_COMMENT || command.kind == CMD_NONE)
+    {
+        out.append(command.text, command.text_len);
+        return;
+    }
+    out.append(commandName(command.kind));
+    if(command.valid)
+    {
+        for (int i = 0; i < commandArgsNum(command.kind); i++)
+        {
+            out.appendChar(' ');
+            out.appendInt(command.args[i]);
+        }
+    }
+    out.appendChar('\n');
+}
+
+int main(int argc, const char** argv)
+{
+    if(argc != 4)
+    {
+        fprintf(stderr, "usage: %s text2bin|bin2text|results2text <in> <out>\n", argv[0]);
+        return 1;
+    }
+    InputFile input;
+    if(!input.open(argv[2]))
+    {
+        fprintf(stderr, "%s: can't read %s\n", argv[0], argv[2]);
+        return 1;
+    }
+    int fd = openOutput(argv[3]);
+    if(fd < 0)
+    {
+        fprintf(stderr, "%s: can't write %s\n", argv[0], argv[3]);
+        return 1;
+    }
+    const char* cursor = input.begin();
+    const char* end = input.end();
+    bool truncated = false;
+    {
+        OutputBuffer out(fd);
+        Command command;
+        if(strcmp(argv[1], "text2bin") == 0)
+        {
+            while(parseCommand(cursor, end, command))
+                encodeCommand(command, out);
+        }
+        else if(strcmp(argv[1], "bin2text") == 0)
+        {
+            while(decodeCommand(cursor, end, command))
+                writeCommandText(command, out);
+            truncated = cursor != end;
+        }
+        else if(strcmp(argv[1], "results2text") == 0)
+        {
+            CommandResult result;
+            int* types = nullptr;
+            int* models = nullptr;
+            int capacity = 0;
+            while(decodeResult(cursor, end, command, result, types, models, capacity))
+                formatResult(command, result, out);
+            truncated = cursor != end;
+            free(types);
+            free(models);
+        }
+        else
+        {
+            fprintf(stderr, "%s: unknown mode %s\n", argv[0], argv[1]);
+            truncated = true;
+        }
+        out.flush();
+    }
+    if(fd != 1)
+        close(fd);
+    if(truncated)
+    {
+        fprintf(stderr, "%s: bad record in %s\n", argv[0], argv[2]);
+        return 1;
+    }
+    return 0;
+}